@@ -0,0 +1,355 @@
+#include "bench-common.h"
+
+#include <unistd.h>
+
+#define ROW_HEIGHT 50
+
+/* BenchItem {{{ */
+G_DEFINE_TYPE (BenchItem, bench_item, G_TYPE_OBJECT)
+
+static void bench_item_init (BenchItem *item) {}
+static void bench_item_class_init (BenchItemClass *class) {}
+/* }}} */
+
+/* BenchModel {{{ */
+struct _BenchModel
+{
+  GObject parent_instance;
+
+  guint n_items;
+  gboolean variable_heights;
+  /* Index → live item if set, see bench_model_set_stable_items() */
+  GHashTable *items;
+};
+
+static void
+item_finalized_cb (gpointer  data,
+                   GObject  *where_the_object_was)
+{
+  BenchModel *self = data;
+
+  g_hash_table_remove (self->items, GUINT_TO_POINTER (((BenchItem *)where_the_object_was)->index));
+}
+
+static void
+forget_items (BenchModel *self)
+{
+  GHashTableIter iter;
+  gpointer item;
+
+  if (self->items == NULL)
+    return;
+
+  g_hash_table_iter_init (&iter, self->items);
+  while (g_hash_table_iter_next (&iter, NULL, &item))
+    g_object_weak_unref (item, item_finalized_cb, self);
+  g_hash_table_remove_all (self->items);
+}
+
+static GType
+bench_model_get_item_type (GListModel *model)
+{
+  return BENCH_TYPE_ITEM;
+}
+
+static guint
+bench_model_get_n_items (GListModel *model)
+{
+  return BENCH_MODEL (model)->n_items;
+}
+
+static gpointer
+bench_model_get_item (GListModel *model,
+                      guint       position)
+{
+  BenchModel *self = BENCH_MODEL (model);
+  BenchItem *item;
+
+  if (position >= self->n_items)
+    return NULL;
+
+  if (self->items != NULL)
+    {
+      item = g_hash_table_lookup (self->items, GUINT_TO_POINTER (position));
+      if (item != NULL)
+        return g_object_ref (item);
+    }
+
+  item = g_object_new (BENCH_TYPE_ITEM, NULL);
+  item->index = position;
+
+  if (self->variable_heights)
+    /* Deterministic, but all over the place */
+    item->height = ROW_HEIGHT / 2 + (g_int_hash (&position) * 2654435761u) % (ROW_HEIGHT * 3);
+  else
+    item->height = ROW_HEIGHT;
+
+  if (self->items != NULL)
+    {
+      g_hash_table_insert (self->items, GUINT_TO_POINTER (position), item);
+      g_object_weak_ref (G_OBJECT (item), item_finalized_cb, self);
+    }
+
+  return item;
+}
+
+static void
+bench_model_list_model_init (GListModelInterface *iface)
+{
+  iface->get_item_type = bench_model_get_item_type;
+  iface->get_n_items   = bench_model_get_n_items;
+  iface->get_item      = bench_model_get_item;
+}
+
+G_DEFINE_TYPE_WITH_CODE (BenchModel, bench_model, G_TYPE_OBJECT,
+                         G_IMPLEMENT_INTERFACE (G_TYPE_LIST_MODEL, bench_model_list_model_init))
+
+static void
+bench_model_finalize (GObject *object)
+{
+  BenchModel *self = BENCH_MODEL (object);
+
+  forget_items (self);
+  g_clear_pointer (&self->items, g_hash_table_unref);
+
+  G_OBJECT_CLASS (bench_model_parent_class)->finalize (object);
+}
+
+static void bench_model_init (BenchModel *model) {}
+
+static void
+bench_model_class_init (BenchModelClass *class)
+{
+  G_OBJECT_CLASS (class)->finalize = bench_model_finalize;
+}
+
+BenchModel *
+bench_model_new (guint    n_items,
+                 gboolean variable_heights)
+{
+  BenchModel *model = g_object_new (BENCH_TYPE_MODEL, NULL);
+
+  model->n_items = n_items;
+  model->variable_heights = variable_heights;
+
+  return model;
+}
+
+/* If set, get_item() returns the same object for an index while it's alive,
+ * like models of actual objects do. Otherwise it's a new one every time. */
+void
+bench_model_set_stable_items (BenchModel *model,
+                              gboolean    stable_items)
+{
+  forget_items (model);
+  g_clear_pointer (&model->items, g_hash_table_unref);
+
+  if (stable_items)
+    model->items = g_hash_table_new (NULL, NULL);
+}
+
+void
+bench_model_splice (BenchModel *model,
+                    guint       position,
+                    guint       removed,
+                    guint       added)
+{
+  g_assert (position + removed <= model->n_items);
+
+  /* Items are made up from their index, which changes for all of them */
+  forget_items (model);
+
+  model->n_items = model->n_items - removed + added;
+  g_list_model_items_changed (G_LIST_MODEL (model), position, removed, added);
+}
+/* }}} */
+
+/* Rows {{{ */
+static GtkWidget *
+simple_fill_func (gpointer   item,
+                  GtkWidget *old_widget,
+                  guint      item_index,
+                  gpointer   user_data)
+{
+  BenchItem *data = item;
+  GtkWidget *label;
+  char buf[32];
+
+  if (G_UNLIKELY (!old_widget))
+    label = gtk_label_new ("");
+  else
+    label = old_widget;
+
+  g_snprintf (buf, sizeof (buf), "Row %u", data->index);
+  gtk_label_set_label (GTK_LABEL (label), buf);
+  gtk_widget_set_size_request (label, -1, data->height);
+
+  return label;
+}
+
+static GtkWidget *
+complex_fill_func (gpointer   item,
+                   GtkWidget *old_widget,
+                   guint      item_index,
+                   gpointer   user_data)
+{
+  BenchItem *data = item;
+  GtkWidget *box;
+  GtkWidget *label1, *label2, *sw;
+  char buf[32];
+
+  if (G_UNLIKELY (!old_widget))
+    {
+      box = gtk_box_new (GTK_ORIENTATION_HORIZONTAL, 6);
+      label1 = gtk_label_new ("");
+      label2 = gtk_label_new ("");
+      sw = gtk_switch_new ();
+
+      gtk_label_set_ellipsize (GTK_LABEL (label2), PANGO_ELLIPSIZE_END);
+      gtk_widget_set_hexpand (label2, TRUE);
+      gtk_widget_set_valign (sw, GTK_ALIGN_CENTER);
+
+      gtk_container_add (GTK_CONTAINER (box), gtk_image_new_from_icon_name ("list-add-symbolic"));
+      gtk_container_add (GTK_CONTAINER (box), label1);
+      gtk_container_add (GTK_CONTAINER (box), label2);
+      gtk_container_add (GTK_CONTAINER (box), gtk_button_new_with_label ("Click Me"));
+      gtk_container_add (GTK_CONTAINER (box), sw);
+
+      g_object_set_data (G_OBJECT (box), "label1", label1);
+      g_object_set_data (G_OBJECT (box), "label2", label2);
+      g_object_set_data (G_OBJECT (box), "switch", sw);
+    }
+  else
+    {
+      box = old_widget;
+      label1 = g_object_get_data (G_OBJECT (box), "label1");
+      label2 = g_object_get_data (G_OBJECT (box), "label2");
+      sw = g_object_get_data (G_OBJECT (box), "switch");
+    }
+
+  g_snprintf (buf, sizeof (buf), "Row %'u", data->index);
+  gtk_label_set_label (GTK_LABEL (label1), buf);
+  gtk_label_set_markup (GTK_LABEL (label2),
+                        "Some <b>longer</b> text that will get ellipsized <a href=\"foo\">at some point</a>");
+  gtk_switch_set_active (GTK_SWITCH (sw), data->index % 2 == 0);
+  gtk_widget_set_size_request (box, -1, data->height);
+
+  return box;
+}
+/* }}} */
+
+BenchList *
+bench_list_new (GListModel *model,
+                gboolean    complex_rows,
+                int         width,
+                int         height)
+{
+  BenchList *list = g_new0 (BenchList, 1);
+
+  list->listbox = gd_model_list_box_new ();
+  list->scroller = gtk_scrolled_window_new (NULL, NULL);
+  gtk_container_add (GTK_CONTAINER (list->scroller), list->listbox);
+  g_object_ref_sink (G_OBJECT (list->scroller));
+
+  list->vadjustment = gtk_scrolled_window_get_vadjustment (GTK_SCROLLED_WINDOW (list->scroller));
+
+  gd_model_list_box_set_model (GD_MODEL_LIST_BOX (list->listbox), model,
+                               complex_rows ? complex_fill_func : simple_fill_func, NULL, NULL,
+                               NULL, NULL, NULL);
+
+  list->allocation.x = 0;
+  list->allocation.y = 0;
+  list->allocation.width = width;
+  list->allocation.height = height;
+
+  return list;
+}
+
+void
+bench_list_free (BenchList *list)
+{
+  g_object_unref (list->scroller);
+  g_free (list);
+}
+
+/* One layout pass, the same the frame clock would do. Returns the time it took in µs */
+gint64
+bench_list_frame (BenchList *list)
+{
+  gint64 start = g_get_monotonic_time ();
+  int min;
+
+  gtk_widget_measure (list->scroller, GTK_ORIENTATION_HORIZONTAL, -1, &min, NULL, NULL, NULL);
+  gtk_widget_size_allocate (list->scroller, &list->allocation, -1);
+
+  return g_get_monotonic_time () - start;
+}
+
+static int
+compare_frame_times (gconstpointer a,
+                     gconstpointer b)
+{
+  gint64 t1 = *(const gint64 *)a;
+  gint64 t2 = *(const gint64 *)b;
+
+  return t1 < t2 ? -1 : (t1 > t2 ? 1 : 0);
+}
+
+/* @frame_times gets sorted */
+double
+bench_percentile (GArray *frame_times,
+                  double  percentile)
+{
+  guint index;
+
+  if (frame_times->len == 0)
+    return 0;
+
+  g_array_sort (frame_times, compare_frame_times);
+  index = (guint) ((frame_times->len - 1) * percentile / 100.0);
+
+  return g_array_index (frame_times, gint64, index);
+}
+
+/* Resident set size in bytes */
+gsize
+bench_get_rss (void)
+{
+  char *contents;
+  gsize rss = 0;
+
+  if (g_file_get_contents ("/proc/self/statm", &contents, NULL, NULL))
+    {
+      char **parts = g_strsplit (contents, " ", -1);
+
+      if (parts[0] != NULL && parts[1] != NULL)
+        rss = g_ascii_strtoull (parts[1], NULL, 10) * sysconf (_SC_PAGESIZE);
+
+      g_strfreev (parts);
+      g_free (contents);
+    }
+
+  return rss;
+}
+
+/* Returns FALSE if there is no display at all. meson runs us through
+ * xvfb-run if available. Otherwise we try a broadway server, and if there
+ * isn't one either, the benchmark fails rather than silently not running. */
+gboolean
+bench_init (void)
+{
+  if (gtk_init_check ())
+    return TRUE;
+
+  if (g_getenv ("GDK_BACKEND") == NULL)
+    {
+      g_printerr ("No display, trying broadway\n");
+      g_setenv ("GDK_BACKEND", "broadway", TRUE);
+
+      if (gtk_init_check ())
+        return TRUE;
+    }
+
+  g_printerr ("Could not initialize GTK. Run under xvfb-run or with a broadway server\n");
+  return FALSE;
+}
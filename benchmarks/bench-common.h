@@ -0,0 +1,54 @@
+#ifndef _BENCH_COMMON_H_
+#define _BENCH_COMMON_H_
+
+#include <gtk/gtk.h>
+#include "gd-model-list-box.h"
+
+/* Items are synthesized on demand, so even 10⁷ rows don't cost any memory
+ * and whatever we measure is the list box, not the model. */
+struct _BenchItem
+{
+  GObject parent_instance;
+
+  guint index;
+  int height;
+};
+
+typedef struct _BenchItem BenchItem;
+
+#define BENCH_TYPE_ITEM bench_item_get_type ()
+G_DECLARE_FINAL_TYPE (BenchItem, bench_item, BENCH, ITEM, GObject)
+
+#define BENCH_TYPE_MODEL bench_model_get_type ()
+G_DECLARE_FINAL_TYPE (BenchModel, bench_model, BENCH, MODEL, GObject)
+
+BenchModel * bench_model_new              (guint       n_items,
+                                           gboolean    variable_heights);
+void         bench_model_set_stable_items (BenchModel *model,
+                                           gboolean    stable_items);
+void         bench_model_splice           (BenchModel *model,
+                                           guint       position,
+                                           guint       removed,
+                                           guint       added);
+
+typedef struct
+{
+  GtkWidget *scroller;
+  GtkWidget *listbox;
+  GtkAdjustment *vadjustment;
+  GtkAllocation allocation;
+} BenchList;
+
+BenchList *  bench_list_new     (GListModel *model,
+                                 gboolean    complex_rows,
+                                 int         width,
+                                 int         height);
+void         bench_list_free    (BenchList  *list);
+gint64       bench_list_frame   (BenchList  *list);
+
+double       bench_percentile   (GArray     *frame_times,
+                                 double      percentile);
+gsize        bench_get_rss      (void);
+gboolean     bench_init         (void);
+
+#endif
@@ -0,0 +1,150 @@
+#include "bench-common.h"
+
+#define WIDTH  600
+#define HEIGHT 800
+
+static int max_exponent = 7;
+static int n_frames = 200;
+
+static GOptionEntry entries[] = {
+  { "max-exponent", 'n', 0, G_OPTION_ARG_INT, &max_exponent, "Largest model size as power of 10 (default 7)", "N" },
+  { "frames", 'f', 0, G_OPTION_ARG_INT, &n_frames, "Frames per scroll pattern (default 200)", "N" },
+  { NULL }
+};
+
+typedef enum {
+  SCROLL_STEPS,  /* Small steps, like kinetic scrolling */
+  SCROLL_PAGES,  /* Page-sized steps, like a fast fling */
+  SCROLL_JUMPS,  /* Random positions, like clicking the scrollbar trough */
+  SCROLL_WOBBLE, /* Back and forth, so the same rows keep coming back */
+} ScrollPattern;
+
+static const char *pattern_names[] = { "steps", "pages", "jumps", "wobble" };
+
+static double
+next_value (BenchList     *list,
+            ScrollPattern  pattern,
+            int            frame,
+            GRand         *rand)
+{
+  double value = gtk_adjustment_get_value (list->vadjustment);
+  double max_value = gtk_adjustment_get_upper (list->vadjustment) -
+                     gtk_adjustment_get_page_size (list->vadjustment);
+
+  switch (pattern)
+    {
+      case SCROLL_STEPS:
+        value += 37;
+        break;
+      case SCROLL_PAGES:
+        value += gtk_adjustment_get_page_size (list->vadjustment) * 0.8;
+        break;
+      case SCROLL_JUMPS:
+        value = g_rand_double_range (rand, 0, max_value);
+        break;
+      case SCROLL_WOBBLE:
+        value += frame % 2 == 0 ? 150 : -100;
+        break;
+    }
+
+  /* Wrap around at the end so every frame actually scrolls */
+  if (value > max_value)
+    value = 0;
+
+  return value;
+}
+
+static void
+run (guint         n_items,
+     gboolean      variable_heights,
+     gboolean      complex_rows,
+     ScrollPattern pattern,
+     gboolean      stable_items)
+{
+  BenchModel *model = bench_model_new (n_items, variable_heights);
+  BenchList *list;
+  GArray *frame_times = g_array_sized_new (FALSE, FALSE, sizeof (gint64), n_frames);
+  GRand *rand = g_rand_new_with_seed (n_items);
+  GdModelListBoxStats stats;
+  gint64 first_frame;
+  int i;
+
+  bench_model_set_stable_items (model, stable_items);
+  list = bench_list_new (G_LIST_MODEL (model), complex_rows, WIDTH, HEIGHT);
+
+  first_frame = bench_list_frame (list);
+  gd_model_list_box_reset_stats (GD_MODEL_LIST_BOX (list->listbox));
+
+  for (i = 0; i < n_frames; i ++)
+    {
+      gint64 frame_time;
+
+      gtk_adjustment_set_value (list->vadjustment, next_value (list, pattern, i, rand));
+      frame_time = bench_list_frame (list);
+      g_array_append_val (frame_times, frame_time);
+    }
+
+  gd_model_list_box_get_stats (GD_MODEL_LIST_BOX (list->listbox), &stats);
+
+  g_print ("%9u  %-8s  %-7s  %-6s  %-6s  %6" G_GINT64_FORMAT "  %6.0f  %6.0f  %6.0f  %6.0f  %6.2f  %6.2f  %7.1f  %6" G_GSIZE_FORMAT "\n",
+           n_items,
+           variable_heights ? "variable" : "uniform",
+           complex_rows ? "complex" : "simple",
+           pattern_names[pattern],
+           stable_items ? "stable" : "fresh",
+           first_frame,
+           bench_percentile (frame_times, 50),
+           bench_percentile (frame_times, 90),
+           bench_percentile (frame_times, 99),
+           bench_percentile (frame_times, 100),
+           (double)stats.fill_calls / n_frames,
+           (double)stats.affine_hits / n_frames,
+           (double)stats.measure_calls / n_frames,
+           bench_get_rss () / 1024);
+
+  g_rand_free (rand);
+  g_array_free (frame_times, TRUE);
+  bench_list_free (list);
+  g_object_unref (model);
+}
+
+int
+main (int argc, char **argv)
+{
+  GOptionContext *context;
+  GError *error = NULL;
+  guint64 max_items = 1;
+  guint n_items;
+  int variable_heights, complex_rows, pattern, stable_items;
+  int i;
+
+  context = g_option_context_new ("- GdModelListBox layout benchmark");
+  g_option_context_add_main_entries (context, entries, NULL);
+  if (!g_option_context_parse (context, &argc, &argv, &error))
+    {
+      g_printerr ("%s\n", error->message);
+      return 1;
+    }
+  g_option_context_free (context);
+
+  if (!bench_init ())
+    return 1;
+
+  g_print ("Frame times in µs, memory in KiB\n");
+  g_print ("%9s  %-8s  %-7s  %-6s  %-6s  %6s  %6s  %6s  %6s  %6s  %6s  %6s  %7s  %6s\n",
+           "items", "heights", "rows", "scroll", "model", "first",
+           "p50", "p90", "p99", "max", "binds", "affine", "measure", "rss");
+
+  for (i = 0; i < max_exponent; i ++)
+    max_items *= 10;
+
+  for (n_items = 1000; n_items <= max_items; n_items *= 10)
+    for (variable_heights = 0; variable_heights <= 1; variable_heights ++)
+      for (complex_rows = 0; complex_rows <= 1; complex_rows ++)
+        for (pattern = SCROLL_STEPS; pattern <= SCROLL_WOBBLE; pattern ++)
+          /* Pooled rows only get their item back if it's the same object */
+          for (stable_items = 0; stable_items <= (pattern == SCROLL_WOBBLE); stable_items ++)
+            run (n_items, variable_heights, complex_rows, pattern, stable_items);
+
+  return 0;
+}
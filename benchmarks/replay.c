@@ -0,0 +1,140 @@
+#include "bench-common.h"
+
+/* One frame at 60Hz. Events within the same frame interval are applied
+ * together before the layout pass, just like the frame clock would. */
+#define FRAME_INTERVAL (G_USEC_PER_SEC / 60)
+
+static gboolean variable_heights = FALSE;
+static gboolean complex_rows = FALSE;
+static int repeat = 1;
+
+static GOptionEntry entries[] = {
+  { "variable-heights", 'v', 0, G_OPTION_ARG_NONE, &variable_heights, "Use rows of different heights", NULL },
+  { "complex", 'c', 0, G_OPTION_ARG_NONE, &complex_rows, "Use complex rows instead of labels", NULL },
+  { "repeat", 'r', 0, G_OPTION_ARG_INT, &repeat, "Replay the trace N times (default 1)", "N" },
+  { NULL }
+};
+
+static void
+apply_event (BenchList                *list,
+             BenchModel               *model,
+             const GdScrollTraceEvent *event)
+{
+  switch (event->type)
+    {
+      case GD_SCROLL_TRACE_VALUE:
+        gtk_adjustment_set_value (list->vadjustment, event->values[0]);
+        break;
+      case GD_SCROLL_TRACE_ALLOCATION:
+        list->allocation.width = event->values[0];
+        list->allocation.height = event->values[1];
+        break;
+      case GD_SCROLL_TRACE_SPLICE:
+        bench_model_splice (model, event->values[0], event->values[1], event->values[2]);
+        break;
+    }
+}
+
+static void
+replay (GdScrollTrace *trace,
+        GArray        *frame_times,
+        guint64       *binds)
+{
+  BenchModel *model = bench_model_new (gd_scroll_trace_get_n_items (trace), variable_heights);
+  BenchList *list = bench_list_new (G_LIST_MODEL (model), complex_rows, 0, 0);
+  const GdScrollTraceEvent *events;
+  GdModelListBoxStats stats;
+  gboolean first_frame = TRUE;
+  guint n_events;
+  guint i = 0;
+
+  events = gd_scroll_trace_get_events (trace, &n_events);
+
+  while (i < n_events)
+    {
+      gint64 frame_end = events[i].time + FRAME_INTERVAL;
+      gint64 frame_time;
+
+      for (; i < n_events && events[i].time < frame_end; i ++)
+        apply_event (list, model, &events[i]);
+
+      frame_time = bench_list_frame (list);
+
+      /* The recording starts with the initial allocation and value,
+       * filling the empty list is not what we are interested in. */
+      if (first_frame)
+        {
+          gd_model_list_box_reset_stats (GD_MODEL_LIST_BOX (list->listbox));
+          first_frame = FALSE;
+          continue;
+        }
+
+      g_array_append_val (frame_times, frame_time);
+    }
+
+  gd_model_list_box_get_stats (GD_MODEL_LIST_BOX (list->listbox), &stats);
+  *binds += stats.fill_calls;
+
+  bench_list_free (list);
+  g_object_unref (model);
+}
+
+int
+main (int argc, char **argv)
+{
+  GOptionContext *context;
+  GError *error = NULL;
+  GdScrollTrace *trace;
+  GArray *frame_times;
+  guint64 binds = 0;
+  guint janky = 0;
+  guint i;
+
+  context = g_option_context_new ("TRACE - Replay a GdModelListBox scroll trace");
+  g_option_context_add_main_entries (context, entries, NULL);
+  if (!g_option_context_parse (context, &argc, &argv, &error))
+    {
+      g_printerr ("%s\n", error->message);
+      return 1;
+    }
+  g_option_context_free (context);
+
+  if (argc != 2)
+    {
+      g_printerr ("Usage: %s [OPTION…] TRACE\n", argv[0]);
+      return 1;
+    }
+
+  trace = gd_scroll_trace_load (argv[1], &error);
+  if (trace == NULL)
+    {
+      g_printerr ("%s\n", error->message);
+      return 1;
+    }
+
+  if (!bench_init ())
+    return 1;
+
+  frame_times = g_array_new (FALSE, FALSE, sizeof (gint64));
+
+  for (i = 0; i < (guint)repeat; i ++)
+    replay (trace, frame_times, &binds);
+
+  for (i = 0; i < frame_times->len; i ++)
+    if (g_array_index (frame_times, gint64, i) > FRAME_INTERVAL)
+      janky ++;
+
+  g_print ("Frames:          %u\n", frame_times->len);
+  g_print ("Over %d µs:     %u\n", (int)FRAME_INTERVAL, janky);
+  g_print ("Binds per frame: %.2f\n", frame_times->len > 0 ? (double)binds / frame_times->len : 0.0);
+  g_print ("Frame times (µs):\n");
+  g_print ("  p50: %6.0f\n", bench_percentile (frame_times, 50));
+  g_print ("  p90: %6.0f\n", bench_percentile (frame_times, 90));
+  g_print ("  p99: %6.0f\n", bench_percentile (frame_times, 99));
+  g_print ("  max: %6.0f\n", bench_percentile (frame_times, 100));
+
+  g_array_free (frame_times, TRUE);
+  gd_scroll_trace_free (trace);
+
+  return 0;
+}
@@ -0,0 +1,137 @@
+#include <gtk/gtk.h>
+#include "gd-model-list-box.h"
+#include "gd-column-box.h"
+
+/* Test class {{{ */
+struct _GdData
+{
+  GObject parent_instance;
+
+  char *name;
+  guint size;
+  const char *description;
+};
+
+typedef struct _GdData GdData;
+
+G_DECLARE_FINAL_TYPE (GdData, gd_data, GD, DATA, GObject)
+G_DEFINE_TYPE (GdData, gd_data, G_TYPE_OBJECT)
+#define GD_TYPE_DATA gd_data_get_type ()
+
+static void gd_data_init (GdData *d) {}
+static void gd_data_finalize (GObject *o) { g_free (((GdData *)o)->name); G_OBJECT_CLASS (gd_data_parent_class)->finalize (o); }
+static void gd_data_class_init (GdDataClass *dc) { G_OBJECT_CLASS (dc)->finalize = gd_data_finalize; }
+/* }}} */
+
+const guint N = 100000;
+
+static const char *CSS =
+"row:hover {"
+"  background-color: alpha(grey, 0.2);"
+"}"
+"row > label {"
+"  padding: 6px 12px;"
+"}"
+;
+
+GtkWidget *
+fill_func (gpointer   item,
+           GtkWidget *old_widget,
+           guint      item_index,
+           gpointer   user_data)
+{
+  GdColumnBox *row;
+  GdData *data = item;
+  char *size;
+
+  if (G_UNLIKELY (!old_widget))
+    {
+      GtkWidget *label;
+
+      row = GD_COLUMN_BOX (gd_column_box_new ());
+
+      label = gtk_label_new ("");
+      gtk_label_set_xalign (GTK_LABEL (label), 0.0);
+      gd_column_box_append (row, label);
+
+      label = gtk_label_new ("");
+      gtk_label_set_xalign (GTK_LABEL (label), 1.0);
+      gd_column_box_append (row, label);
+
+      label = gtk_label_new ("");
+      gtk_label_set_xalign (GTK_LABEL (label), 0.0);
+      gtk_label_set_ellipsize (GTK_LABEL (label), PANGO_ELLIPSIZE_END);
+      gd_column_box_append (row, label);
+    }
+  else
+    {
+      row = GD_COLUMN_BOX (old_widget);
+    }
+
+  size = g_format_size (data->size);
+  gtk_label_set_label (GTK_LABEL (gd_column_box_get_cell (row, 0)), data->name);
+  gtk_label_set_label (GTK_LABEL (gd_column_box_get_cell (row, 1)), size);
+  gtk_label_set_label (GTK_LABEL (gd_column_box_get_cell (row, 2)), data->description);
+  g_free (size);
+
+  return GTK_WIDGET (row);
+}
+
+int
+main (int argc, char **argv)
+{
+  GtkWidget *window;
+  GtkWidget *scroller;
+  GtkWidget *list;
+  GtkCssProvider *css_provider;
+  GListStore *model;
+  guint i;
+
+  gtk_init ();
+
+  window = gtk_window_new (GTK_WINDOW_TOPLEVEL);
+  scroller = gtk_scrolled_window_new (NULL, NULL);
+  list = gd_model_list_box_new ();
+
+  css_provider = gtk_css_provider_new ();
+  gtk_css_provider_load_from_data (css_provider, CSS, -1);
+  gtk_style_context_add_provider_for_display (gdk_display_get_default (),
+                                              GTK_STYLE_PROVIDER (css_provider),
+                                              GTK_STYLE_PROVIDER_PRIORITY_APPLICATION);
+
+  gtk_scrolled_window_set_policy (GTK_SCROLLED_WINDOW (scroller), GTK_POLICY_NEVER, GTK_POLICY_AUTOMATIC);
+
+  /* Name: as wide as the widest name, size: fixed, description: the rest */
+  gd_model_list_box_append_column (GD_MODEL_LIST_BOX (list), -1, FALSE);
+  gd_model_list_box_append_column (GD_MODEL_LIST_BOX (list), 100, FALSE);
+  gd_model_list_box_append_column (GD_MODEL_LIST_BOX (list), 200, TRUE);
+
+  model = g_list_store_new (GD_TYPE_DATA);
+  for (i = 0; i < N; i ++)
+    {
+      GdData *d = g_object_new (GD_TYPE_DATA, NULL);
+
+      d->name = g_strdup_printf ("File %u%s", i, i % 7 == 0 ? " (copy)" : "");
+      d->size = g_random_int_range (0, 100 * 1024 * 1024);
+      d->description = "Some long description text that gets ellipsized when there is no room for it";
+      g_list_store_append (model, d);
+      g_object_unref (d);
+    }
+
+  gd_model_list_box_set_model (GD_MODEL_LIST_BOX (list), G_LIST_MODEL (model),
+                               fill_func, NULL, NULL,
+                               NULL, NULL, NULL);
+
+  gtk_container_add (GTK_CONTAINER (scroller), list);
+  gtk_container_add (GTK_CONTAINER (window), scroller);
+
+  g_signal_connect (G_OBJECT (window), "close-request", G_CALLBACK (gtk_main_quit), NULL);
+
+  gtk_window_resize (GTK_WINDOW (window), 700, 400);
+  gtk_widget_show (window);
+  gtk_main ();
+
+  gtk_widget_destroy (window);
+
+  return 0;
+}
@@ -145,6 +145,17 @@ remove_func (GtkWidget *widget, gpointer item, gpointer user_data)
                                         remove_button_clicked_cb, NULL);
 }
 
+/* Runs on a worker thread, GdData is never changed there */
+static gpointer
+prepare_func (gpointer item,
+              guint    item_index,
+              gpointer user_data)
+{
+  GdData *data = item;
+
+  return g_strdup_printf ("Row %'u of %'u", data->item_index + 1, data->model_size);
+}
+
 GtkWidget *
 fill_func (gpointer   item,
            GtkWidget *old_widget,
@@ -153,7 +164,6 @@ fill_func (gpointer   item,
 {
   GdRowWidget *row;
   GdData *data = item;
-  gchar *label;
 
   if (G_UNLIKELY (!old_widget))
     {
@@ -182,8 +192,8 @@ fill_func (gpointer   item,
 #endif
 
   gtk_image_set_from_icon_name (GTK_IMAGE (row->image), "list-add-symbolic");
-  label = g_strdup_printf ("Row %'u of %'u", data->item_index + 1, data->model_size);
-  gtk_label_set_label (GTK_LABEL (row->label1), label);
+  gtk_label_set_label (GTK_LABEL (row->label1),
+                       gd_model_list_box_get_payload (user_data, item_index));
   gtk_label_set_markup (GTK_LABEL (row->label2), data->text);
   gtk_switch_set_active (GTK_SWITCH (row->_switch), data->on);
   /*gtk_widget_set_margin_top (GTK_WIDGET (row), MIN (200, item_index * 4));*/
@@ -192,8 +202,6 @@ fill_func (gpointer   item,
   g_signal_connect (G_OBJECT (row->remove_button), "clicked",
                     G_CALLBACK (remove_button_clicked_cb), GUINT_TO_POINTER (item_index));
 
-  g_free (label);
-
   return GTK_WIDGET (row);
 }
 
@@ -267,6 +275,31 @@ to_top_button_clicked_cb (GtkButton *button,
   gtk_adjustment_set_value (vadjustment, 0);
 }
 
+static void
+record_button_toggled_cb (GtkToggleButton *button,
+                          gpointer         user_data)
+{
+  GdModelListBox *list = user_data;
+  GdScrollTrace *trace;
+  GError *error = NULL;
+
+  if (gtk_toggle_button_get_active (button))
+    {
+      gd_model_list_box_start_recording (list);
+      return;
+    }
+
+  /* Replay with benchmarks/replay */
+  trace = gd_model_list_box_stop_recording (list);
+  if (!gd_scroll_trace_save (trace, "scroll-trace.txt", &error))
+    {
+      g_warning ("Could not save scroll trace: %s", error->message);
+      g_error_free (error);
+    }
+
+  gd_scroll_trace_free (trace);
+}
+
 int
 main (int argc, char **argv)
 {
@@ -280,6 +313,7 @@ main (int argc, char **argv)
   GtkWidget *scroll_button = gtk_button_new_with_label ("Scroll");
   GtkWidget *to_bottom_button = gtk_button_new_with_label ("To Bottom");
   GtkWidget *to_top_button = gtk_button_new_with_label ("To Top");
+  GtkWidget *record_button = gtk_toggle_button_new_with_label ("Record");
   GtkCssProvider *css_provider;
 
   g_signal_connect (window, "set-focus", G_CALLBACK (set_focus_cb), NULL);
@@ -307,8 +341,9 @@ main (int argc, char **argv)
       g_list_store_append (G_LIST_STORE (model), d);
     }
 
+  gd_model_list_box_set_prepare_func (GD_MODEL_LIST_BOX (list), prepare_func, g_free, NULL, NULL);
   gd_model_list_box_set_model (GD_MODEL_LIST_BOX (list), model,
-                               fill_func, NULL, NULL,
+                               fill_func, list, NULL,
                                remove_func, NULL, NULL);
 
   gtk_container_add (GTK_CONTAINER (scroller), list);
@@ -322,6 +357,8 @@ main (int argc, char **argv)
   gtk_container_add (GTK_CONTAINER (headerbar), to_bottom_button);
   g_signal_connect (to_top_button, "clicked", G_CALLBACK (to_top_button_clicked_cb), scroller);
   gtk_container_add (GTK_CONTAINER (headerbar), to_top_button);
+  g_signal_connect (record_button, "toggled", G_CALLBACK (record_button_toggled_cb), list);
+  gtk_container_add (GTK_CONTAINER (headerbar), record_button);
 
 
   g_signal_connect (G_OBJECT (window), "close-request", G_CALLBACK (gtk_main_quit), NULL);
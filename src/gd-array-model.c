@@ -0,0 +1,337 @@
+/*
+ *  Copyright 2017 Timm Bäder
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "gd-array-model.h"
+
+#include <string.h>
+
+/*
+ * A GListModel storing plain fixed-size records in one contiguous array.
+ *
+ * Items are only created when asked for via g_list_model_get_item(), which
+ * GdModelListBox does for the rows it binds. They are small objects pointing
+ * back to the model and a position; a fill_func can just as well skip them and
+ * read the record via gd_array_model_get_record() using the item index it gets.
+ *
+ * Since items only refer to a position, they are not updated when the model
+ * changes. They are meant to be short-lived. While one is alive, asking for
+ * its position again returns the same object, so GdModelListBox can tell
+ * that a pooled row still shows it. Changing the model drops the ones whose
+ * position moved or got another record from that.
+ */
+
+struct _GdArrayModel
+{
+  GObject parent_instance;
+
+  GArray *records;
+  /* Position → live item, not owning them */
+  GHashTable *items;
+};
+
+struct _GdArrayModelItem
+{
+  GObject parent_instance;
+
+  GdArrayModel *model;
+  guint position;
+};
+
+static void gd_array_model_list_model_init (GListModelInterface *iface);
+
+G_DEFINE_TYPE_WITH_CODE (GdArrayModel, gd_array_model, G_TYPE_OBJECT,
+                         G_IMPLEMENT_INTERFACE (G_TYPE_LIST_MODEL, gd_array_model_list_model_init))
+
+G_DEFINE_TYPE (GdArrayModelItem, gd_array_model_item, G_TYPE_OBJECT)
+
+/* GdArrayModelItem {{{ */
+static void
+gd_array_model_item_finalize (GObject *object)
+{
+  GdArrayModelItem *item = GD_ARRAY_MODEL_ITEM (object);
+
+  g_object_unref (item->model);
+
+  G_OBJECT_CLASS (gd_array_model_item_parent_class)->finalize (object);
+}
+
+static void
+gd_array_model_item_class_init (GdArrayModelItemClass *class)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (class);
+
+  object_class->finalize = gd_array_model_item_finalize;
+}
+
+static void
+gd_array_model_item_init (GdArrayModelItem *item)
+{
+}
+
+GdArrayModel *
+gd_array_model_item_get_model (GdArrayModelItem *item)
+{
+  g_return_val_if_fail (GD_IS_ARRAY_MODEL_ITEM (item), NULL);
+
+  return item->model;
+}
+
+guint
+gd_array_model_item_get_position (GdArrayModelItem *item)
+{
+  g_return_val_if_fail (GD_IS_ARRAY_MODEL_ITEM (item), 0);
+
+  return item->position;
+}
+
+/**
+ * gd_array_model_item_get_record:
+ *
+ * Returns: (transfer none): The record @item was created for, or %NULL
+ *   if the model has shrunk since.
+ */
+gpointer
+gd_array_model_item_get_record (GdArrayModelItem *item)
+{
+  g_return_val_if_fail (GD_IS_ARRAY_MODEL_ITEM (item), NULL);
+
+  if (item->position >= item->model->records->len)
+    return NULL;
+
+  return gd_array_model_get_record (item->model, item->position);
+}
+/* }}} */
+
+/* Item cache {{{ */
+static void
+item_finalized_cb (gpointer  data,
+                   GObject  *where_the_object_was)
+{
+  GdArrayModel *self = data;
+  gpointer key = GUINT_TO_POINTER (((GdArrayModelItem *)where_the_object_was)->position);
+
+  if (g_hash_table_lookup (self->items, key) == where_the_object_was)
+    g_hash_table_remove (self->items, key);
+}
+
+/* Forgets the items from @start to @end, their position shows another record now */
+static void
+forget_items (GdArrayModel *self,
+              guint         start,
+              guint         end)
+{
+  GHashTableIter iter;
+  gpointer key, value;
+
+  g_hash_table_iter_init (&iter, self->items);
+  while (g_hash_table_iter_next (&iter, &key, &value))
+    {
+      if (GPOINTER_TO_UINT (key) < start || GPOINTER_TO_UINT (key) >= end)
+        continue;
+
+      g_object_weak_unref (value, item_finalized_cb, self);
+      g_hash_table_iter_remove (&iter);
+    }
+}
+/* }}} */
+
+/* GListModel {{{ */
+static GType
+gd_array_model_get_item_type (GListModel *model)
+{
+  return GD_TYPE_ARRAY_MODEL_ITEM;
+}
+
+static guint
+gd_array_model_get_n_items (GListModel *model)
+{
+  GdArrayModel *self = GD_ARRAY_MODEL (model);
+
+  return self->records->len;
+}
+
+static gpointer
+gd_array_model_get_item (GListModel *model,
+                         guint       position)
+{
+  GdArrayModel *self = GD_ARRAY_MODEL (model);
+  GdArrayModelItem *item;
+
+  if (position >= self->records->len)
+    return NULL;
+
+  item = g_hash_table_lookup (self->items, GUINT_TO_POINTER (position));
+  if (item != NULL)
+    return g_object_ref (item);
+
+  item = g_object_new (GD_TYPE_ARRAY_MODEL_ITEM, NULL);
+  item->model = g_object_ref (self);
+  item->position = position;
+
+  g_hash_table_insert (self->items, GUINT_TO_POINTER (position), item);
+  g_object_weak_ref (G_OBJECT (item), item_finalized_cb, self);
+
+  return item;
+}
+
+static void
+gd_array_model_list_model_init (GListModelInterface *iface)
+{
+  iface->get_item_type = gd_array_model_get_item_type;
+  iface->get_n_items   = gd_array_model_get_n_items;
+  iface->get_item      = gd_array_model_get_item;
+}
+/* }}} */
+
+static void
+gd_array_model_finalize (GObject *object)
+{
+  GdArrayModel *self = GD_ARRAY_MODEL (object);
+
+  g_array_unref (self->records);
+  /* Empty, every item keeps a reference on us */
+  g_hash_table_unref (self->items);
+
+  G_OBJECT_CLASS (gd_array_model_parent_class)->finalize (object);
+}
+
+static void
+gd_array_model_class_init (GdArrayModelClass *class)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (class);
+
+  object_class->finalize = gd_array_model_finalize;
+}
+
+static void
+gd_array_model_init (GdArrayModel *self)
+{
+  self->items = g_hash_table_new (NULL, NULL);
+}
+
+/**
+ * gd_array_model_new:
+ * @record_size: Size of one record in bytes
+ * @clear_func: (nullable): Called with a pointer to each record that gets removed
+ */
+GdArrayModel *
+gd_array_model_new (gsize          record_size,
+                    GDestroyNotify clear_func)
+{
+  GdArrayModel *self;
+
+  g_return_val_if_fail (record_size > 0, NULL);
+
+  self = g_object_new (GD_TYPE_ARRAY_MODEL, NULL);
+  self->records = g_array_new (FALSE, FALSE, record_size);
+  g_array_set_clear_func (self->records, clear_func);
+
+  return self;
+}
+
+gsize
+gd_array_model_get_record_size (GdArrayModel *self)
+{
+  g_return_val_if_fail (GD_IS_ARRAY_MODEL (self), 0);
+
+  return g_array_get_element_size (self->records);
+}
+
+/**
+ * gd_array_model_get_record:
+ *
+ * Returns: (transfer none): A pointer to the record at @position. It stays
+ *   valid until the model is changed.
+ */
+gpointer
+gd_array_model_get_record (GdArrayModel *self,
+                           guint         position)
+{
+  g_return_val_if_fail (GD_IS_ARRAY_MODEL (self), NULL);
+  g_return_val_if_fail (position < self->records->len, NULL);
+
+  return self->records->data + (gsize)position * g_array_get_element_size (self->records);
+}
+
+/**
+ * gd_array_model_splice:
+ * @records: (nullable): @n_added records to copy into the model
+ *
+ * Removes @n_removed records at @position and inserts @n_added new ones there.
+ * If @records is %NULL, the new records are zero-filled.
+ */
+void
+gd_array_model_splice (GdArrayModel  *self,
+                       guint          position,
+                       guint          n_removed,
+                       gconstpointer  records,
+                       guint          n_added)
+{
+  g_return_if_fail (GD_IS_ARRAY_MODEL (self));
+  g_return_if_fail (position <= self->records->len);
+  g_return_if_fail (position + n_removed <= self->records->len);
+
+  if (n_removed == 0 && n_added == 0)
+    return;
+
+  /* Records after a same-sized replacement don't move */
+  forget_items (self, position, n_removed == n_added ? position + n_removed : G_MAXUINT);
+
+  if (n_removed > 0)
+    g_array_remove_range (self->records, position, n_removed);
+
+  if (n_added > 0)
+    {
+      if (records != NULL)
+        {
+          g_array_insert_vals (self->records, position, records, n_added);
+        }
+      else
+        {
+          gsize record_size = g_array_get_element_size (self->records);
+          guint old_len = self->records->len;
+
+          g_array_set_size (self->records, old_len + n_added);
+          memmove (self->records->data + (gsize)(position + n_added) * record_size,
+                   self->records->data + (gsize)position * record_size,
+                   (gsize)(old_len - position) * record_size);
+          memset (self->records->data + (gsize)position * record_size, 0,
+                  (gsize)n_added * record_size);
+        }
+    }
+
+  g_list_model_items_changed (G_LIST_MODEL (self), position, n_removed, n_added);
+}
+
+void
+gd_array_model_append (GdArrayModel  *self,
+                       gconstpointer  records,
+                       guint          n_records)
+{
+  g_return_if_fail (GD_IS_ARRAY_MODEL (self));
+
+  gd_array_model_splice (self, self->records->len, 0, records, n_records);
+}
+
+void
+gd_array_model_remove_all (GdArrayModel *self)
+{
+  g_return_if_fail (GD_IS_ARRAY_MODEL (self));
+
+  gd_array_model_splice (self, 0, self->records->len, NULL, 0);
+}
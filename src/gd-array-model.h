@@ -0,0 +1,33 @@
+#ifndef _GD_ARRAY_MODEL_H_
+#define _GD_ARRAY_MODEL_H_
+
+#include <gio/gio.h>
+
+#define GD_TYPE_ARRAY_MODEL gd_array_model_get_type ()
+
+G_DECLARE_FINAL_TYPE (GdArrayModel, gd_array_model, GD, ARRAY_MODEL, GObject)
+
+#define GD_TYPE_ARRAY_MODEL_ITEM gd_array_model_item_get_type ()
+
+G_DECLARE_FINAL_TYPE (GdArrayModelItem, gd_array_model_item, GD, ARRAY_MODEL_ITEM, GObject)
+
+GdArrayModel *   gd_array_model_new                 (gsize              record_size,
+                                                     GDestroyNotify     clear_func);
+gsize            gd_array_model_get_record_size     (GdArrayModel      *self);
+gpointer         gd_array_model_get_record          (GdArrayModel      *self,
+                                                     guint              position);
+void             gd_array_model_splice              (GdArrayModel      *self,
+                                                     guint              position,
+                                                     guint              n_removed,
+                                                     gconstpointer      records,
+                                                     guint              n_added);
+void             gd_array_model_append              (GdArrayModel      *self,
+                                                     gconstpointer      records,
+                                                     guint              n_records);
+void             gd_array_model_remove_all          (GdArrayModel      *self);
+
+GdArrayModel *   gd_array_model_item_get_model      (GdArrayModelItem  *item);
+guint            gd_array_model_item_get_position   (GdArrayModelItem  *item);
+gpointer         gd_array_model_item_get_record     (GdArrayModelItem  *item);
+
+#endif
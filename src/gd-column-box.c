@@ -0,0 +1,201 @@
+/*
+ *  Copyright 2017 Timm Bäder
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "gd-column-box.h"
+#include "gd-model-list-box.h"
+
+/*
+ * A row widget for GdModelListBox columns. Cell i is put into column i,
+ * with the width the list box negotiated for that column. Outside of a
+ * list box with columns, cells just get their natural width.
+ */
+
+struct _GdColumnBox
+{
+  GtkWidget parent_instance;
+
+  GPtrArray *cells;
+};
+
+G_DEFINE_TYPE (GdColumnBox, gd_column_box, GTK_TYPE_WIDGET)
+
+static int
+get_column_width (GdColumnBox *self,
+                  guint        column)
+{
+  GtkWidget *parent = gtk_widget_get_parent (GTK_WIDGET (self));
+  GtkWidget *cell = g_ptr_array_index (self->cells, column);
+  int nat;
+
+  if (GD_IS_MODEL_LIST_BOX (parent) &&
+      column < gd_model_list_box_get_n_columns (GD_MODEL_LIST_BOX (parent)))
+    return gd_model_list_box_get_column_width (GD_MODEL_LIST_BOX (parent), column);
+
+  gtk_widget_measure (cell, GTK_ORIENTATION_HORIZONTAL, -1, NULL, &nat, NULL, NULL);
+
+  return nat;
+}
+
+static void
+__measure (GtkWidget      *widget,
+           GtkOrientation  orientation,
+           int             for_size,
+           int            *minimum,
+           int            *natural,
+           int            *minimum_baseline,
+           int            *natural_baseline)
+{
+  GdColumnBox *self = GD_COLUMN_BOX (widget);
+  guint i;
+
+  *minimum = 0;
+  *natural = 0;
+
+  for (i = 0; i < self->cells->len; i ++)
+    {
+      GtkWidget *cell = g_ptr_array_index (self->cells, i);
+      int m, n;
+
+      if (orientation == GTK_ORIENTATION_HORIZONTAL)
+        {
+          gtk_widget_measure (cell, GTK_ORIENTATION_HORIZONTAL, -1, &m, &n, NULL, NULL);
+          *minimum += m;
+          *natural += n;
+        }
+      else
+        {
+          gtk_widget_measure (cell, GTK_ORIENTATION_VERTICAL,
+                              for_size >= 0 ? get_column_width (self, i) : -1,
+                              &m, &n, NULL, NULL);
+          *minimum = MAX (*minimum, m);
+          *natural = MAX (*natural, n);
+        }
+    }
+}
+
+static void
+__size_allocate (GtkWidget           *widget,
+                 const GtkAllocation *allocation,
+                 int                  baseline)
+{
+  GdColumnBox *self = GD_COLUMN_BOX (widget);
+  GtkAllocation cell_alloc;
+  guint i;
+
+  cell_alloc.x = 0;
+  cell_alloc.y = 0;
+  cell_alloc.height = allocation->height;
+
+  for (i = 0; i < self->cells->len; i ++)
+    {
+      GtkWidget *cell = g_ptr_array_index (self->cells, i);
+
+      cell_alloc.width = get_column_width (self, i);
+      gtk_widget_size_allocate (cell, &cell_alloc, -1);
+      cell_alloc.x += cell_alloc.width;
+    }
+}
+
+static void
+__snapshot (GtkWidget   *widget,
+            GtkSnapshot *snapshot)
+{
+  GdColumnBox *self = GD_COLUMN_BOX (widget);
+  guint i;
+
+  for (i = 0; i < self->cells->len; i ++)
+    gtk_widget_snapshot_child (widget, g_ptr_array_index (self->cells, i), snapshot);
+}
+
+static void
+__finalize (GObject *object)
+{
+  GdColumnBox *self = GD_COLUMN_BOX (object);
+  guint i;
+
+  for (i = 0; i < self->cells->len; i ++)
+    gtk_widget_unparent (g_ptr_array_index (self->cells, i));
+
+  g_ptr_array_free (self->cells, TRUE);
+
+  G_OBJECT_CLASS (gd_column_box_parent_class)->finalize (object);
+}
+
+static void
+gd_column_box_class_init (GdColumnBoxClass *class)
+{
+  GObjectClass   *object_class = G_OBJECT_CLASS (class);
+  GtkWidgetClass *widget_class = GTK_WIDGET_CLASS (class);
+
+  object_class->finalize = __finalize;
+
+  widget_class->measure       = __measure;
+  widget_class->size_allocate = __size_allocate;
+  widget_class->snapshot      = __snapshot;
+
+  gtk_widget_class_set_css_name (widget_class, "row");
+}
+
+static void
+gd_column_box_init (GdColumnBox *self)
+{
+  gtk_widget_set_has_surface (GTK_WIDGET (self), FALSE);
+
+  self->cells = g_ptr_array_new ();
+}
+
+GtkWidget *
+gd_column_box_new (void)
+{
+  return GTK_WIDGET (g_object_new (GD_TYPE_COLUMN_BOX, NULL));
+}
+
+/**
+ * gd_column_box_append:
+ *
+ * Adds @cell as the cell for the next column.
+ */
+void
+gd_column_box_append (GdColumnBox *self,
+                      GtkWidget   *cell)
+{
+  g_return_if_fail (GD_IS_COLUMN_BOX (self));
+  g_return_if_fail (GTK_IS_WIDGET (cell));
+  g_return_if_fail (gtk_widget_get_parent (cell) == NULL);
+
+  gtk_widget_set_parent (cell, GTK_WIDGET (self));
+  g_ptr_array_add (self->cells, cell);
+}
+
+GtkWidget *
+gd_column_box_get_cell (GdColumnBox *self,
+                        guint        column)
+{
+  g_return_val_if_fail (GD_IS_COLUMN_BOX (self), NULL);
+  g_return_val_if_fail (column < self->cells->len, NULL);
+
+  return g_ptr_array_index (self->cells, column);
+}
+
+guint
+gd_column_box_get_n_cells (GdColumnBox *self)
+{
+  g_return_val_if_fail (GD_IS_COLUMN_BOX (self), 0);
+
+  return self->cells->len;
+}
@@ -0,0 +1,17 @@
+#ifndef _GD_COLUMN_BOX_H_
+#define _GD_COLUMN_BOX_H_
+
+#include <gtk/gtk.h>
+
+#define GD_TYPE_COLUMN_BOX gd_column_box_get_type ()
+
+G_DECLARE_FINAL_TYPE (GdColumnBox, gd_column_box, GD, COLUMN_BOX, GtkWidget)
+
+GtkWidget * gd_column_box_new         (void);
+void        gd_column_box_append      (GdColumnBox *box,
+                                       GtkWidget   *cell);
+GtkWidget * gd_column_box_get_cell    (GdColumnBox *box,
+                                       guint        column);
+guint       gd_column_box_get_n_cells (GdColumnBox *box);
+
+#endif
@@ -0,0 +1,84 @@
+/*
+ *  Copyright 2017 Timm Bäder
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "gd-debug.h"
+
+#ifdef HAVE_SYSPROF
+#include <sysprof-capture.h>
+#endif
+
+guint gd_debug_flags = 0;
+
+static const GDebugKey gd_debug_keys[] = {
+  { "layout",   GD_DEBUG_LAYOUT   },
+  { "bind",     GD_DEBUG_BIND     },
+  { "unbind",   GD_DEBUG_UNBIND   },
+  { "measure",  GD_DEBUG_MEASURE  },
+  { "model",    GD_DEBUG_MODEL    },
+  { "validate", GD_DEBUG_VALIDATE },
+};
+
+void
+gd_debug_init (void)
+{
+  static gsize initialized = 0;
+
+  if (g_once_init_enter (&initialized))
+    {
+      gd_debug_flags = g_parse_debug_string (g_getenv ("GD_LISTBOX_DEBUG"),
+                                             gd_debug_keys,
+                                             G_N_ELEMENTS (gd_debug_keys));
+      g_once_init_leave (&initialized, 1);
+    }
+}
+
+#ifdef GD_ENABLE_TRACING
+/* In nanoseconds, in the same clock sysprof uses */
+gint64
+gd_trace_current_time (void)
+{
+#ifdef HAVE_SYSPROF
+  return SYSPROF_CAPTURE_CURRENT_TIME;
+#else
+  return g_get_monotonic_time () * 1000;
+#endif
+}
+
+void
+gd_trace_mark (gint64      begin,
+               const char *name,
+               const char *format,
+               ...)
+{
+  gint64 end = gd_trace_current_time ();
+  va_list args;
+  char *message;
+
+  va_start (args, format);
+  message = g_strdup_vprintf (format, args);
+  va_end (args);
+
+#ifdef HAVE_SYSPROF
+  sysprof_collector_mark (begin, end - begin, "GdModelListBox", name, "%s", message);
+#else
+  g_message ("%s: %s (%.3f ms)", name, message, (end - begin) / 1000000.0);
+#endif
+
+  g_free (message);
+}
+#endif
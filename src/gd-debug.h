@@ -0,0 +1,93 @@
+/*
+ *  Copyright 2017 Timm Bäder
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _GD_DEBUG_H_
+#define _GD_DEBUG_H_
+
+#include <glib.h>
+
+/* Parsed from the GD_LISTBOX_DEBUG environment variable, e.g.
+ * GD_LISTBOX_DEBUG=layout,bind */
+typedef enum {
+  GD_DEBUG_LAYOUT   = 1 << 0,
+  GD_DEBUG_BIND     = 1 << 1,
+  GD_DEBUG_UNBIND   = 1 << 2,
+  GD_DEBUG_MEASURE  = 1 << 3,
+  GD_DEBUG_MODEL    = 1 << 4,
+  GD_DEBUG_VALIDATE = 1 << 5,
+} GdDebugFlags;
+
+extern guint gd_debug_flags;
+
+void gd_debug_init (void);
+
+/* Expensive consistency checks, e.g. anything measuring all rows.
+ * They only run with GD_LISTBOX_DEBUG=validate (the tests set that), so release
+ * layouts don't pay for them. Unlike g_assert(), G_DISABLE_ASSERT doesn't
+ * affect them. */
+#define GD_VALIDATING() G_UNLIKELY (gd_debug_flags & GD_DEBUG_VALIDATE)
+
+#define gd_validate(expr) G_STMT_START {                                           \
+    if (GD_VALIDATING () && !(expr))                                               \
+      g_assertion_message_expr (G_LOG_DOMAIN, __FILE__, __LINE__, G_STRFUNC, #expr); \
+  } G_STMT_END
+
+#define gd_validate_cmpint(n1, cmp, n2) G_STMT_START {                                   \
+    if (GD_VALIDATING ())                                                                \
+      {                                                                                  \
+        gint64 __n1 = (n1), __n2 = (n2);                                                 \
+        if (!(__n1 cmp __n2))                                                            \
+          g_assertion_message_cmpnum (G_LOG_DOMAIN, __FILE__, __LINE__, G_STRFUNC,       \
+                                      #n1 " " #cmp " " #n2,                              \
+                                      (long double) __n1, #cmp, (long double) __n2, 'i'); \
+      }                                                                                  \
+  } G_STMT_END
+
+#ifdef GD_ENABLE_TRACING
+
+#define GD_DEBUG_CHECK(type) G_UNLIKELY (gd_debug_flags & GD_DEBUG_##type)
+
+/* @action is only evaluated if @type is enabled, so it can be as expensive as it wants */
+#define GD_NOTE(type, action) G_STMT_START { \
+    if (GD_DEBUG_CHECK (type))               \
+      { action; }                            \
+  } G_STMT_END
+
+/* Profiler marks. GD_TRACE_END emits a mark from @begin to now, which ends up in
+ * sysprof if we were built against it, or as a message otherwise. */
+#define GD_TRACE_BEGIN(type) (GD_DEBUG_CHECK (type) ? gd_trace_current_time () : 0)
+#define GD_TRACE_END(type, begin, name, ...) G_STMT_START { \
+    if (GD_DEBUG_CHECK (type) && (begin) != 0)              \
+      gd_trace_mark ((begin), (name), __VA_ARGS__);         \
+  } G_STMT_END
+
+gint64 gd_trace_current_time (void);
+void   gd_trace_mark         (gint64      begin,
+                              const char *name,
+                              const char *format,
+                              ...) G_GNUC_PRINTF (3, 4);
+
+#else
+
+#define GD_DEBUG_CHECK(type) 0
+#define GD_NOTE(type, action)
+#define GD_TRACE_BEGIN(type) 0
+#define GD_TRACE_END(type, begin, name, ...) G_STMT_START { (void) (begin); } G_STMT_END
+
+#endif
+
+#endif
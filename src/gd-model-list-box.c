@@ -16,6 +16,8 @@
  */
 
 #include "gd-model-list-box.h"
+#include "gd-debug.h"
+#include "gd-column-box.h"
 
 G_DEFINE_TYPE_WITH_CODE (GdModelListBox, gd_model_list_box, GTK_TYPE_WIDGET,
                          G_IMPLEMENT_INTERFACE (GTK_TYPE_SCROLLABLE, NULL));
@@ -25,6 +27,8 @@ G_DEFINE_TYPE_WITH_CODE (GdModelListBox, gd_model_list_box, GTK_TYPE_WIDGET,
 
 enum {
   SIGNAL_ROW_ACTIVATED,
+  SIGNAL_SELECTION_CHANGED,
+  SIGNAL_SCROLL_BY,
   LAST_SIGNAL
 };
 static guint signals[LAST_SIGNAL] = { 0 };
@@ -37,907 +41,3466 @@ enum {
   PROP_VSCROLL_POLICY
 };
 
-static GtkWidget *
-get_widget (GdModelListBox *self,
-            guint           index)
+static GQuark bound_item_quark;
+/* Index + 1 of the item a widget shows, and still shows while it's in the
+ * pool. 0 once remove_func has been called for it. */
+static GQuark bound_index_quark;
+
+/* How many pooled widgets we keep around for their items to come back,
+ * instead of binding them to other items right away */
+#define AFFINE_POOL_SIZE 8
+
+/* What self->widgets and self->pool contain instead of widgets in widgetless mode */
+typedef struct
 {
   gpointer item;
-  GtkWidget *old_widget = NULL;
-  GtkWidget *new_widget;
+  int height;
+} RowData;
 
-  item = g_list_model_get_item (self->model, index);
+typedef struct
+{
+  /* Fixed width, or -1 to use measured_width */
+  int declared_width;
+  gboolean expand;
+  /* The widest natural width of all cells bound so far */
+  int measured_width;
+  /* What rows get, see negotiate_columns() */
+  int width;
+} Column;
 
-  if (self->pool->len > 0)
-    old_widget = g_ptr_array_remove_index_fast (self->pool,
-                                                self->pool->len - 1);
+static inline int
+column_base_width (const Column *column)
+{
+  return column->declared_width >= 0 ? column->declared_width : column->measured_width;
+}
 
-  new_widget = self->fill_func (item, old_widget, index, self->fill_func_data);
-  g_assert (new_widget != NULL);
-  g_assert (GTK_IS_WIDGET (new_widget));
+/* Picks up the natural widths of a freshly bound row's cells. This is the only
+ * place cells are measured for their width, rows never get measured against
+ * each other. */
+static void
+measure_columns (GdModelListBox *self,
+                 GtkWidget      *row)
+{
+  GdColumnBox *column_box;
+  guint n;
+  guint i;
 
-  if (old_widget != NULL)
-    g_assert (old_widget == new_widget);
+  if (!GD_IS_COLUMN_BOX (row))
+    return;
 
-  if (g_object_is_floating (new_widget))
-    g_object_ref_sink (new_widget);
+  column_box = GD_COLUMN_BOX (row);
+  n = MIN (gd_column_box_get_n_cells (column_box), self->columns->len);
 
-  return new_widget;
-}
+  for (i = 0; i < n; i ++)
+    {
+      Column *column = &g_array_index (self->columns, Column, i);
+      int nat;
 
-static void
-insert_child_internal (GdModelListBox *self,
-                       GtkWidget      *widget,
-                       guint           index)
-{
-  if (gtk_widget_get_parent (widget) == NULL)
-    gtk_widget_set_parent (widget, GTK_WIDGET (self));
+      if (column->declared_width >= 0)
+        continue;
 
-  gtk_widget_set_child_visible (widget, TRUE);
-  g_ptr_array_insert (self->widgets, index, widget);
+      gtk_widget_measure (gd_column_box_get_cell (column_box, i),
+                          GTK_ORIENTATION_HORIZONTAL, -1,
+                          NULL, &nat, NULL, NULL);
+      self->stats.measure_calls ++;
+
+      if (nat > column->measured_width)
+        {
+          column->measured_width = nat;
+          self->columns_width = -1;
+          self->max_width_changed = TRUE;
+        }
+    }
 }
 
-static void
-remove_child_by_index (GdModelListBox *self,
-                       guint           index)
+/* Distributes @width among the columns: everyone gets their base width,
+ * expanding columns share what's left. Returns whether any column width
+ * changed. */
+static gboolean
+negotiate_columns (GdModelListBox *self,
+                   int             width)
 {
-  GtkWidget *row;
+  int total = 0;
+  guint n_expand = 0;
+  int extra = 0;
+  int rest = 0;
+  gboolean changed = FALSE;
+  guint i;
 
-  row = g_ptr_array_index (self->widgets, index);
+  for (i = 0; i < self->columns->len; i ++)
+    {
+      Column *column = &g_array_index (self->columns, Column, i);
 
-  gtk_widget_set_child_visible (g_ptr_array_index (self->widgets, index), FALSE);
+      total += column_base_width (column);
+      if (column->expand)
+        n_expand ++;
+    }
 
-  if (self->remove_func)
+  if (width > total && n_expand > 0)
     {
-      guint item_index = self->model_from + index;
-      self->remove_func (row,
-                         g_list_model_get_item (self->model, item_index),
-                         self->remove_func_data);
+      extra = (width - total) / n_expand;
+      rest  = (width - total) % n_expand;
     }
 
-  /* Can't use _fast for self->widgets, we need to keep the order. */
-  g_ptr_array_remove_index (self->widgets, index);
-  g_ptr_array_add (self->pool, row);
-}
+  for (i = 0; i < self->columns->len; i ++)
+    {
+      Column *column = &g_array_index (self->columns, Column, i);
+      int column_width = column_base_width (column);
 
-static inline int
-requested_row_height (GdModelListBox *box,
-                      GtkWidget      *w)
-{
-  int min;
-  gtk_widget_measure (w,
-                      GTK_ORIENTATION_VERTICAL,
-                      gtk_widget_get_width (GTK_WIDGET (box)),
-                      &min, NULL, NULL, NULL);
-  return min;
-}
+      if (column->expand)
+        {
+          column_width += extra;
+          if (rest > 0)
+            {
+              column_width ++;
+              rest --;
+            }
+        }
 
-// TODO(Perf): This function is useless as we always use it in a loop in ensure_visible_widgets
-static inline int
-row_y (GdModelListBox *self,
-       guint           index)
-{
-  int y = 0;
-  guint i;
+      if (column_width != column->width)
+        {
+          column->width = column_width;
+          changed = TRUE;
+        }
+    }
 
-  for (i = 0; i < index; i ++)
-    y += requested_row_height (self, g_ptr_array_index (self->widgets, i));
+  self->columns_width = width;
 
-  return y;
+  return changed;
 }
 
-static int
-estimated_row_height (GdModelListBox *self)
+/* Keeps track of the widest row we've seen, so measuring our width doesn't
+ * need to measure all rows, and doesn't change whenever other rows get bound. */
+static void
+update_max_width (GdModelListBox *self,
+                  GtkWidget      *row)
 {
-  int avg_widget_height = 0;
-
-  Foreach_Row
-    avg_widget_height += requested_row_height (self, row);
-  }}
-
-  if (self->widgets->len > 0)
-    avg_widget_height /= self->widgets->len;
-  else
-    return 0;
+  int min, nat;
 
-  return avg_widget_height;
+  gtk_widget_measure (row, GTK_ORIENTATION_HORIZONTAL, -1,
+                      &min, &nat, NULL, NULL);
+  self->stats.measure_calls ++;
 
+  if (min > self->max_min_width || nat > self->max_nat_width)
+    {
+      self->max_min_width = MAX (self->max_min_width, min);
+      self->max_nat_width = MAX (self->max_nat_width, nat);
+      self->max_width_changed = TRUE;
+    }
 }
 
-static inline int
-bin_y (GdModelListBox *self)
+static inline gboolean
+is_widgetless (GdModelListBox *self)
 {
-  return - gtk_adjustment_get_value (self->vadjustment) + self->bin_y_diff;
+  return self->snapshot_func != NULL;
 }
 
-static inline int
-bin_height (GdModelListBox *self)
+static void item_notify_cb (GObject    *item,
+                            GParamSpec *pspec,
+                            gpointer    user_data);
+
+static inline void
+watch_item (GdModelListBox *self,
+            gpointer        item)
 {
-  int height = 0;
-  int min;
+  if (self->auto_invalidate && item != NULL)
+    g_signal_connect (item, "notify", G_CALLBACK (item_notify_cb), self);
+}
 
-  /* XXX This is only true if we actually allocate all rows at minimum height... */
-  Foreach_Row
-    gtk_widget_measure (row,
-                        GTK_ORIENTATION_VERTICAL,
-                        gtk_widget_get_width (GTK_WIDGET (self)),
-                        &min, NULL, NULL, NULL);
+static inline void
+unwatch_item (GdModelListBox *self,
+              gpointer        item)
+{
+  if (self->auto_invalidate && item != NULL)
+    g_signal_handlers_disconnect_by_func (item, item_notify_cb, self);
+}
 
-    height += min;
-  }}
+/* The item a row in self->widgets is bound to */
+static inline gpointer
+bound_item (GdModelListBox *self,
+            gpointer        row)
+{
+  if (is_widgetless (self))
+    return ((RowData *)row)->item;
 
-  return height;
+  return g_object_get_qdata (G_OBJECT (row), bound_item_quark);
 }
 
-static int
-estimated_list_height (GdModelListBox *self)
+static inline guint
+affine_index (GtkWidget *widget)
 {
-  int avg_height;
-  int top_widgets;
-  int bottom_widgets;
-  int exact_height = 0;
+  return GPOINTER_TO_UINT (g_object_get_qdata (G_OBJECT (widget), bound_index_quark));
+}
 
-  avg_height = estimated_row_height (self);
-  top_widgets = self->model_from;
-  bottom_widgets = g_list_model_get_n_items (self->model) - self->model_to;
+/*
+ * Unbinding a widget is deferred until it's clear that its item isn't coming
+ * back, i.e. until the pooled widget gets used for another item or its item
+ * changed.
+ */
+static void
+release_widget (GdModelListBox *self,
+                GtkWidget      *widget)
+{
+  gpointer item;
 
-  g_assert (top_widgets + bottom_widgets + self->widgets->len == g_list_model_get_n_items (self->model));
+  if (affine_index (widget) == 0)
+    return;
 
-  Foreach_Row
-    exact_height += requested_row_height (self, row);
-  }}
+  g_object_set_qdata (G_OBJECT (widget), bound_index_quark, NULL);
 
-  g_assert (self->widgets->len == (self->model_to - self->model_from));
+  item = g_object_get_qdata (G_OBJECT (widget), bound_item_quark);
+  unwatch_item (self, item);
 
-  return (top_widgets * avg_height) +
-         exact_height +
-         (bottom_widgets * avg_height);
+  if (self->remove_func)
+    self->remove_func (widget, item, self->remove_func_data);
 }
 
-/**
- * When we set the vadjustment value from within this widget, we need to care about two things:
- *
- *   1) Block the signal handler. It's mostly harmless but we don't want to unnecessarily
- *      redo things and we especially don't want to call queue_allocate or even queue_resize
- *      during size-allocate.
- *
- *   2) self->bin_y_diff depends on the adjustment value, so if we manually change the adjustment
- *      value, we also need to update self->bin_y_diff. This should happen in such a way that
- *      bin_y (self) returns the same value before and after setting the adjustment value
- *      and bin_y_diff.
- */
 static void
-set_vadjustment_value (GdModelListBox *self,
-                       double          new_value)
+release_pool (GdModelListBox *self)
 {
-  int old_bin_y = bin_y (self);
-  double cur_value = gtk_adjustment_get_value (self->vadjustment);
+  guint i;
 
-  g_debug ("%s: Adjusting value from %f to %f", __FUNCTION__, cur_value, new_value);
-  g_signal_handler_block (self->vadjustment,
-                          self->vadjustment_value_changed_id);
-  gtk_adjustment_set_value (self->vadjustment, new_value);
-  g_signal_handler_unblock (self->vadjustment,
-                            self->vadjustment_value_changed_id);
-  g_assert_cmpint ((int)new_value, ==, (int)gtk_adjustment_get_value (self->vadjustment));
-  g_debug ("bin_y_diff: %f, cur_value: %f, new_value: %f",
-             self->bin_y_diff, cur_value, new_value);
-  self->bin_y_diff -= (cur_value - new_value);
-  g_assert_cmpint (bin_y (self), ==, old_bin_y);
+  if (is_widgetless (self))
+    return;
+
+  for (i = 0; i < self->pool->len; i ++)
+    release_widget (self, g_ptr_array_index (self->pool, i));
 }
 
-static void
-configure_adjustment (GdModelListBox *self)
+static gboolean
+detach_pool_idle_cb (gpointer user_data)
 {
-  int widget_height;
-  int list_height;
-  int max_value;
-  double cur_upper;
-  double page_size;
-  double cur_value;
-
-  widget_height = gtk_widget_get_height (GTK_WIDGET (self));
-  list_height   = estimated_list_height (self);
-  cur_upper     = gtk_adjustment_get_upper (self->vadjustment);
-  cur_value     = gtk_adjustment_get_value (self->vadjustment);
-  page_size     = gtk_adjustment_get_page_size (self->vadjustment);
+  GdModelListBox *self = user_data;
+  guint i;
 
-  if ((int)cur_upper != list_height)
-    {
-      gtk_adjustment_set_upper (self->vadjustment, list_height);
-      g_debug ("Changing upper from %f to %d", cur_upper, list_height);
-    }
-  else if (list_height == 0)
+  for (i = 0; i < self->pool->len; i ++)
     {
-      gtk_adjustment_set_upper (self->vadjustment, widget_height);
+      GtkWidget *widget = g_ptr_array_index (self->pool, i);
+
+      if (gtk_widget_get_parent (widget) != NULL)
+        gtk_widget_unparent (widget);
     }
 
-  if ((int)page_size != widget_height)
-    gtk_adjustment_set_page_size (self->vadjustment, widget_height);
+  GD_NOTE (LAYOUT, g_message ("%s: %u pooled widgets detached", G_STRFUNC, self->pool->len));
 
-  gtk_adjustment_set_lower (self->vadjustment, 0.0);
+  self->detach_id = 0;
+  return G_SOURCE_REMOVE;
+}
 
-  max_value = MAX (0, list_height - widget_height);
-  if (cur_value > max_value)
+/*
+ * Unparents the pooled widgets once the current frame is done, so a row that
+ * is reused in the same layout doesn't have to get its style computed again.
+ */
+static void
+queue_detach_pool (GdModelListBox *self)
+{
+  if (!self->detach_pool || self->detach_id != 0)
+    return;
+
+  self->detach_id = g_idle_add_full (G_PRIORITY_DEFAULT_IDLE, detach_pool_idle_cb, self, NULL);
+}
+
+static void
+cancel_detach_pool (GdModelListBox *self)
+{
+  if (self->detach_id != 0)
     {
-      g_debug ("2 ###############################################################");
-      set_vadjustment_value (self, max_value);
-      g_debug ("2 ###############################################################");
+      g_source_remove (self->detach_id);
+      self->detach_id = 0;
     }
 }
 
+/*
+ * Releases the pooled widgets a model change affects. That's every one at
+ * or after @position whose index changes, since the fill_func got the
+ * index and the row might depend on it.
+ */
 static void
-ensure_visible_widgets (GdModelListBox *self)
+splice_pool (GdModelListBox *self,
+             guint           position,
+             guint           removed,
+             guint           added)
 {
-  int widget_height;
-  int bottom_removed = 0;
-  int bottom_added = 0;
-  int top_removed = 0;
-  int top_added = 0;
-
-  g_debug (__FUNCTION__);
+  guint i;
 
-  if (!self->vadjustment ||
-      !self->model ||
-      g_list_model_get_n_items (self->model) == 0)
+  if (is_widgetless (self))
     return;
 
-  widget_height = gtk_widget_get_height (GTK_WIDGET (self));
-
-  g_debug ("------------------------");
-  g_debug ("        value: %f", gtk_adjustment_get_value (self->vadjustment));
-  g_debug ("        upper: %f", gtk_adjustment_get_upper (self->vadjustment));
-  g_debug ("    page_size: %f", gtk_adjustment_get_page_size (self->vadjustment));
-  g_debug ("widget height: %d", widget_height);
-  g_debug ("        bin_y: %d (SHOULD BE <= 0!)", bin_y (self));
-  g_debug ("   bin_height: %d", bin_height (self));
-  g_debug ("   bin_y_diff: %f", self->bin_y_diff);
-
-  g_assert_cmpint (self->bin_y_diff, >=, 0);
-  g_assert_cmpint (bin_height (self), >=, 0);
-  double upper_before = estimated_list_height (self);
-
-  double max_value = MAX (0, estimated_list_height (self) - widget_height);
-  if (gtk_adjustment_get_value (self->vadjustment) > max_value)
+  for (i = 0; i < self->pool->len; i ++)
     {
-      /* We do NOT use _set_adjustment_value here since that would adjust the bin_y_diff
-       * as well, which the later code will already to. */
-      g_debug ("1 ###############################################################");
-      g_signal_handler_block (self->vadjustment,
-                              self->vadjustment_value_changed_id);
-      gtk_adjustment_set_value (self->vadjustment, max_value);
-      g_signal_handler_unblock (self->vadjustment,
-                                self->vadjustment_value_changed_id);
-      g_debug ("1 ###############################################################");
-    }
+      GtkWidget *widget = g_ptr_array_index (self->pool, i);
+      guint index = affine_index (widget);
 
-  /* This "out of sight" case happens when the new value is so different from the old one
-   * that we rather just remove all widgets and adjust the model_from/model_to values.
-   * This happens when scrolling fast, clicking the scrollbar directly or just by programmatically
-   * setting the vadjustment value.
-   */
-  if (bin_y (self) + bin_height (self) < 0 ||
-      bin_y (self) >= widget_height)
-    {
-      int avg_row_height = estimated_row_height (self);
-      double percentage;
-      double value = gtk_adjustment_get_value (self->vadjustment);
-      double upper = gtk_adjustment_get_upper (self->vadjustment);
-      double page_size = gtk_adjustment_get_page_size (self->vadjustment);
-      guint top_widget_index;
-      int i;
+      if (index == 0 || index - 1 < position)
+        continue;
 
-      g_debug ("OUT OF SIGHT! bin_y: %d, bin_height; %d, widget_height: %d",
-                 bin_y (self), bin_height (self), widget_height);
-      g_debug ("Value: %f, upper: %f", value, upper);
+      /* Replaced in place, the ones after it keep their index */
+      if (removed == added && index - 1 >= position + removed)
+        continue;
 
-      for (i = self->widgets->len - 1; i >= 0; i --)
-        remove_child_by_index (self, i);
+      release_widget (self, widget);
+    }
+}
 
-      g_assert (self->widgets->len == 0);
+/* Takes a widget to bind @item to out of the pool, or returns NULL if a new
+ * one should be created. Sets *@affine if it's still bound to @item, at the
+ * same index. Items are compared by pointer, so this only ever happens for
+ * models that return the same object for an item as long as it's alive. */
+static GtkWidget *
+take_pooled_widget (GdModelListBox *self,
+                    guint           index,
+                    gpointer        item,
+                    gboolean       *affine)
+{
+  GtkWidget *widget;
+  guint oldest_free = G_MAXUINT;
+  guint i;
 
-      percentage = value / (upper - page_size);
+  *affine = FALSE;
 
-      top_widget_index = (guint) (g_list_model_get_n_items (self->model) * percentage);
-      g_debug ("top_widget_index: %u (Percentage %f)", top_widget_index, percentage);
+  for (i = 0; i < self->pool->len; i ++)
+    {
+      widget = g_ptr_array_index (self->pool, i);
 
-      if (top_widget_index > g_list_model_get_n_items (self->model))
+      if (affine_index (widget) == 0)
         {
-          g_assert (FALSE);
+          if (oldest_free == G_MAXUINT)
+            oldest_free = i;
         }
-      else
+      else if (affine_index (widget) == index + 1 && bound_item (self, widget) == item)
         {
-          self->model_from = top_widget_index;
-          self->model_to   = top_widget_index;
-          self->bin_y_diff = self->model_from * avg_row_height;
+          *affine = TRUE;
+          return g_ptr_array_remove_index (self->pool, i);
         }
+    }
 
-        g_assert (self->model_from <= g_list_model_get_n_items (self->model));
-        g_assert (self->model_from <= self->model_to);
-        g_assert (self->model_to <= g_list_model_get_n_items (self->model));
-        g_assert (bin_y (self) <= widget_height);
+  /* Rows from before an out-of-sight jump are still parented and visible */
+  if (self->teleport->len > 0)
+    {
+      widget = g_ptr_array_remove_index_fast (self->teleport, self->teleport->len - 1);
+      release_widget (self, widget);
+      self->stats.rows_teleported ++;
 
-        g_debug ("After OOS: model_from: %d, model_to: %d, bin_y: %d, bin_height; %d",
-                   self->model_from, self->model_to, bin_y (self), bin_height (self));
+      return widget;
     }
 
+  if (oldest_free != G_MAXUINT)
+    return g_ptr_array_remove_index (self->pool, oldest_free);
 
-  /* It might be necessary to get back here... */
-maybe_add_widgets:
-  g_debug ("model_from: %u, model_to: %u", self->model_from, self->model_to);
-  /* If we already show the last item, i.e. we are at the end of the list anyway,
-   * BUT the last item is not allocated at the very bottom, we shift everything down here,
-   * so the code later might add an item at the top.
-   *
-   * This can happen when one scrolled to the bottom and then increased the widget height.
-   */
-  if (self->model_to == g_list_model_get_n_items (self->model) &&
-      self->model_from > 0 &&
-      bin_y (self) + bin_height (self) < widget_height)
-    {
-      /*g_debug ("AT THE END");*/
-      /*g_debug ("        bin_y: %d", bin_y (self));*/
-      /*g_debug ("   bin_height: %d", bin_height (self));*/
-      /*g_debug ("widget height: %d", widget_height);*/
+  if (self->pool->len < AFFINE_POOL_SIZE)
+    return NULL;
 
-      self->bin_y_diff += widget_height - (bin_y (self) + bin_height (self));
+  /* The one that's been out of view the longest */
+  widget = g_ptr_array_remove_index (self->pool, 0);
+  release_widget (self, widget);
 
-      /*g_debug ("bin_y_diff now: %f", self->bin_y_diff);*/
-      /*g_debug ("         bin_y: %d", bin_y (self));*/
-      /*g_debug ("    bin_height: %d", bin_height (self));*/
-      /*g_debug (" widget height: %d", widget_height);*/
+  return widget;
+}
 
-      g_assert (bin_y (self) + bin_height (self) >= widget_height);
-    }
-  else if (self->model_from == 0 && bin_y (self) > 0)
-    {
-      /* We are at the very top of the list (item 0 is shown), but we
-       * allocate it at y > 0 because of a radical value/estimated-height change. */
-      g_debug ("YEP!");
-      self->bin_y_diff = 0;
-      g_signal_handler_block (self->vadjustment,
-                              self->vadjustment_value_changed_id);
-      gtk_adjustment_set_value (self->vadjustment, 0);
-      g_signal_handler_unblock (self->vadjustment,
-                                self->vadjustment_value_changed_id);
-      g_debug ("bin_y now: %d", bin_y (self));
-    }
+/* Prepare stage {{{ */
+typedef struct _GdPrepareFuncs
+{
+  volatile gint ref_count;
+  GdModelListBoxPrepareFunc func;
+  GDestroyNotify payload_destroy;
+  gpointer data;
+  GDestroyNotify data_destroy;
+} PrepareFuncs;
+
+typedef struct
+{
+  GdModelListBox *box;
+  PrepareFuncs *prepare;
+  gpointer item;
+  guint index;
+  guint generation;
+  gpointer payload;
+} PrepareJob;
 
-  /* Remove top widgets */
-  {
-    guint i;
+/* Stands in for payloads that are being prepared on a worker thread */
+static char payload_pending;
+#define PAYLOAD_PENDING ((gpointer) &payload_pending)
 
-    for (i = 0; i < self->widgets->len; i ++)
-      {
-        GtkWidget *w = g_ptr_array_index (self->widgets, i);
-        int w_height = requested_row_height (self, w);
-        if (bin_y (self) + row_y (self, i) + w_height < 0)
-          {
-            g_debug ("bin_y: %d, row_y: %d, w_height: %d", bin_y (self), row_y (self, i), w_height);
-            g_assert_cmpint (i, ==, 0);
-            self->bin_y_diff += w_height;
-            remove_child_by_index (self, i);
-            self->model_from ++;
-            top_removed ++;
-            g_debug ("Removing from top with index %u. bin_y_diff now: %f", i, self->bin_y_diff);
+static PrepareFuncs *
+prepare_funcs_ref (PrepareFuncs *prepare)
+{
+  g_atomic_int_inc (&prepare->ref_count);
 
-            /* Do the first row again */
-            i--;
-          } else
-            break;
-      }
-  }
+  return prepare;
+}
 
-  /* Remove bottom widgets */
-  {
-    int i = self->widgets->len - 1;
-    for (;;)
-      {
-        GtkWidget *w;
-        int y;
+/* Only ever called on the main thread */
+static void
+prepare_funcs_unref (PrepareFuncs *prepare)
+{
+  if (g_atomic_int_dec_and_test (&prepare->ref_count))
+    {
+      if (prepare->data_destroy != NULL)
+        prepare->data_destroy (prepare->data);
 
-        if (i <= 0)
-          {
-            break;
-          }
+      g_slice_free (PrepareFuncs, prepare);
+    }
+}
 
-        y = bin_y (self) + row_y (self, i);
+static inline void
+free_payload (PrepareFuncs *prepare,
+              gpointer      payload)
+{
+  if (payload != PAYLOAD_PENDING && prepare->payload_destroy != NULL)
+    prepare->payload_destroy (payload);
+}
 
-        if (y < widget_height)
-          {
-            break;
-          }
-        g_debug ("Removing widget at bottom with y %d", y);
+static void
+clear_payloads (GdModelListBox *self)
+{
+  GHashTableIter iter;
+  gpointer payload;
 
-        w = g_ptr_array_index (self->widgets, i);
-        g_assert (w);
+  /* Anything still running is for an outdated state now */
+  self->prepare_generation ++;
 
-        remove_child_by_index (self, i);
-        self->model_to --;
-        bottom_removed ++;
+  if (self->prepare == NULL)
+    return;
 
-        i--;
-      }
-  }
+  g_hash_table_iter_init (&iter, self->payloads);
+  while (g_hash_table_iter_next (&iter, NULL, &payload))
+    free_payload (self->prepare, payload);
 
-  /* Add top widgets */
-  {
-    /*g_debug ("adding on top. bin_y: %d, bin_y_diff: %f",*/
-               /*bin_y (self), self->bin_y_diff);*/
-    for (;;)
-      {
-        GtkWidget *new_widget;
-        int min;
+  g_hash_table_remove_all (self->payloads);
+}
 
-        if (bin_y (self) <= 0)
-          {
-            break;
-          }
+static void
+remove_payload (GdModelListBox *self,
+                guint           index)
+{
+  gpointer payload;
 
-        if (self->model_from == 0)
-          {
-            break;
-          }
+  if (self->prepare == NULL)
+    return;
 
-        self->model_from --;
+  if (g_hash_table_lookup_extended (self->payloads, GUINT_TO_POINTER (index), NULL, &payload))
+    {
+      g_hash_table_remove (self->payloads, GUINT_TO_POINTER (index));
+      free_payload (self->prepare, payload);
+    }
+}
 
-        g_debug ("Adding on top for index %u", self->model_from);
-        new_widget = get_widget (self, self->model_from);
-        g_assert (new_widget != NULL);
-        insert_child_internal (self, new_widget, 0);
-        min = requested_row_height (self, new_widget);
-        self->bin_y_diff -= min;
-        top_added ++;
-      }
-    g_debug ("After adding on top. bin_y: %d, bin_y_diff: %f",
-               bin_y (self), self->bin_y_diff);
+/* Moves the payloads along with their items */
+static void
+splice_payloads (GdModelListBox *self,
+                 guint           position,
+                 guint           removed,
+                 guint           added)
+{
+  GHashTable *payloads;
+  GHashTableIter iter;
+  gpointer key, payload;
 
-    if (top_added > 0 && bin_y (self) > 0)
-      goto maybe_add_widgets;
+  if (self->prepare == NULL || g_hash_table_size (self->payloads) == 0)
+    return;
 
-  }
+  /* Running jobs were started for the old positions */
+  self->prepare_generation ++;
 
-  /* Insert bottom widgets */
-  {
-    for (;;)
-      {
-        GtkWidget *new_widget;
+  payloads = g_hash_table_new (NULL, NULL);
 
-        /* If the widget is full anyway */
-        if (bin_y (self) + bin_height (self) >= widget_height)
-          {
-            break;
-          }
+  g_hash_table_iter_init (&iter, self->payloads);
+  while (g_hash_table_iter_next (&iter, &key, &payload))
+    {
+      guint index = GPOINTER_TO_UINT (key);
 
-        /* ... or if we are out of items */
-        if (self->model_to >= g_list_model_get_n_items (self->model))
-          {
-            break;
-          }
+      if (payload == PAYLOAD_PENDING ||
+          (index >= position && index < position + removed))
+        {
+          free_payload (self->prepare, payload);
+          continue;
+        }
 
-        g_debug ("Adding at bottom for model index %u. bin_y: %d, bin_height: %d", self->model_to,
-                   bin_y (self), bin_height (self));
-        new_widget = get_widget (self, self->model_to);
-        insert_child_internal (self, new_widget, self->widgets->len);
+      if (index >= position + removed)
+        index = index - removed + added;
 
-        self->model_to ++;
-        bottom_added ++;
-      }
-  }
+      g_hash_table_insert (payloads, GUINT_TO_POINTER (index), payload);
+    }
 
-  g_debug ("Top removed:    %d", top_removed);
-  g_debug ("Top added:      %d", top_added);
-  g_debug ("Bottom removed: %d", bottom_removed);
-  g_debug ("Bottom added:   %d", bottom_added);
+  g_hash_table_unref (self->payloads);
+  self->payloads = payloads;
+}
 
-  if (top_removed    > 0) g_assert_cmpint (top_added,      ==, 0);
-  if (top_added      > 0) g_assert_cmpint (top_removed,    ==, 0);
-  if (bottom_removed > 0) g_assert_cmpint (bottom_added,   ==, 0);
-  if (bottom_added   > 0) g_assert_cmpint (bottom_removed, ==, 0);
+static gboolean
+prepare_done_cb (gpointer user_data)
+{
+  PrepareJob *job = user_data;
+  GdModelListBox *self = job->box;
+  gpointer old_payload;
 
-  g_assert_cmpint (self->widgets->len, ==, self->model_to - self->model_from);
+  self->prepare_jobs --;
 
-  /*
-   * The configure_adjustment call will adjust the adjustment value if it's larger than the adjustment
-   * upper. BUT the assumption here is the we scrolled to the end, to the new value will simply be
-   * upper - page_size, which is wrong since it's value > upper - page_size because the upper changed
-   * as a result of us adding/removing widgets.
-   *
-   * We need to handle this here, separately.
-   */
-  double value = gtk_adjustment_get_value (self->vadjustment);
-  int new_upper = estimated_list_height (self);
+  /* Only use the result if nothing changed and bind didn't need it yet */
+  if (job->generation == self->prepare_generation &&
+      g_hash_table_lookup_extended (self->payloads, GUINT_TO_POINTER (job->index), NULL, &old_payload) &&
+      old_payload == PAYLOAD_PENDING)
+    g_hash_table_insert (self->payloads, GUINT_TO_POINTER (job->index), job->payload);
+  else
+    free_payload (job->prepare, job->payload);
 
-  if (new_upper != (int)upper_before)
-  /*if (value > new_upper - widget_height)*/
-    {
-      g_debug ("%d != %d", new_upper, (int)upper_before);
-       /*g_debug ("%f > %f!", value, new_upper - widget_height);*/
-      g_debug ("Value: %f, old upper: %f, new upper: %d, page_size: %d", value, upper_before, new_upper, widget_height);
-      g_debug ("bin_y:      %d", bin_y (self));
-      g_debug ("bin_y_diff: %f", self->bin_y_diff);
+  prepare_funcs_unref (job->prepare);
+  g_object_unref (job->item);
+  g_object_unref (self);
+  g_slice_free (PrepareJob, job);
 
-      int cur_bin_y = bin_y (self);
-      int new_value = (self->model_from * estimated_row_height (self)) - cur_bin_y;
-      new_value = MIN (new_value, new_upper - widget_height);
-      new_value = MAX (new_value, 0);
+  return G_SOURCE_REMOVE;
+}
 
-      gtk_adjustment_set_upper (self->vadjustment, new_upper);
-      set_vadjustment_value (self, new_value);
-    }
+static void
+prepare_thread_func (gpointer data,
+                     gpointer user_data)
+{
+  PrepareJob *job = data;
 
-  configure_adjustment (self);
+  job->payload = job->prepare->func (job->item, job->index, job->prepare->data);
 
-  g_assert_cmpint (self->bin_y_diff, >=, 0);
-  g_assert_cmpint (bin_y (self), <=, 0);
+  g_idle_add_full (G_PRIORITY_DEFAULT, prepare_done_cb, job, NULL);
+}
 
-  if (self->model_from > 0 && self->model_to == g_list_model_get_n_items (self->model))
-    g_assert (bin_y (self) + bin_height (self) >= widget_height);
+static GThreadPool *
+get_prepare_pool (void)
+{
+  static GThreadPool *pool = NULL;
+
+  if (g_once_init_enter (&pool))
+    {
+      GThreadPool *new_pool;
+
+      new_pool = g_thread_pool_new (prepare_thread_func, NULL, g_get_num_processors (), FALSE, NULL);
+      g_once_init_leave (&pool, new_pool);
+    }
 
+  return pool;
 }
 
+/*
+ * Prepares payloads on worker threads for the items around the visible ones,
+ * one screen full above and below. Payloads further away are dropped.
+ */
 static void
-value_changed_cb (GtkAdjustment *adjustment,
-                  gpointer       user_data)
+schedule_prepare (GdModelListBox *self)
 {
-  GdModelListBox *self = user_data;
+  GHashTableIter iter;
+  gpointer key, payload;
+  guint n_items;
+  guint margin;
+  guint from, to;
+  guint i;
+
+  if (self->prepare == NULL || self->model == NULL || self->widgets->len == 0)
+    return;
 
-  g_debug ("%s: %f -> %f", __FUNCTION__, self->last_value, gtk_adjustment_get_value (adjustment));
+  n_items = g_list_model_get_n_items (self->model);
+  margin = self->widgets->len;
+  from = self->model_from > margin ? self->model_from - margin : 0;
+  to = MIN (n_items, self->model_to + margin);
 
-  self->last_value = gtk_adjustment_get_value (adjustment);
-  g_debug ("QUEUE ALLOCATE");
-  /* ensure_visible_widgets will be called from size_allocate */
-  g_assert (GTK_IS_WIDGET (user_data));
-  gtk_widget_queue_allocate (user_data);
+  g_hash_table_iter_init (&iter, self->payloads);
+  while (g_hash_table_iter_next (&iter, &key, &payload))
+    {
+      guint index = GPOINTER_TO_UINT (key);
+
+      /* Keep some more, for scrolling back and forth */
+      if (index + margin < from || index >= to + margin)
+        {
+          free_payload (self->prepare, payload);
+          g_hash_table_iter_remove (&iter);
+        }
+    }
+
+  for (i = from; i < to; i ++)
+    {
+      PrepareJob *job;
+
+      if (i == self->model_from)
+        i = self->model_to;
+      if (i >= to)
+        break;
+
+      if (g_hash_table_contains (self->payloads, GUINT_TO_POINTER (i)))
+        continue;
+
+      job = g_slice_new (PrepareJob);
+      job->box = g_object_ref (self);
+      job->prepare = prepare_funcs_ref (self->prepare);
+      job->item = g_list_model_get_item (self->model, i);
+      job->index = i;
+      job->generation = self->prepare_generation;
+      job->payload = NULL;
+
+      g_hash_table_insert (self->payloads, GUINT_TO_POINTER (i), PAYLOAD_PENDING);
+      self->prepare_jobs ++;
+      g_thread_pool_push (get_prepare_pool (), job, NULL);
+    }
 }
 
+/* Makes sure the fill_func finds the payload for @index */
 static void
-items_changed_cb (GListModel *model,
-                  guint       position,
-                  guint       removed,
-                  guint       added,
-                  gpointer    user_data)
+ensure_payload (GdModelListBox *self,
+                guint           index,
+                gpointer        item)
 {
-  GdModelListBox *self = user_data;
-  int i;
+  gpointer payload;
 
-  g_debug ("%s: position %d, removed: %u, added: %u", __FUNCTION__, position, removed, added);
-  g_message ("Range: %u-%u", self->model_from, self->model_to);
+  if (self->prepare == NULL)
+    return;
 
-  /* If the change is out of our visible range anyway,
-   * we don't care. */
-  if (position > self->model_to)
+  if (g_hash_table_lookup_extended (self->payloads, GUINT_TO_POINTER (index), NULL, &payload) &&
+      payload != PAYLOAD_PENDING)
     {
-      configure_adjustment (self);
+      self->stats.prepare_hits ++;
       return;
     }
 
-  /* Empty the current view */
-  for (i = self->widgets->len - 1; i >= 0; i --)
-    remove_child_by_index (self, i);
+  /* Not ready in time, or never scheduled. A job that is still running for
+   * it will notice and drop its result. */
+  payload = self->prepare->func (item, index, self->prepare->data);
+  g_hash_table_insert (self->payloads, GUINT_TO_POINTER (index), payload);
+  self->stats.prepare_misses ++;
+}
+/* }}} */
 
-  self->model_to = self->model_from;
-  self->bin_y_diff = 0;
+static RowData *
+get_row_data (GdModelListBox *self,
+              guint           index)
+{
+  RowData *row_data;
+  gint64 trace_begin = GD_TRACE_BEGIN (BIND);
 
-  /* Will end up calling ensure_widgets */
-  gtk_widget_queue_allocate (GTK_WIDGET (self));
+  if (self->pool->len > 0)
+    {
+      row_data = g_ptr_array_remove_index_fast (self->pool,
+                                                self->pool->len - 1);
+      self->stats.pool_hits ++;
+    }
+  else
+    {
+      row_data = g_slice_new (RowData);
+      self->stats.pool_misses ++;
+      self->stats.widgets_created ++;
+    }
+
+  row_data->item = g_list_model_get_item (self->model, index);
+  watch_item (self, row_data->item);
+  ensure_payload (self, index, row_data->item);
+  row_data->height = self->measure_func (row_data->item, index, self->row_width,
+                                         self->snapshot_func_data);
+  self->stats.fill_calls ++;
+  self->stats.measure_calls ++;
+
+  GD_TRACE_END (BIND, trace_begin, "bind", "item %u (widgetless): %d",
+                index, row_data->height);
+
+  return row_data;
 }
 
-static void
-pressed_cb (GtkGestureMultiPress *gesture,
-            int                   n_press,
-            double                x,
-            double                y,
-            gpointer              user_data)
+/* Returns a row widget for the given item, or its RowData in widgetless mode.
+ * Sets *@bound unless it's a pooled widget still showing the item. */
+static gpointer
+get_widget (GdModelListBox *self,
+            guint           index,
+            gboolean       *bound)
 {
-  GdModelListBox *self = user_data;
+  gpointer item;
+  GtkWidget *old_widget;
+  GtkWidget *new_widget;
+  gboolean affine;
+  gint64 trace_begin;
 
-  Foreach_Row
-    int wx, wy;
-    gtk_widget_translate_coordinates (GTK_WIDGET (self), row, x, y, &wx, &wy);
-    if (gtk_widget_contains (row, wx, wy))
-      {
-        self->active_row = row;
-        gtk_widget_set_state_flags (row, GTK_STATE_FLAG_ACTIVE, FALSE);
-        break;
-      }
-  }}
+  *bound = TRUE;
+
+  if (is_widgetless (self))
+    return get_row_data (self, index);
+
+  trace_begin = GD_TRACE_BEGIN (BIND);
+  item = g_list_model_get_item (self->model, index);
+
+  old_widget = take_pooled_widget (self, index, item, &affine);
+  if (old_widget != NULL)
+    self->stats.pool_hits ++;
+  else
+    self->stats.pool_misses ++;
+
+  /* Still showing @item, so there is nothing to do */
+  if (affine)
+    {
+      g_object_unref (item);
+      self->stats.affine_hits ++;
+      *bound = FALSE;
+
+      GD_TRACE_END (BIND, trace_begin, "bind", "item %u (same widget)", index);
+      return old_widget;
+    }
+
+  ensure_payload (self, index, item);
+  new_widget = self->fill_func (item, old_widget, index, self->fill_func_data);
+  self->stats.fill_calls ++;
+  g_assert (new_widget != NULL);
+  g_assert (GTK_IS_WIDGET (new_widget));
+
+  if (old_widget != NULL)
+    g_assert (old_widget == new_widget);
+  else
+    self->stats.widgets_created ++;
+
+  if (g_object_is_floating (new_widget))
+    g_object_ref_sink (new_widget);
+
+  /* Remember the item so remove_func gets the right one, even if the
+   * model changed in between. This also owns the reference from get_item(). */
+  g_object_set_qdata_full (G_OBJECT (new_widget), bound_item_quark,
+                           item, g_object_unref);
+  g_object_set_qdata (G_OBJECT (new_widget), bound_index_quark, GUINT_TO_POINTER (index + 1));
+  watch_item (self, item);
+
+  GD_TRACE_END (BIND, trace_begin, "bind", "item %u%s", index,
+                old_widget != NULL ? "" : " (new widget)");
+
+  return new_widget;
 }
 
+/* Adds a height to the statistics estimated_row_height() uses. Only for rows
+ * that were just measured, rows that are just shown again don't count twice. */
 static void
-released_cb (GtkGestureMultiPress *gesture,
-             int                   n_press,
-             double                x,
-             double                y,
-             gpointer              user_data)
+sample_row_height (GdModelListBox *self,
+                   int             height)
 {
-  GdModelListBox *self = user_data;
+  self->height_sum += height;
+  self->height_count ++;
+}
 
-  Foreach_Row
+/* @bound: whether @row was just bound, and so measured for the first time */
+static void
+insert_child_internal (GdModelListBox *self,
+                       gpointer        row,
+                       guint           index,
+                       gboolean        bound)
+{
+  GtkWidget *widget = row;
+
+  if (is_widgetless (self))
+    {
+      if (bound)
+        sample_row_height (self, ((RowData *)row)->height);
+      g_ptr_array_insert (self->widgets, index, row);
+      self->stats.rows_realized ++;
+      return;
+    }
+
+  if (gtk_widget_get_parent (widget) == NULL)
+    gtk_widget_set_parent (widget, GTK_WIDGET (self));
+
+  /* Rows that kept their item were measured when it got bound */
+  if (bound)
+    {
+      if (self->columns->len > 0)
+        measure_columns (self, widget);
+      else if (self->declared_width < 0)
+        update_max_width (self, widget);
+    }
+
+  gtk_widget_set_child_visible (widget, TRUE);
+  if (bound)
+    sample_row_height (self, requested_row_height (self, widget));
+
+  if (gd_range_set_contains (self->selection, self->model_from + index))
+    gtk_widget_set_state_flags (widget, GTK_STATE_FLAG_SELECTED, FALSE);
+  else
+    gtk_widget_unset_state_flags (widget, GTK_STATE_FLAG_SELECTED);
+  g_ptr_array_insert (self->widgets, index, widget);
+  self->stats.rows_realized ++;
+}
+
+static void
+remove_child_by_index (GdModelListBox *self,
+                       guint           index)
+{
+  GtkWidget *row;
+  gint64 trace_begin = GD_TRACE_BEGIN (UNBIND);
+
+  row = g_ptr_array_index (self->widgets, index);
+
+  if (is_widgetless (self))
+    {
+      RowData *row_data = g_ptr_array_index (self->widgets, index);
+
+      unwatch_item (self, row_data->item);
+      g_clear_object (&row_data->item);
+      g_ptr_array_remove_index (self->widgets, index);
+      g_ptr_array_add (self->pool, row_data);
+
+      GD_TRACE_END (UNBIND, trace_begin, "unbind", "item %u (widgetless)", self->model_from + index);
+      return;
+    }
+
+  /* It keeps showing its item, remove_func gets called in release_widget() */
+  gtk_widget_set_child_visible (g_ptr_array_index (self->widgets, index), FALSE);
+
+  /* Can't use _fast for self->widgets, we need to keep the order. */
+  g_ptr_array_remove_index (self->widgets, index);
+  g_ptr_array_add (self->pool, row);
+  queue_detach_pool (self);
+
+  GD_TRACE_END (UNBIND, trace_begin, "unbind", "item %u", self->model_from + index);
+}
+
+static inline int
+requested_row_height (GdModelListBox *box,
+                      gpointer        w)
+{
+  int min;
+  gint64 trace_begin;
+
+  /* Measured when bound, and again when the width changes */
+  if (is_widgetless (box))
+    return ((RowData *)w)->height;
+
+  trace_begin = GD_TRACE_BEGIN (MEASURE);
+
+  gtk_widget_measure (w,
+                      GTK_ORIENTATION_VERTICAL,
+                      gtk_widget_get_width (GTK_WIDGET (box)),
+                      &min, NULL, NULL, NULL);
+  box->stats.measure_calls ++;
+
+  GD_TRACE_END (MEASURE, trace_begin, "measure", "row %p: %d", w, min);
+  return min;
+}
+
+// TODO(Perf): This function is useless as we always use it in a loop in ensure_visible_widgets
+static inline int
+row_y (GdModelListBox *self,
+       guint           index)
+{
+  int y = 0;
+  guint i;
+
+  for (i = 0; i < index; i ++)
+    y += requested_row_height (self, g_ptr_array_index (self->widgets, i));
+
+  return y;
+}
+
+static int
+estimated_row_height (GdModelListBox *self)
+{
+  int avg_widget_height = 0;
+
+  /* Every row seen so far, not just the ones in view, so this settles
+   * instead of changing whenever rows of different size scroll by */
+  if (self->height_count > 0)
+    return (int) ((self->height_sum + self->height_count / 2) / self->height_count);
+
+  Foreach_Row
+    avg_widget_height += requested_row_height (self, row);
+  }}
+
+  if (self->widgets->len > 0)
+    avg_widget_height /= self->widgets->len;
+  else
+    return 0;
+
+  return avg_widget_height;
+
+}
+
+static inline int
+bin_y (GdModelListBox *self)
+{
+  gint64 y = self->bin_y_diff - self->list_value;
+
+  /* Only far away after a jump, which is all the out-of-sight check needs */
+  return (int) CLAMP (y, G_MININT / 2, G_MAXINT / 2);
+}
+
+static inline int
+bin_height (GdModelListBox *self)
+{
+  int height = 0;
+
+  /* XXX This is only true if we actually allocate all rows at minimum height... */
+  Foreach_Row
+    height += requested_row_height (self, row);
+  }}
+
+  return height;
+}
+
+static gint64
+estimated_list_height (GdModelListBox *self)
+{
+  gint64 avg_height;
+  guint top_widgets;
+  guint bottom_widgets;
+  gint64 exact_height = 0;
+
+  avg_height = estimated_row_height (self);
+  top_widgets = self->model_from;
+  bottom_widgets = g_list_model_get_n_items (self->model) - self->model_to;
+
+  g_assert (top_widgets + bottom_widgets + self->widgets->len == g_list_model_get_n_items (self->model));
+
+  Foreach_Row
+    exact_height += requested_row_height (self, row);
+  }}
+
+  g_assert (self->widgets->len == (self->model_to - self->model_from));
+
+  return (top_widgets * avg_height) +
+         exact_height +
+         (bottom_widgets * avg_height);
+}
+
+/* Larger lists get scaled down onto the vadjustment, neither the
+ * scrollbar nor our parent can deal with more than an int */
+#define MAX_ADJUSTMENT_UPPER (G_MAXINT / 2)
+
+/*
+ * Puts the vadjustment value where self->list_value is.
+ */
+static void
+sync_adjustment_value (GdModelListBox *self)
+{
+  g_signal_handler_block (self->vadjustment,
+                          self->vadjustment_value_changed_id);
+  gtk_adjustment_set_value (self->vadjustment, self->list_value / self->adjustment_scale);
+  g_signal_handler_unblock (self->vadjustment,
+                            self->vadjustment_value_changed_id);
+
+  self->last_value = gtk_adjustment_get_value (self->vadjustment);
+
+  /* The vadjustment clamps the value to its upper, and so do we */
+  if (self->adjustment_scale == 1.0)
+    self->list_value = (gint64) self->last_value;
+  else if (self->last_value < self->list_value / self->adjustment_scale - 1)
+    self->list_value = (gint64) (self->last_value * self->adjustment_scale);
+}
+
+/*
+ * Scaled, wheel and touchpad scrolling go to scroll_cb() instead of the
+ * GtkScrolledWindow, which would scroll by the scale times as much.
+ */
+static void
+update_scroll_controller (GdModelListBox *self)
+{
+  gtk_event_controller_set_propagation_phase (self->scroll_controller,
+                                              self->adjustment_scale != 1.0 ? GTK_PHASE_BUBBLE : GTK_PHASE_NONE);
+}
+
+/*
+ * Sets the value in list pixels, without touching bin_y_diff.
+ */
+static void
+set_list_value (GdModelListBox *self,
+                gint64          value)
+{
+  self->list_value = value;
+  sync_adjustment_value (self);
+}
+
+/*
+ * Sets the upper in list pixels. Up to MAX_ADJUSTMENT_UPPER, the vadjustment
+ * gets the same. Above, the range of values is mapped linearly onto the one of
+ * the vadjustment, so both ends stay exact.
+ */
+static void
+set_list_upper (GdModelListBox *self,
+                gint64          upper)
+{
+  double page_size = gtk_adjustment_get_page_size (self->vadjustment);
+  double scale = 1.0;
+
+  self->list_upper = upper;
+
+  if (upper > MAX_ADJUSTMENT_UPPER && page_size < MAX_ADJUSTMENT_UPPER)
+    {
+      scale = MAX (1.0, (upper - page_size) / (MAX_ADJUSTMENT_UPPER - page_size));
+      upper = MAX_ADJUSTMENT_UPPER;
+    }
+
+  if ((gint64)gtk_adjustment_get_upper (self->vadjustment) != upper)
+    gtk_adjustment_set_upper (self->vadjustment, upper);
+
+  if (scale != self->adjustment_scale)
+    {
+      GD_NOTE (LAYOUT, g_message ("%s: Adjustment scale now %f", G_STRFUNC, scale));
+      self->adjustment_scale = scale;
+      update_scroll_controller (self);
+      sync_adjustment_value (self);
+    }
+}
+
+/**
+ * When we set the vadjustment value from within this widget, we need to care about two things:
+ *
+ *   1) Block the signal handler. It's mostly harmless but we don't want to unnecessarily
+ *      redo things and we especially don't want to call queue_allocate or even queue_resize
+ *      during size-allocate.
+ *
+ *   2) self->bin_y_diff depends on the adjustment value, so if we manually change the adjustment
+ *      value, we also need to update self->bin_y_diff. This should happen in such a way that
+ *      bin_y (self) returns the same value before and after setting the adjustment value
+ *      and bin_y_diff.
+ */
+static void
+set_vadjustment_value (GdModelListBox *self,
+                       gint64          new_value)
+{
+  int old_bin_y = bin_y (self);
+  gint64 cur_value = self->list_value;
+
+  GD_NOTE (LAYOUT, g_message ("%s: Adjusting value from %" G_GINT64_FORMAT " to %" G_GINT64_FORMAT
+                              ", bin_y_diff: %" G_GINT64_FORMAT,
+                              G_STRFUNC, cur_value, new_value, self->bin_y_diff));
+  set_list_value (self, new_value);
+  self->bin_y_diff -= (cur_value - new_value);
+  g_assert_cmpint (bin_y (self), ==, old_bin_y);
+}
+
+/* How much the estimated list height may differ from the upper of
+ * the vadjustment before we change it, relative to the upper */
+#define UPPER_TOLERANCE 0.02
+
+/* bin_y_diff moves by at most 1/DRIFT_CORRECTION of each scroll step */
+#define DRIFT_CORRECTION 4
+
+#define SCROLL_STEPS_PER_PAGE 10
+
+/*
+ * Returns the upper the vadjustment should have for the estimated
+ * @list_height. Small changes of the estimate keep the current upper,
+ * so the scrollbar doesn't jitter and our parent doesn't relayout.
+ * The rows don't care, bin_y_diff is independent of it.
+ */
+static gint64
+effective_upper (GdModelListBox *self,
+                 gint64          list_height)
+{
+  gint64 cur_upper = self->list_upper;
+  double page_size = gtk_adjustment_get_page_size (self->vadjustment);
+  gint64 value = self->list_value;
+  double tolerance;
+
+  if (self->widgets->len == 0 || cur_upper <= page_size)
+    return list_height;
+
+  /* At the end, the last row has to end exactly at upper */
+  if (self->model_to >= g_list_model_get_n_items (self->model))
+    return list_height;
+
+  /* Scrolled to the end of a too small upper, more rows have to fit */
+  if (value >= cur_upper - page_size - 1 && list_height > cur_upper)
+    return list_height;
+
+  tolerance = MAX (page_size / 2, cur_upper * UPPER_TOLERANCE);
+  if (ABS (list_height - cur_upper) > tolerance)
+    return list_height;
+
+  return cur_upper;
+}
+
+static void
+configure_adjustment (GdModelListBox *self)
+{
+  int widget_height;
+  gint64 list_height;
+  gint64 max_value;
+  gint64 cur_upper;
+  double page_size;
+
+  widget_height = gtk_widget_get_height (GTK_WIDGET (self));
+  list_height   = effective_upper (self, estimated_list_height (self));
+  cur_upper     = self->list_upper;
+  page_size     = gtk_adjustment_get_page_size (self->vadjustment);
+
+  /* The scale depends on the page size, so set that first */
+  if ((int)page_size != widget_height)
+    gtk_adjustment_set_page_size (self->vadjustment, widget_height);
+
+  gtk_adjustment_set_lower (self->vadjustment, 0.0);
+
+  if (cur_upper != list_height || (int)page_size != widget_height)
+    {
+      set_list_upper (self, list_height);
+      GD_NOTE (LAYOUT, g_message ("Changing upper from %" G_GINT64_FORMAT " to %" G_GINT64_FORMAT,
+                                  cur_upper, list_height));
+    }
+  else if (list_height == 0)
+    {
+      set_list_upper (self, widget_height);
+    }
+
+  max_value = MAX (0, list_height - widget_height);
+  if (self->list_value > max_value)
+    set_vadjustment_value (self, max_value);
+
+  /* Scrolled by pixels while scaled, move the scrollbar to where the rows are */
+  if (self->adjustment_scale != 1.0 &&
+      ABS (gtk_adjustment_get_value (self->vadjustment) -
+           self->list_value / self->adjustment_scale) >= 1)
+    sync_adjustment_value (self);
+}
+
+static void
+apply_pending_changes (GdModelListBox *self)
+{
+  int i;
+
+  if (!self->changes_pending)
+    return;
+
+  GD_NOTE (MODEL, g_message ("%s: position %u, removed: %u, added: %u", G_STRFUNC,
+                             self->changes_position, self->changes_removed, self->changes_added));
+  self->changes_pending = FALSE;
+
+  /* If the change is out of our visible range anyway, i.e. it starts
+   * after the last row we show (appends are the common case), we don't care.
+   * The new list height gets picked up by configure_adjustment() at the end
+   * of ensure_visible_widgets(). */
+  if (self->changes_position >= self->model_to &&
+      self->model_to > self->model_from)
+    {
+      splice_pool (self, self->changes_position, self->changes_removed, self->changes_added);
+      return;
+    }
+
+  /* Empty the current view. Rows for items before the change get
+   * their widgets back from the pool without binding them again. */
+  for (i = self->widgets->len - 1; i >= 0; i --)
+    remove_child_by_index (self, i);
+
+  splice_pool (self, self->changes_position, self->changes_removed, self->changes_added);
+
+  self->model_from = self->model != NULL ?
+                     MIN (self->model_from, g_list_model_get_n_items (self->model)) : 0;
+  self->model_to   = self->model_from;
+  self->bin_y_diff = 0;
+}
+
+/*
+ * Puts the rows for a saved scroll state in place, i.e. none yet but
+ * model_from and bin_y such that the rows added at the bottom start at the
+ * anchor item. Returns whether it did anything.
+ */
+static gboolean
+restore_scroll_state (GdModelListBox *self,
+                      int             widget_height)
+{
+  const GdModelListBoxScrollState *state = &self->scroll_state;
+  guint n_items = g_list_model_get_n_items (self->model);
+  gint64 value;
+  int i;
+
+  /* Wait for an actual size, otherwise this binds nothing and we'd have to
+   * do an out-of-sight jump once we have one. */
+  if (!self->scroll_state_pending || widget_height <= 0)
+    return FALSE;
+
+  self->scroll_state_pending = FALSE;
+
+  GD_NOTE (LAYOUT, g_message ("%s: anchor %u, offset %d, average height %d", G_STRFUNC,
+                              state->anchor_index, state->anchor_offset, state->average_height));
+
+  for (i = self->widgets->len - 1; i >= 0; i --)
+    remove_child_by_index (self, i);
+
+  self->model_from = MIN (state->anchor_index, n_items - 1);
+  self->model_to   = self->model_from;
+
+  /* The value gets corrected for the actual row heights once the rows are
+   * bound, at the end of ensure_visible_widgets(). */
+  value = MAX ((gint64)self->model_from * MAX (state->average_height, 0),
+               MAX (state->anchor_offset, 0));
+  self->bin_y_diff = value - MAX (state->anchor_offset, 0);
+
+  if (self->list_upper < value + widget_height)
+    set_list_upper (self, value + widget_height);
+
+  set_list_value (self, value);
+
+  return TRUE;
+}
+
+static void
+ensure_visible_widgets (GdModelListBox *self)
+{
+  int widget_height;
+  int bottom_removed = 0;
+  int bottom_added = 0;
+  int top_removed = 0;
+  int top_added = 0;
+  gboolean restoring;
+  gint64 trace_begin = GD_TRACE_BEGIN (LAYOUT);
+  gint64 start_time = g_get_monotonic_time ();
+
+  apply_pending_changes (self);
+
+  if (!self->vadjustment ||
+      !self->model ||
+      g_list_model_get_n_items (self->model) == 0)
+    {
+      self->stats.ensure_visible_time += g_get_monotonic_time () - start_time;
+      return;
+    }
+
+  widget_height = gtk_widget_get_height (GTK_WIDGET (self));
+
+  GD_NOTE (LAYOUT, g_message ("%s: value: %" G_GINT64_FORMAT ", upper: %" G_GINT64_FORMAT
+                              ", page_size: %f, widget height: %d, "
+                              "bin_y: %d, bin_height: %d, bin_y_diff: %" G_GINT64_FORMAT,
+                              G_STRFUNC,
+                              self->list_value,
+                              self->list_upper,
+                              gtk_adjustment_get_page_size (self->vadjustment),
+                              widget_height, bin_y (self), bin_height (self),
+                              self->bin_y_diff));
+
+  g_assert_cmpint (self->bin_y_diff, >=, 0);
+  gd_validate_cmpint (bin_height (self), >=, 0);
+  gint64 upper_before = estimated_list_height (self);
+
+  gint64 max_value = MAX (0, effective_upper (self, upper_before) - widget_height);
+  if (self->follow_tail && self->at_tail)
+    {
+      /* Following the end of the list, so scroll down to whatever got appended.
+       * This is just like the user scrolling down, so only the rows that get
+       * into view are bound. */
+      if (self->list_upper < upper_before)
+        set_list_upper (self, upper_before);
+
+      set_list_value (self, max_value);
+    }
+  else if (self->list_value > max_value)
+    {
+      /* We do NOT use _set_adjustment_value here since that would adjust the bin_y_diff
+       * as well, which the later code will already to. */
+      set_list_value (self, max_value);
+    }
+
+  restoring = restore_scroll_state (self, widget_height);
+
+  /* This "out of sight" case happens when the new value is so different from the old one
+   * that we rather just remove all widgets and adjust the model_from/model_to values.
+   * This happens when scrolling fast, clicking the scrollbar directly or just by programmatically
+   * setting the vadjustment value.
+   */
+  if (!restoring &&
+      (bin_y (self) + bin_height (self) < 0 ||
+       bin_y (self) >= widget_height))
+    {
+      int avg_row_height = estimated_row_height (self);
+      double percentage;
+      gint64 value = self->list_value;
+      gint64 upper = self->list_upper;
+      double page_size = gtk_adjustment_get_page_size (self->vadjustment);
+      guint top_widget_index;
+      int i;
+
+      GD_NOTE (LAYOUT, g_message ("Out of sight! bin_y: %d, bin_height: %d, value: %" G_GINT64_FORMAT
+                                  ", upper: %" G_GINT64_FORMAT,
+                                  bin_y (self), bin_height (self), value, upper));
+
+      if (is_widgetless (self))
+        {
+          for (i = self->widgets->len - 1; i >= 0; i --)
+            remove_child_by_index (self, i);
+        }
+      else
+        {
+          GPtrArray *rows = self->widgets;
+
+          /* The rows stay parented and visible, get_widget() re-targets them
+           * to the items at the new position. */
+          g_assert (self->teleport->len == 0);
+          self->widgets = self->teleport;
+          self->teleport = rows;
+        }
+
+      g_assert (self->widgets->len == 0);
+      self->stats.out_of_sight_resets ++;
+
+      percentage = value / (upper - page_size);
+
+      top_widget_index = (guint) (g_list_model_get_n_items (self->model) * percentage);
+      GD_NOTE (LAYOUT, g_message ("top_widget_index: %u (Percentage %f)", top_widget_index, percentage));
+
+      if (top_widget_index > g_list_model_get_n_items (self->model))
+        {
+          g_assert (FALSE);
+        }
+      else
+        {
+          self->model_from = top_widget_index;
+          self->model_to   = top_widget_index;
+          self->bin_y_diff = (gint64)self->model_from * avg_row_height;
+        }
+
+        g_assert (self->model_from <= g_list_model_get_n_items (self->model));
+        g_assert (self->model_from <= self->model_to);
+        g_assert (self->model_to <= g_list_model_get_n_items (self->model));
+        g_assert (bin_y (self) <= widget_height);
+    }
+  else if (!restoring && self->scroll_delta > 0 &&
+           self->model_from > 0 &&
+           self->model_to < g_list_model_get_n_items (self->model))
+    {
+      /* The rows above model_from are estimated to start at model_from * the
+       * average height. Move bin_y_diff towards that while the user scrolls,
+       * a bit faster or slower than the content, so small estimate changes
+       * don't have to move the value. Not at the ends, those are exact. */
+      gint64 drift = (gint64)self->model_from * estimated_row_height (self) - self->bin_y_diff;
+      gint64 max_step = self->scroll_delta / DRIFT_CORRECTION;
+
+      self->bin_y_diff += CLAMP (drift, -max_step, max_step);
+    }
+
+  self->scroll_delta = 0;
+
+  /* It might be necessary to get back here... */
+maybe_add_widgets:
+  GD_NOTE (LAYOUT, g_message ("model_from: %u, model_to: %u", self->model_from, self->model_to));
+  /* If we already show the last item, i.e. we are at the end of the list anyway,
+   * BUT the last item is not allocated at the very bottom, we shift everything down here,
+   * so the code later might add an item at the top.
+   *
+   * This can happen when one scrolled to the bottom and then increased the widget height.
+   */
+  if (self->model_to == g_list_model_get_n_items (self->model) &&
+      self->model_from > 0 &&
+      bin_y (self) + bin_height (self) < widget_height)
+    {
+      self->bin_y_diff += widget_height - (bin_y (self) + bin_height (self));
+      GD_NOTE (LAYOUT, g_message ("At the end, bin_y_diff now: %" G_GINT64_FORMAT, self->bin_y_diff));
+
+      gd_validate_cmpint (bin_y (self) + bin_height (self), >=, widget_height);
+    }
+  else if (self->model_from == 0 && bin_y (self) > 0)
+    {
+      /* We are at the very top of the list (item 0 is shown), but we
+       * allocate it at y > 0 because of a radical value/estimated-height change. */
+      GD_NOTE (LAYOUT, g_message ("First row allocated at bin_y %d, resetting", bin_y (self)));
+      self->bin_y_diff = 0;
+      set_list_value (self, 0);
+    }
+
+  /* Remove top widgets */
+  {
+    guint i;
+
+    for (i = 0; i < self->widgets->len; i ++)
+      {
+        GtkWidget *w = g_ptr_array_index (self->widgets, i);
+        int w_height = requested_row_height (self, w);
+        if (bin_y (self) + row_y (self, i) + w_height < 0)
+          {
+            g_assert_cmpint (i, ==, 0);
+            self->bin_y_diff += w_height;
+            remove_child_by_index (self, i);
+            self->model_from ++;
+            top_removed ++;
+            GD_NOTE (LAYOUT, g_message ("Removing from top with index %u. bin_y_diff now: %" G_GINT64_FORMAT,
+                                        i, self->bin_y_diff));
+
+            /* Do the first row again */
+            i--;
+          } else
+            break;
+      }
+  }
+
+  /* Remove bottom widgets */
+  {
+    int i = self->widgets->len - 1;
+    for (;;)
+      {
+        GtkWidget *w;
+        int y;
+
+        if (i <= 0)
+          {
+            break;
+          }
+
+        y = bin_y (self) + row_y (self, i);
+
+        if (y < widget_height)
+          {
+            break;
+          }
+        GD_NOTE (LAYOUT, g_message ("Removing widget at bottom with y %d", y));
+
+        w = g_ptr_array_index (self->widgets, i);
+        g_assert (w);
+
+        remove_child_by_index (self, i);
+        self->model_to --;
+        bottom_removed ++;
+
+        i--;
+      }
+  }
+
+  /* Add top widgets */
+  {
+    for (;;)
+      {
+        GtkWidget *new_widget;
+        gboolean bound;
+        int min;
+
+        if (bin_y (self) <= 0)
+          {
+            break;
+          }
+
+        if (self->model_from == 0)
+          {
+            break;
+          }
+
+        self->model_from --;
+
+        GD_NOTE (LAYOUT, g_message ("Adding on top for index %u", self->model_from));
+        new_widget = get_widget (self, self->model_from, &bound);
+        g_assert (new_widget != NULL);
+        insert_child_internal (self, new_widget, 0, bound);
+        min = requested_row_height (self, new_widget);
+        self->bin_y_diff -= min;
+        top_added ++;
+      }
+    GD_NOTE (LAYOUT, g_message ("After adding on top. bin_y: %d, bin_y_diff: %" G_GINT64_FORMAT,
+                                bin_y (self), self->bin_y_diff));
+
+    if (top_added > 0 && bin_y (self) > 0)
+      goto maybe_add_widgets;
+
+  }
+
+  /* Insert bottom widgets */
+  {
+    for (;;)
+      {
+        GtkWidget *new_widget;
+        gboolean bound;
+
+        /* If the widget is full anyway */
+        if (bin_y (self) + bin_height (self) >= widget_height)
+          {
+            break;
+          }
+
+        /* ... or if we are out of items */
+        if (self->model_to >= g_list_model_get_n_items (self->model))
+          {
+            break;
+          }
+
+        GD_NOTE (LAYOUT, g_message ("Adding at bottom for model index %u. bin_y: %d, bin_height: %d",
+                                    self->model_to, bin_y (self), bin_height (self)));
+        new_widget = get_widget (self, self->model_to, &bound);
+        insert_child_internal (self, new_widget, self->widgets->len, bound);
+
+        self->model_to ++;
+        bottom_added ++;
+      }
+  }
+
+  /* Restored close to the end of the list, so there are not enough rows below
+   * the anchor. Go back and let the code above fill up from the top. */
+  if (restoring && self->model_from > 0 &&
+      bin_y (self) + bin_height (self) < widget_height)
+    {
+      restoring = FALSE;
+      goto maybe_add_widgets;
+    }
+
+  /* Rows from before an out-of-sight jump that weren't needed after it */
+  while (self->teleport->len > 0)
+    {
+      GtkWidget *row = g_ptr_array_remove_index_fast (self->teleport, self->teleport->len - 1);
+
+      gtk_widget_set_child_visible (row, FALSE);
+      g_ptr_array_add (self->pool, row);
+      queue_detach_pool (self);
+    }
+
+  GD_NOTE (LAYOUT, g_message ("Top removed: %d, top added: %d, bottom removed: %d, bottom added: %d",
+                              top_removed, top_added, bottom_removed, bottom_added));
+
+  if (top_removed    > 0) g_assert_cmpint (top_added,      ==, 0);
+  if (top_added      > 0) g_assert_cmpint (top_removed,    ==, 0);
+  if (bottom_removed > 0) g_assert_cmpint (bottom_added,   ==, 0);
+  if (bottom_added   > 0) g_assert_cmpint (bottom_removed, ==, 0);
+
+  g_assert_cmpint (self->widgets->len, ==, self->model_to - self->model_from);
+
+  /*
+   * The configure_adjustment call will adjust the adjustment value if it's larger than the adjustment
+   * upper. BUT the assumption here is the we scrolled to the end, to the new value will simply be
+   * upper - page_size, which is wrong since it's value > upper - page_size because the upper changed
+   * as a result of us adding/removing widgets.
+   *
+   * We need to handle this here, separately.
+   */
+  gint64 new_upper = estimated_list_height (self);
+
+  if (new_upper != upper_before &&
+      effective_upper (self, new_upper) == new_upper)
+    {
+      GD_NOTE (LAYOUT, g_message ("Value: %" G_GINT64_FORMAT ", old upper: %" G_GINT64_FORMAT
+                                  ", new upper: %" G_GINT64_FORMAT ", bin_y: %d, bin_y_diff: %" G_GINT64_FORMAT,
+                                  self->list_value, upper_before, new_upper, bin_y (self), self->bin_y_diff));
+
+      int cur_bin_y = bin_y (self);
+      gint64 new_value = ((gint64)self->model_from * estimated_row_height (self)) - cur_bin_y;
+      new_value = MIN (new_value, new_upper - widget_height);
+      new_value = MAX (new_value, 0);
+
+      set_list_upper (self, new_upper);
+      set_vadjustment_value (self, new_value);
+    }
+
+  configure_adjustment (self);
+
+  /* The upper estimate might have changed, stay pinned to it */
+  if (self->follow_tail && self->at_tail &&
+      self->model_to == g_list_model_get_n_items (self->model))
+    {
+      gint64 tail_value = MAX (0, self->list_upper - widget_height);
+
+      if (self->list_value != tail_value)
+        set_vadjustment_value (self, tail_value);
+    }
+
+  g_assert_cmpint (self->bin_y_diff, >=, 0);
+  g_assert_cmpint (bin_y (self), <=, 0);
+
+  if (self->model_from > 0 && self->model_to == g_list_model_get_n_items (self->model))
+    gd_validate_cmpint (bin_y (self) + bin_height (self), >=, widget_height);
+
+  self->stats.ensure_visible_time += g_get_monotonic_time () - start_time;
+  GD_TRACE_END (LAYOUT, trace_begin, "ensure-visible-widgets", "rows %u-%u", self->model_from, self->model_to);
+}
+
+static gboolean
+is_at_tail (GdModelListBox *self)
+{
+  double page_size = gtk_adjustment_get_page_size (self->vadjustment);
+
+  /* Allow for rounding, the value is set from ints */
+  return self->list_value >= self->list_upper - page_size - 1;
+}
+
+static void
+value_changed_cb (GtkAdjustment *adjustment,
+                  gpointer       user_data)
+{
+  GdModelListBox *self = user_data;
+  double value = gtk_adjustment_get_value (adjustment);
+  gint64 old_list_value = self->list_value;
+
+  GD_NOTE (LAYOUT, g_message ("%s: %f -> %f", G_STRFUNC, self->last_value, value));
+
+  /* Scrollbar clicks and drags, these mean a position in the list. While
+   * scaled, wheel and keys don't get here but go to scroll_by_pixels(). */
+  self->list_value = (gint64) (value * self->adjustment_scale);
+
+  self->scroll_delta += ABS (self->list_value - old_list_value);
+  self->last_value = value;
+  self->at_tail = is_at_tail (self);
+
+  if (self->trace != NULL)
+    gd_scroll_trace_add (self->trace, GD_SCROLL_TRACE_VALUE, value, 0, 0);
+  /* ensure_visible_widgets will be called from size_allocate */
+  g_assert (GTK_IS_WIDGET (user_data));
+  gtk_widget_queue_allocate (user_data);
+}
+
+/*
+ * Scrolls by @delta list pixels. Through the vadjustment, that would be
+ * @delta times the scale.
+ */
+static void
+scroll_by_pixels (GdModelListBox *self,
+                  gint64          delta)
+{
+  double page_size = gtk_adjustment_get_page_size (self->vadjustment);
+  gint64 max_value = MAX (0, self->list_upper - (gint64) page_size);
+  gint64 old_list_value = self->list_value;
+
+  GD_NOTE (LAYOUT, g_message ("%s: %" G_GINT64_FORMAT, G_STRFUNC, delta));
+
+  set_list_value (self, CLAMP (self->list_value + delta, 0, max_value));
+
+  self->scroll_delta += ABS (self->list_value - old_list_value);
+  self->at_tail = is_at_tail (self);
+
+  if (self->trace != NULL)
+    gd_scroll_trace_add (self->trace, GD_SCROLL_TRACE_VALUE, self->last_value, 0, 0);
+  gtk_widget_queue_allocate (GTK_WIDGET (self));
+}
+
+/* How far one wheel click or arrow key press scrolls */
+static gint64
+scroll_step (GdModelListBox *self)
+{
+  return MAX (1, (gint64) gtk_adjustment_get_page_size (self->vadjustment) / SCROLL_STEPS_PER_PAGE);
+}
+
+static void
+scroll_cb (GtkEventControllerScroll *controller,
+           double                    dx,
+           double                    dy,
+           gpointer                  user_data)
+{
+  GdModelListBox *self = user_data;
+  double delta;
+
+  if (self->vadjustment == NULL)
+    return;
+
+  delta = dy * scroll_step (self);
+
+  scroll_by_pixels (self, (gint64) (delta + (delta < 0 ? -0.5 : 0.5)));
+}
+
+static gboolean
+__scroll_by (GdModelListBox *self,
+             GtkScrollType   scroll)
+{
+  gint64 page_size;
+
+  /* Not scaled, the GtkScrolledWindow bindings do the same */
+  if (self->vadjustment == NULL || self->adjustment_scale == 1.0)
+    return FALSE;
+
+  page_size = (gint64) gtk_adjustment_get_page_size (self->vadjustment);
+
+  switch (scroll)
+    {
+      case GTK_SCROLL_STEP_UP:
+        scroll_by_pixels (self, - scroll_step (self));
+        return TRUE;
+      case GTK_SCROLL_STEP_DOWN:
+        scroll_by_pixels (self, scroll_step (self));
+        return TRUE;
+      case GTK_SCROLL_PAGE_UP:
+        scroll_by_pixels (self, - page_size);
+        return TRUE;
+      case GTK_SCROLL_PAGE_DOWN:
+        scroll_by_pixels (self, page_size);
+        return TRUE;
+      default:
+        return FALSE;
+    }
+}
+
+/*
+ * Merges the splice (position, removed, added) into the pending one.
+ * Both are expressed in terms of the model state they were emitted on,
+ * so the result is one splice going from the model state at the last
+ * layout to the current one, covering every item either of them touched.
+ */
+static void
+merge_pending_change (GdModelListBox *self,
+                      guint           position,
+                      guint           removed,
+                      guint           added)
+{
+  guint start;
+  guint end;
+
+  if (!self->changes_pending)
+    {
+      self->changes_pending  = TRUE;
+      self->changes_position = position;
+      self->changes_removed  = removed;
+      self->changes_added    = added;
+      return;
+    }
+
+  start = MIN (self->changes_position, position);
+  /* End of the touched range, in the model state between the two changes */
+  end   = MAX (self->changes_position + self->changes_added, position + removed);
+
+  self->changes_removed  = end - self->changes_added + self->changes_removed - start;
+  self->changes_added    = end - removed + added - start;
+  self->changes_position = start;
+}
+
+static void
+items_changed_cb (GListModel *model,
+                  guint       position,
+                  guint       removed,
+                  guint       added,
+                  gpointer    user_data)
+{
+  GdModelListBox *self = user_data;
+
+  GD_NOTE (MODEL, g_message ("%s: position %u, removed: %u, added: %u",
+                             G_STRFUNC, position, removed, added));
+
+  if (self->trace != NULL)
+    gd_scroll_trace_add (self->trace, GD_SCROLL_TRACE_SPLICE, position, removed, added);
+
+  /* The selection is in terms of positions, so it needs to follow every single
+   * change. This is O(ranges), not O(items). */
+  gd_range_set_splice (self->selection, position, removed, added);
+  if (self->selection_anchor != G_MAXUINT && self->selection_anchor >= position)
+    {
+      if (self->selection_anchor < position + removed)
+        self->selection_anchor = G_MAXUINT;
+      else
+        self->selection_anchor = self->selection_anchor - removed + added;
+    }
+
+  splice_payloads (self, position, removed, added);
+
+  /* Bulk updates usually emit one items-changed per item, so we don't do anything
+   * here but remember what changed. Everything is applied at once in the next
+   * size-allocate, see apply_pending_changes(). */
+  if (!self->changes_pending)
+    gtk_widget_queue_allocate (GTK_WIDGET (self));
+
+  merge_pending_change (self, position, removed, added);
+}
+
+/*
+ * Runs the fill_func again for the row at @i, on the same widget. The layout
+ * only gets redone if the row's height changed.
+ */
+static void
+rebind_row (GdModelListBox *self,
+            guint           i)
+{
+  guint index = self->model_from + i;
+  gpointer row = g_ptr_array_index (self->widgets, i);
+  gpointer item;
+  int old_height;
+  int new_height;
+
+  GD_NOTE (MODEL, g_message ("%s: item %u", G_STRFUNC, index));
+
+  self->rebinding = TRUE;
+  old_height = requested_row_height (self, row);
+  unwatch_item (self, bound_item (self, row));
+  /* The payload is just as outdated as the row */
+  remove_payload (self, index);
+
+  if (is_widgetless (self))
+    {
+      RowData *row_data = row;
+
+      item = g_list_model_get_item (self->model, index);
+      g_object_unref (row_data->item);
+      row_data->item = item;
+      ensure_payload (self, index, item);
+      row_data->height = self->measure_func (item, index, self->row_width,
+                                             self->snapshot_func_data);
+      self->stats.measure_calls ++;
+    }
+  else
+    {
+      GtkWidget *widget = row;
+      GtkWidget *new_widget;
+
+      if (self->remove_func)
+        self->remove_func (widget, bound_item (self, row), self->remove_func_data);
+
+      item = g_list_model_get_item (self->model, index);
+      ensure_payload (self, index, item);
+      new_widget = self->fill_func (item, widget, index, self->fill_func_data);
+      g_assert (new_widget == widget);
+
+      /* Drops the reference to the previously bound item */
+      g_object_set_qdata_full (G_OBJECT (widget), bound_item_quark,
+                               item, g_object_unref);
+
+      if (self->columns->len > 0)
+        measure_columns (self, widget);
+      else if (self->declared_width < 0)
+        update_max_width (self, widget);
+    }
+
+  self->stats.fill_calls ++;
+  watch_item (self, item);
+  self->rebinding = FALSE;
+
+  new_height = requested_row_height (self, row);
+  sample_row_height (self, new_height);
+  if (new_height != old_height)
+    gtk_widget_queue_allocate (GTK_WIDGET (self));
+  else
+    gtk_widget_queue_draw (GTK_WIDGET (self));
+}
+
+static void
+item_notify_cb (GObject    *item,
+                GParamSpec *pspec,
+                gpointer    user_data)
+{
+  GdModelListBox *self = user_data;
+
+  /* The fill_func changing the item shouldn't send us in circles */
+  if (self->rebinding)
+    return;
+
+  Foreach_Row
+    if (bound_item (self, row) == (gpointer)item)
+      {
+        gd_model_list_box_invalidate_item (self, self->model_from + i);
+        return;
+      }
+  }}
+
+  /* A pooled widget that was waiting for it to come back */
+  if (!is_widgetless (self))
+    {
+      guint i;
+
+      for (i = 0; i < self->pool->len; i ++)
+        {
+          GtkWidget *widget = g_ptr_array_index (self->pool, i);
+
+          if (affine_index (widget) != 0 && bound_item (self, widget) == (gpointer)item)
+            release_widget (self, widget);
+        }
+    }
+}
+
+/* Selection {{{ */
+static void
+update_rows_selected (GdModelListBox *self)
+{
+  /* The selection is picked up in snapshot() */
+  if (is_widgetless (self))
+    {
+      gtk_widget_queue_draw (GTK_WIDGET (self));
+      return;
+    }
+
+  Foreach_Row
+    if (gd_range_set_contains (self->selection, self->model_from + i))
+      gtk_widget_set_state_flags (row, GTK_STATE_FLAG_SELECTED, FALSE);
+    else
+      gtk_widget_unset_state_flags (row, GTK_STATE_FLAG_SELECTED);
+  }}
+}
+
+static void
+selection_changed (GdModelListBox *self,
+                   guint           position,
+                   guint           n_items)
+{
+  update_rows_selected (self);
+
+  if (n_items > 0)
+    g_signal_emit (self, signals[SIGNAL_SELECTION_CHANGED], 0, position, n_items);
+}
+
+/* Returns the range of items selection_changed() has to be emitted for if the
+ * entire selection changes. */
+static void
+get_selection_bounds (GdModelListBox *self,
+                      guint          *start,
+                      guint          *end)
+{
+  guint n_ranges = gd_range_set_get_n_ranges (self->selection);
+  guint first, last, n;
+
+  if (n_ranges == 0)
+    {
+      *start = G_MAXUINT;
+      *end = 0;
+      return;
+    }
+
+  gd_range_set_get_range (self->selection, 0, &first, &n);
+  gd_range_set_get_range (self->selection, n_ranges - 1, &last, &n);
+
+  *start = first;
+  *end = last + n;
+}
+
+static void
+select_range_internal (GdModelListBox *self,
+                       guint           position,
+                       guint           n_items,
+                       gboolean        unselect_rest)
+{
+  guint changed_start = position;
+  guint changed_end = position + n_items;
+
+  if (unselect_rest)
+    {
+      guint start, end;
+
+      get_selection_bounds (self, &start, &end);
+      changed_start = MIN (changed_start, start);
+      changed_end = MAX (changed_end, end);
+
+      gd_range_set_clear (self->selection);
+    }
+
+  gd_range_set_add (self->selection, position, n_items);
+  selection_changed (self, changed_start, changed_end - changed_start);
+}
+
+static void
+select_item_for_click (GdModelListBox *self,
+                       guint           item_index)
+{
+  GdkModifierType state = 0;
+  gboolean extend;
+  gboolean modify;
+
+  if (self->selection_mode == GD_SELECTION_NONE)
+    return;
+
+  gtk_get_current_event_state (&state);
+  extend = (state & GDK_SHIFT_MASK) != 0;
+  modify = (state & GDK_CONTROL_MASK) != 0;
+
+  if (self->selection_mode == GD_SELECTION_MULTIPLE &&
+      extend && self->selection_anchor != G_MAXUINT)
+    {
+      /* Shift-click selects everything between the anchor and the clicked item,
+       * no matter how many items that is. The anchor stays where it is. */
+      guint from = MIN (self->selection_anchor, item_index);
+      guint to   = MAX (self->selection_anchor, item_index);
+
+      select_range_internal (self, from, to - from + 1, !modify);
+    }
+  else if (self->selection_mode == GD_SELECTION_MULTIPLE && modify)
+    {
+      if (gd_range_set_contains (self->selection, item_index))
+        gd_model_list_box_unselect_item (self, item_index);
+      else
+        select_range_internal (self, item_index, 1, FALSE);
+
+      self->selection_anchor = item_index;
+    }
+  else
+    {
+      select_range_internal (self, item_index, 1, TRUE);
+      self->selection_anchor = item_index;
+    }
+}
+/* }}} */
+
+static void
+pressed_cb (GtkGestureMultiPress *gesture,
+            int                   n_press,
+            double                x,
+            double                y,
+            gpointer              user_data)
+{
+  GdModelListBox *self = user_data;
+
+  if (is_widgetless (self))
+    {
+      self->active_index = gd_model_list_box_get_item_at_y (self, y);
+      gtk_widget_queue_draw (GTK_WIDGET (self));
+      return;
+    }
+
+  Foreach_Row
+    int wx, wy;
+    gtk_widget_translate_coordinates (GTK_WIDGET (self), row, x, y, &wx, &wy);
+    if (gtk_widget_contains (row, wx, wy))
+      {
+        self->active_row = row;
+        gtk_widget_set_state_flags (row, GTK_STATE_FLAG_ACTIVE, FALSE);
+        break;
+      }
+  }}
+}
+
+static void
+released_cb (GtkGestureMultiPress *gesture,
+             int                   n_press,
+             double                x,
+             double                y,
+             gpointer              user_data)
+{
+  GdModelListBox *self = user_data;
+
+  if (is_widgetless (self))
+    {
+      guint item_index = gd_model_list_box_get_item_at_y (self, y);
+
+      if (item_index != G_MAXUINT && item_index == self->active_index)
+        {
+          RowData *row_data = g_ptr_array_index (self->widgets, item_index - self->model_from);
+
+          select_item_for_click (self, item_index);
+          g_signal_emit (self, signals[SIGNAL_ROW_ACTIVATED], 0,
+                         NULL, row_data->item, item_index);
+        }
+
+      self->active_index = G_MAXUINT;
+      gtk_widget_queue_draw (GTK_WIDGET (self));
+      return;
+    }
+
+  Foreach_Row
     int wx, wy;
     gtk_widget_translate_coordinates (GTK_WIDGET (self), row, x, y, &wx, &wy);
     if (gtk_widget_contains (row, wx, wy))
       {
         if (row == self->active_row)
           {
-            guint item_index = self->model_from + i;
-            gpointer item = g_list_model_get_item (self->model, item_index);
+            guint item_index = self->model_from + i;
+            gpointer item = g_object_get_qdata (G_OBJECT (row), bound_item_quark);
+
+            select_item_for_click (self, item_index);
+            g_signal_emit (self, signals[SIGNAL_ROW_ACTIVATED], 0,
+                           row, item, item_index);
+          }
+        break;
+      }
+  }}
+
+
+  if (self->active_row != NULL)
+    {
+      gtk_widget_unset_state_flags (self->active_row, GTK_STATE_FLAG_ACTIVE);
+    }
+
+  self->active_row = NULL;
+}
+
+/*
+ * Checks that the rows are allocated right below each other, starting at bin_y
+ * and covering the entire widget unless we ran out of items.
+ * Only called when validating.
+ */
+static void
+validate_allocation (GdModelListBox *self)
+{
+  int widget_height = gtk_widget_get_height (GTK_WIDGET (self));
+  int y = bin_y (self);
+
+  gd_validate_cmpint (self->widgets->len, ==, self->model_to - self->model_from);
+  gd_validate_cmpint (self->model_to, <=, g_list_model_get_n_items (self->model));
+  gd_validate_cmpint (y, <=, 0);
+
+  Foreach_Row
+    GtkAllocation alloc;
+
+    if (is_widgetless (self))
+      {
+        y += requested_row_height (self, row);
+        continue;
+      }
+
+    gtk_widget_get_allocation (row, &alloc);
+    gd_validate_cmpint (alloc.y, ==, y);
+    gd_validate_cmpint (alloc.height, ==, requested_row_height (self, row));
+    y += alloc.height;
+  }}
+
+  if (self->model_to < g_list_model_get_n_items (self->model))
+    gd_validate_cmpint (y, >=, widget_height);
+}
+
+static void
+remeasure_rows (GdModelListBox *self,
+                int             width)
+{
+  self->row_width = width;
+
+  Foreach_Row
+    RowData *row_data = (RowData *)row;
+
+    row_data->height = self->measure_func (row_data->item, self->model_from + i, width,
+                                           self->snapshot_func_data);
+    self->stats.measure_calls ++;
+  }}
+}
+
+/* GtkWidget vfuncs {{{ */
+static gboolean
+resize_idle_cb (gpointer user_data)
+{
+  GdModelListBox *self = user_data;
+
+  self->resize_id = 0;
+  self->max_width_changed = FALSE;
+  gtk_widget_queue_resize (GTK_WIDGET (self));
+
+  return G_SOURCE_REMOVE;
+}
+
+/*
+ * We can't queue a resize from size_allocate, so this happens right after.
+ * Rows bound until then just make it pick up a larger width.
+ */
+static void
+queue_width_resize (GdModelListBox *self)
+{
+  if (self->resize_id != 0)
+    return;
+
+  self->resize_id = g_idle_add_full (G_PRIORITY_HIGH_IDLE, resize_idle_cb, self, NULL);
+}
+
+static void
+cancel_width_resize (GdModelListBox *self)
+{
+  if (self->resize_id != 0)
+    {
+      g_source_remove (self->resize_id);
+      self->resize_id = 0;
+    }
+}
+
+/*
+ * Column boxes measure their cells with the column widths, so their cached
+ * sizes are stale once those change. Unlike queueing a resize on ourselves,
+ * this is fine during size_allocate: visible rows get measured and allocated
+ * right after, and pooled ones whenever they are bound again.
+ */
+static void
+resize_column_rows (GdModelListBox *self)
+{
+  guint p;
+
+  if (is_widgetless (self))
+    return;
+
+  Foreach_Row
+    if (GD_IS_COLUMN_BOX (row))
+      gtk_widget_queue_resize (row);
+  }}
+
+  for (p = 0; p < self->pool->len; p ++)
+    {
+      GtkWidget *row = g_ptr_array_index (self->pool, p);
+
+      if (GD_IS_COLUMN_BOX (row))
+        gtk_widget_queue_resize (row);
+    }
+}
+
+static void
+__size_allocate (GtkWidget           *widget,
+                 const GtkAllocation *allocation,
+                 int                  baseline)
+{
+  GdModelListBox *self = GD_MODEL_LIST_BOX (widget);
+  gint64 trace_begin = GD_TRACE_BEGIN (LAYOUT);
+  gint64 start_time = g_get_monotonic_time ();
+  guint64 measure_calls_before = self->stats.measure_calls;
+
+  if (self->trace != NULL &&
+      (allocation->width != self->trace_width || allocation->height != self->trace_height))
+    {
+      self->trace_width = allocation->width;
+      self->trace_height = allocation->height;
+      gd_scroll_trace_add (self->trace, GD_SCROLL_TRACE_ALLOCATION,
+                           allocation->width, allocation->height, 0);
+    }
+
+  if (is_widgetless (self) && allocation->width != self->row_width)
+    remeasure_rows (self, allocation->width);
+
+  if (self->columns->len > 0 && self->columns_width != allocation->width &&
+      negotiate_columns (self, allocation->width))
+    resize_column_rows (self);
+
+  /* Row heights usually depend on the width, start over with the rows
+   * in view, measured at the new one */
+  if (allocation->width != self->height_stats_width)
+    {
+      self->height_sum = 0;
+      self->height_count = 0;
+      self->height_stats_width = allocation->width;
+
+      Foreach_Row
+        sample_row_height (self, requested_row_height (self, row));
+      }}
+    }
+
+  ensure_visible_widgets (self);
+  schedule_prepare (self);
+
+  /* Newly bound rows might have widened a column */
+  if (self->columns->len > 0 && self->columns_width != allocation->width &&
+      negotiate_columns (self, allocation->width))
+    resize_column_rows (self);
+
+  if (is_widgetless (self))
+    {
+      /* Nothing to allocate, rows get drawn in snapshot() */
+      if (GD_VALIDATING ())
+        validate_allocation (self);
+    }
+  else if (self->widgets->len > 0)
+    {
+      GtkAllocation child_alloc;
+      int y;
+
+      /* Now actually allocate sizes to all the rows */
+      y = bin_y (self);
+
+      child_alloc.x = 0;
+      child_alloc.width = allocation->width;
+
+      Foreach_Row
+        int h;
+
+        gtk_widget_measure (row, GTK_ORIENTATION_VERTICAL, allocation->width,
+                            &h, NULL, NULL, NULL);
+        self->stats.measure_calls ++;
+        child_alloc.y = y;
+        child_alloc.height = h;
+        GD_NOTE (LAYOUT, g_message ("Allocation for row %u of %u: %d, %d, %d, %d",
+                                    i, self->widgets->len,
+                                    child_alloc.x,
+                                    child_alloc.y,
+                                    child_alloc.width,
+                                    child_alloc.height));
+        gtk_widget_size_allocate (row, &child_alloc, -1);
+
+        y += h;
+      }}
+      /* configure_adjustment is being called from ensure_visible_widgets already */
+
+      if (GD_VALIDATING ())
+        validate_allocation (self);
+    }
+
+  /* A wider row got bound. This only ever grows, so a parent relayout
+   * doesn't happen just because other rows scrolled into view. */
+  if (self->max_width_changed)
+    queue_width_resize (self);
+
+  self->stats.measure_calls_last_frame = self->stats.measure_calls - measure_calls_before;
+  self->stats.size_allocate_time += g_get_monotonic_time () - start_time;
+
+  GD_TRACE_END (LAYOUT, trace_begin, "size-allocate", "%d x %d", allocation->width, allocation->height);
+}
+
+static void
+__snapshot (GtkWidget   *widget,
+            GtkSnapshot *snapshot)
+{
+  GdModelListBox *self = GD_MODEL_LIST_BOX (widget);
+
+  gtk_snapshot_push_clip (snapshot,
+                          &GRAPHENE_RECT_INIT(
+                            0, 0,
+                            gtk_widget_get_width (widget),
+                            gtk_widget_get_height (widget)
+                          ));
+
+  if (is_widgetless (self))
+    {
+      int width = gtk_widget_get_width (widget);
+      int y = self->widgets->len > 0 ? bin_y (self) : 0;
+
+      Foreach_Row
+        RowData *row_data = (RowData *)row;
+        guint item_index = self->model_from + i;
+        GtkStateFlags state = gtk_widget_get_state_flags (widget);
+
+        if (gd_range_set_contains (self->selection, item_index))
+          state |= GTK_STATE_FLAG_SELECTED;
+        if (item_index == self->active_index)
+          state |= GTK_STATE_FLAG_ACTIVE;
+
+        gtk_snapshot_offset (snapshot, 0, y);
+        self->snapshot_func (row_data->item, item_index, snapshot,
+                             width, row_data->height, state,
+                             self->snapshot_func_data);
+        gtk_snapshot_offset (snapshot, 0, -y);
+
+        y += row_data->height;
+      }}
+    }
+  else
+    {
+      Foreach_Row
+        gtk_widget_snapshot_child (widget,
+                                   row,
+                                   snapshot);
+      }}
+    }
+
+  gtk_snapshot_pop (snapshot);
+}
+
+static GtkWidget *
+__pick (GtkWidget *widget,
+        double     x,
+        double     y)
+{
+  if (x >= 0 && x <= gtk_widget_get_width (widget) &&
+      y >= 0 && y <= gtk_widget_get_height(widget))
+    {
+      return GTK_WIDGET_CLASS (gd_model_list_box_parent_class)->pick (widget, x, y);
+    }
+  else
+    {
+      if (gtk_widget_contains (widget, x, y))
+        return widget;
+      else
+        return NULL;
+    }
+}
+
+static void
+__measure (GtkWidget      *widget,
+           GtkOrientation  orientation,
+           int             for_size,
+           int            *minimum,
+           int            *natural,
+           int            *minimum_baseline,
+           int            *natural_baseline)
+{
+  GdModelListBox *self = GD_MODEL_LIST_BOX (widget);
+
+  if (orientation == GTK_ORIENTATION_HORIZONTAL && self->declared_width >= 0)
+    {
+      *minimum = self->declared_width;
+      *natural = self->declared_width;
+    }
+  else if (orientation == GTK_ORIENTATION_HORIZONTAL && self->columns->len > 0)
+    {
+      guint i;
+
+      /* Rows are as wide as the columns, no need to ask them */
+      *minimum = 0;
+      for (i = 0; i < self->columns->len; i ++)
+        *minimum += column_base_width (&g_array_index (self->columns, Column, i));
+
+      *natural = *minimum;
+    }
+  else if (orientation == GTK_ORIENTATION_HORIZONTAL && !is_widgetless (self))
+    {
+      /* Updated whenever a row gets bound */
+      *minimum = self->max_min_width;
+      *natural = self->max_nat_width;
+    }
+  else /* VERTICAL, or widgetless rows which take whatever width they get */
+    {
+      *minimum = 0;
+      *natural = 0;
+    }
+}
+/* }}} */
+
+static void
+destroy_row (GdModelListBox *self,
+             gpointer        row)
+{
+  if (is_widgetless (self))
+    {
+      RowData *row_data = row;
+
+      g_clear_object (&row_data->item);
+      g_slice_free (RowData, row_data);
+    }
+  else
+    {
+      /* Pre-warmed widgets are never parented before they get used */
+      if (gtk_widget_get_parent (row) != NULL)
+        gtk_widget_unparent (row);
+      g_object_unref (row);
+    }
+}
+
+/* Unbinds all rows and empties the pool, for switching between
+ * widget and widgetless mode */
+static void
+clear_rows (GdModelListBox *self)
+{
+  int i;
+
+  for (i = self->widgets->len - 1; i >= 0; i --)
+    remove_child_by_index (self, i);
+
+  release_pool (self);
+  cancel_detach_pool (self);
+  for (i = 0; i < (int)self->pool->len; i ++)
+    destroy_row (self, g_ptr_array_index (self->pool, i));
+
+  g_ptr_array_set_size (self->pool, 0);
+  self->model_to = self->model_from;
+  self->active_row = NULL;
+  self->active_index = G_MAXUINT;
+}
+
+/* Used to size the pool before we know our height, about a screen */
+#define PREWARM_FALLBACK_HEIGHT 1080
+/* How long one idle iteration may spend creating widgets, in microseconds */
+#define PREWARM_BUDGET 2000
+
+static gboolean
+prewarm_idle_cb (gpointer user_data)
+{
+  GdModelListBox *self = user_data;
+  int height = gtk_widget_get_height (GTK_WIDGET (self));
+  guint target;
+  gint64 start_time;
+
+  if (height <= 0)
+    height = PREWARM_FALLBACK_HEIGHT;
+
+  /* Enough rows to fill the viewport, plus the ones partially visible at the edges */
+  target = height / MAX (self->expected_row_height, 1) + 2;
+
+  start_time = g_get_monotonic_time ();
+
+  while (self->pool->len + self->widgets->len < target)
+    {
+      GtkWidget *widget = self->create_func (self->create_func_data);
+
+      g_assert (GTK_IS_WIDGET (widget));
+
+      /* Not parented until it gets bound, so it doesn't cost anything
+       * in style or layout updates before that. */
+      g_object_ref_sink (widget);
+      g_ptr_array_add (self->pool, widget);
+      self->stats.widgets_created ++;
+
+      if (g_get_monotonic_time () - start_time > PREWARM_BUDGET)
+        return G_SOURCE_CONTINUE;
+    }
+
+  GD_NOTE (LAYOUT, g_message ("%s: Pool pre-warmed with %u widgets", G_STRFUNC, self->pool->len));
+  self->prewarm_id = 0;
+
+  return G_SOURCE_REMOVE;
+}
+
+static void
+clear_prewarm_func (GdModelListBox *self)
+{
+  if (self->prewarm_id != 0)
+    {
+      g_source_remove (self->prewarm_id);
+      self->prewarm_id = 0;
+    }
+
+  if (self->create_func_destroy != NULL)
+    self->create_func_destroy (self->create_func_data);
+
+  self->create_func = NULL;
+  self->create_func_data = NULL;
+  self->create_func_destroy = NULL;
+}
+
+/* GObject vfuncs {{{ */
+static void
+__set_property (GObject      *object,
+                guint         prop_id,
+                const GValue *value,
+                GParamSpec   *pspec)
+{
+  GdModelListBox *self = GD_MODEL_LIST_BOX (object);
+
+  switch (prop_id)
+    {
+      case PROP_HADJUSTMENT:
+        g_set_object (&self->hadjustment, g_value_get_object (value));
+        break;
+      case PROP_VADJUSTMENT:
+        if (self->vadjustment)
+          {
+            g_signal_handler_disconnect (self->vadjustment,
+                                         self->vadjustment_value_changed_id);
+          }
+        g_set_object (&self->vadjustment, g_value_get_object (value));
+        if (g_value_get_object (value))
+          {
+            self->last_value = gtk_adjustment_get_value (self->vadjustment);
+            self->list_value = (gint64) self->last_value;
+            self->list_upper = (gint64) gtk_adjustment_get_upper (self->vadjustment);
+            self->adjustment_scale = 1.0;
+            update_scroll_controller (self);
+            self->vadjustment_value_changed_id =
+              g_signal_connect (G_OBJECT (self->vadjustment), "value-changed",
+                                G_CALLBACK (value_changed_cb), object);
+          }
+        break;
+      case PROP_HSCROLL_POLICY:
+      case PROP_VSCROLL_POLICY:
+        break;
+    }
+}
+
+static void
+__get_property (GObject    *object,
+                guint       prop_id,
+                GValue     *value,
+                GParamSpec *pspec)
+{
+  GdModelListBox *self = GD_MODEL_LIST_BOX (object);
+
+  switch (prop_id)
+    {
+      case PROP_HADJUSTMENT:
+        g_value_set_object (value, self->hadjustment);
+        break;
+      case PROP_VADJUSTMENT:
+        g_value_set_object (value, self->vadjustment);
+        break;
+      case PROP_HSCROLL_POLICY:
+      case PROP_VSCROLL_POLICY:
+        break;
+    }
+}
+
+static void
+__finalize (GObject *obj)
+{
+  GdModelListBox *self = GD_MODEL_LIST_BOX (obj);
+  guint i;
+
+  GD_NOTE (LAYOUT, g_message ("%s: Pool: %u, widgets: %u", G_STRFUNC, self->pool->len, self->widgets->len));
+
+  for (i = 0; i < self->pool->len; i ++)
+    {
+      gpointer row = g_ptr_array_index (self->pool, i);
+
+      if (!is_widgetless (self) && affine_index (row) != 0)
+        unwatch_item (self, bound_item (self, row));
+      destroy_row (self, row);
+    }
+
+  for (i = 0; i < self->widgets->len; i ++)
+    {
+      unwatch_item (self, bound_item (self, g_ptr_array_index (self->widgets, i)));
+      destroy_row (self, g_ptr_array_index (self->widgets, i));
+    }
+
+  if (self->snapshot_func_destroy != NULL)
+    self->snapshot_func_destroy (self->snapshot_func_data);
+
+  clear_prewarm_func (self);
+  cancel_detach_pool (self);
+  cancel_width_resize (self);
+  clear_payloads (self);
+  g_clear_pointer (&self->prepare, prepare_funcs_unref);
+  g_hash_table_unref (self->payloads);
+
+  g_ptr_array_free (self->pool, TRUE);
+  g_ptr_array_free (self->teleport, TRUE);
+  g_ptr_array_free (self->widgets, TRUE);
+  gd_range_set_free (self->selection);
+  g_array_free (self->columns, TRUE);
+
+  g_clear_object (&self->hadjustment);
+  g_clear_object (&self->vadjustment);
+  g_clear_object (&self->model);
+  g_clear_pointer (&self->trace, gd_scroll_trace_free);
+
+  G_OBJECT_CLASS (gd_model_list_box_parent_class)->finalize (obj);
+}
+/* }}} */
+
+GtkWidget *
+gd_model_list_box_new (void)
+{
+  return GTK_WIDGET (g_object_new (GD_TYPE_MODEL_LIST_BOX, NULL));
+}
+
+static void
+set_model_internal (GdModelListBox *self,
+                    GListModel     *model)
+{
+  int i;
+
+  /* Items of the new model are not the ones pooled widgets still show */
+  for (i = self->widgets->len - 1; i >= 0; i --)
+    remove_child_by_index (self, i);
+  release_pool (self);
+  self->model_to = self->model_from;
+
+  if (self->model != NULL)
+    {
+      g_signal_handlers_disconnect_by_func (self->model,
+                                            G_CALLBACK (items_changed_cb), self);
+      g_object_unref (self->model);
+    }
+
+  self->model = model;
+  if (model != NULL)
+    {
+      g_signal_connect (G_OBJECT (model), "items-changed", G_CALLBACK (items_changed_cb), self);
+      g_object_ref (model);
+    }
+
+  /* Everything changed, start over at the top */
+  clear_payloads (self);
+  gd_range_set_clear (self->selection);
+  self->selection_anchor = G_MAXUINT;
+  self->model_from       = 0;
+  self->at_tail          = TRUE;
+  self->max_min_width    = 0;
+  self->max_nat_width    = 0;
+  self->height_sum       = 0;
+  self->height_count     = 0;
+  self->scroll_delta     = 0;
+  self->changes_pending  = TRUE;
+  self->changes_position = 0;
+  self->changes_removed  = self->widgets->len;
+  self->changes_added    = model != NULL ? g_list_model_get_n_items (model) : 0;
+
+  ensure_visible_widgets (self);
+
+  gtk_widget_queue_resize (GTK_WIDGET (self));
+}
+
+void
+gd_model_list_box_set_model (GdModelListBox           *self,
+                             GListModel               *model,
+                             GdModelListBoxFillFunc    fill_func,
+                             gpointer                  fill_data,
+                             GDestroyNotify            fill_destroy_notify,
+                             GdModelListBoxRemoveFunc  remove_func,
+                             gpointer                  remove_data,
+                             GDestroyNotify            remove_destroy_notify)
+{
+  g_return_if_fail (GD_IS_MODEL_LIST_BOX (self));
 
-            g_signal_emit (self, signals[SIGNAL_ROW_ACTIVATED], 0,
-                           row, item, item_index);
-          }
-        break;
-      }
+  if (is_widgetless (self))
+    {
+      clear_rows (self);
+
+      if (self->snapshot_func_destroy != NULL)
+        self->snapshot_func_destroy (self->snapshot_func_data);
+
+      self->measure_func = NULL;
+      self->snapshot_func = NULL;
+      self->snapshot_func_data = NULL;
+      self->snapshot_func_destroy = NULL;
+    }
+
+  self->fill_func = fill_func;
+  self->fill_func_data = fill_data;
+
+  self->remove_func = remove_func;
+  self->remove_func_data = remove_data;
+
+  set_model_internal (self, model);
+}
+
+/**
+ * gd_model_list_box_set_snapshot_model:
+ * @measure_func: Returns the height of an item's row for the given width
+ * @snapshot_func: Draws an item's row
+ *
+ * Like gd_model_list_box_set_model(), but instead of creating a widget for
+ * each visible row, rows are drawn directly by @snapshot_func. This avoids all
+ * the per-widget overhead of CSS nodes, measuring and allocating, for lists of
+ * simple rows.
+ *
+ * "row-activated" is emitted with a %NULL row widget in this mode,
+ * use gd_model_list_box_get_item_at_y() for any other hit-testing.
+ */
+void
+gd_model_list_box_set_snapshot_model (GdModelListBox             *self,
+                                      GListModel                 *model,
+                                      GdModelListBoxMeasureFunc   measure_func,
+                                      GdModelListBoxSnapshotFunc  snapshot_func,
+                                      gpointer                    user_data,
+                                      GDestroyNotify              destroy_notify)
+{
+  g_return_if_fail (GD_IS_MODEL_LIST_BOX (self));
+  g_return_if_fail (measure_func != NULL);
+  g_return_if_fail (snapshot_func != NULL);
+
+  /* The pool has widgets or row data for the old funcs in it */
+  clear_rows (self);
+  clear_prewarm_func (self);
+
+  if (self->snapshot_func_destroy != NULL)
+    self->snapshot_func_destroy (self->snapshot_func_data);
+
+  self->fill_func = NULL;
+  self->fill_func_data = NULL;
+  self->remove_func = NULL;
+  self->remove_func_data = NULL;
+
+  self->measure_func = measure_func;
+  self->snapshot_func = snapshot_func;
+  self->snapshot_func_data = user_data;
+  self->snapshot_func_destroy = destroy_notify;
+  self->row_width = gtk_widget_get_width (GTK_WIDGET (self));
+
+  set_model_internal (self, model);
+}
+
+GListModel *
+gd_model_list_box_get_model (GdModelListBox *self)
+{
+  return self->model;
+}
+
+/**
+ * gd_model_list_box_get_item_at_y:
+ * @y: A y coordinate relative to @self
+ *
+ * Returns: The index of the item whose row is at @y, or %G_MAXUINT
+ *   if there is none.
+ */
+guint
+gd_model_list_box_get_item_at_y (GdModelListBox *self,
+                                 double          y)
+{
+  int row_top;
+
+  g_return_val_if_fail (GD_IS_MODEL_LIST_BOX (self), G_MAXUINT);
+
+  if (self->vadjustment == NULL || self->widgets->len == 0)
+    return G_MAXUINT;
+
+  row_top = bin_y (self);
+
+  Foreach_Row
+    int height = requested_row_height (self, row);
+
+    if (y >= row_top && y < row_top + height)
+      return self->model_from + i;
+
+    row_top += height;
   }}
 
+  return G_MAXUINT;
+}
+
+/**
+ * gd_model_list_box_scroll_to_item:
+ *
+ * Scrolls so the item at @position is at the top, unless it's completely
+ * visible already. Like gd_model_list_box_set_scroll_state(), only the rows
+ * around @position get bound, no matter how far away it is.
+ */
+void
+gd_model_list_box_scroll_to_item (GdModelListBox *self,
+                                  guint           position)
+{
+  GdModelListBoxScrollState state;
+
+  g_return_if_fail (GD_IS_MODEL_LIST_BOX (self));
+  g_return_if_fail (self->model != NULL);
+  g_return_if_fail (position < g_list_model_get_n_items (self->model));
+
+  if (!self->changes_pending && !self->scroll_state_pending &&
+      position >= self->model_from && position < self->model_to)
+    {
+      guint index = position - self->model_from;
+      int row_top = bin_y (self);
+      guint i;
+
+      for (i = 0; i < index; i ++)
+        row_top += requested_row_height (self, g_ptr_array_index (self->widgets, i));
+
+      if (row_top >= 0 &&
+          row_top + requested_row_height (self, g_ptr_array_index (self->widgets, index)) <=
+          gtk_widget_get_height (GTK_WIDGET (self)))
+        return;
+    }
+
+  state.anchor_index   = position;
+  state.anchor_offset  = 0;
+  state.average_height = estimated_row_height (self);
+
+  gd_model_list_box_set_scroll_state (self, &state);
+}
+
+/**
+ * gd_model_list_box_get_stats:
+ * @stats: (out caller-allocates): Return location for the counters
+ *
+ * Copies the recycler and layout counters of @self into @stats.
+ * They are always collected and cheap enough to leave on in production,
+ * so this can be used to find out whether a slow list spends its time
+ * binding, measuring or creating new widgets.
+ */
+void
+gd_model_list_box_get_stats (GdModelListBox      *self,
+                             GdModelListBoxStats *stats)
+{
+  g_return_if_fail (GD_IS_MODEL_LIST_BOX (self));
+  g_return_if_fail (stats != NULL);
+
+  *stats = self->stats;
+}
+
+void
+gd_model_list_box_reset_stats (GdModelListBox *self)
+{
+  g_return_if_fail (GD_IS_MODEL_LIST_BOX (self));
+
+  self->stats = (GdModelListBoxStats) { 0 };
+}
+
+/**
+ * gd_model_list_box_set_selection_mode:
+ * @mode: The new selection mode
+ *
+ * Sets how items can be selected. %GD_SELECTION_MULTIPLE allows ctrl-click to
+ * toggle single items and shift-click to select ranges. Changing the mode
+ * unselects everything.
+ */
+void
+gd_model_list_box_set_selection_mode (GdModelListBox  *self,
+                                      GdSelectionMode  mode)
+{
+  g_return_if_fail (GD_IS_MODEL_LIST_BOX (self));
+
+  if (mode == self->selection_mode)
+    return;
+
+  gd_model_list_box_unselect_all (self);
+  self->selection_mode = mode;
+}
+
+GdSelectionMode
+gd_model_list_box_get_selection_mode (GdModelListBox *self)
+{
+  g_return_val_if_fail (GD_IS_MODEL_LIST_BOX (self), GD_SELECTION_NONE);
+
+  return self->selection_mode;
+}
+
+/**
+ * gd_model_list_box_get_selection:
+ *
+ * Returns: (transfer none): The selected positions. This is owned by @self and
+ *   changes whenever the selection or the model changes.
+ */
+GdRangeSet *
+gd_model_list_box_get_selection (GdModelListBox *self)
+{
+  g_return_val_if_fail (GD_IS_MODEL_LIST_BOX (self), NULL);
+
+  return self->selection;
+}
+
+gboolean
+gd_model_list_box_is_selected (GdModelListBox *self,
+                               guint           position)
+{
+  g_return_val_if_fail (GD_IS_MODEL_LIST_BOX (self), FALSE);
+
+  return gd_range_set_contains (self->selection, position);
+}
+
+void
+gd_model_list_box_select_item (GdModelListBox *self,
+                               guint           position,
+                               gboolean        unselect_rest)
+{
+  g_return_if_fail (GD_IS_MODEL_LIST_BOX (self));
+  g_return_if_fail (self->model != NULL);
+  g_return_if_fail (position < g_list_model_get_n_items (self->model));
+
+  if (self->selection_mode == GD_SELECTION_NONE)
+    return;
+
+  select_range_internal (self, position, 1,
+                         unselect_rest || self->selection_mode == GD_SELECTION_SINGLE);
+  self->selection_anchor = position;
+}
+
+void
+gd_model_list_box_unselect_item (GdModelListBox *self,
+                                 guint           position)
+{
+  gd_model_list_box_unselect_range (self, position, 1);
+}
+
+void
+gd_model_list_box_select_range (GdModelListBox *self,
+                                guint           position,
+                                guint           n_items,
+                                gboolean        unselect_rest)
+{
+  g_return_if_fail (GD_IS_MODEL_LIST_BOX (self));
+  g_return_if_fail (self->model != NULL);
+  g_return_if_fail (self->selection_mode == GD_SELECTION_MULTIPLE);
+  g_return_if_fail (position + n_items <= g_list_model_get_n_items (self->model));
+
+  select_range_internal (self, position, n_items, unselect_rest);
+}
+
+void
+gd_model_list_box_unselect_range (GdModelListBox *self,
+                                  guint           position,
+                                  guint           n_items)
+{
+  guint end = position + n_items;
+  guint n_ranges;
+  GArray *changed;
+  guint i;
+
+  g_return_if_fail (GD_IS_MODEL_LIST_BOX (self));
+
+  /* Only the parts of [position, end) that were selected actually change */
+  n_ranges = gd_range_set_get_n_ranges (self->selection);
+  changed = g_array_new (FALSE, FALSE, sizeof (guint));
+  for (i = 0; i < n_ranges; i ++)
+    {
+      guint start, n, changed_start, changed_end;
+
+      gd_range_set_get_range (self->selection, i, &start, &n);
+      if (start >= end)
+        break;
+
+      changed_start = MAX (start, position);
+      changed_end = MIN (start + n, end);
+      if (changed_start < changed_end)
+        {
+          g_array_append_val (changed, changed_start);
+          g_array_append_val (changed, changed_end);
+        }
+    }
+
+  if (changed->len > 0)
+    {
+      gd_range_set_remove (self->selection, position, n_items);
+      update_rows_selected (self);
+
+      for (i = 0; i < changed->len; i += 2)
+        g_signal_emit (self, signals[SIGNAL_SELECTION_CHANGED], 0,
+                       g_array_index (changed, guint, i),
+                       g_array_index (changed, guint, i + 1) - g_array_index (changed, guint, i));
+    }
+
+  g_array_free (changed, TRUE);
+}
+
+void
+gd_model_list_box_select_all (GdModelListBox *self)
+{
+  guint n_items;
+
+  g_return_if_fail (GD_IS_MODEL_LIST_BOX (self));
+  g_return_if_fail (self->selection_mode == GD_SELECTION_MULTIPLE);
+
+  if (self->model == NULL)
+    return;
+
+  n_items = g_list_model_get_n_items (self->model);
+  gd_range_set_clear (self->selection);
+  gd_range_set_add (self->selection, 0, n_items);
+  selection_changed (self, 0, n_items);
+}
+
+void
+gd_model_list_box_unselect_all (GdModelListBox *self)
+{
+  guint start, end;
+
+  g_return_if_fail (GD_IS_MODEL_LIST_BOX (self));
+
+  get_selection_bounds (self, &start, &end);
+  gd_range_set_clear (self->selection);
+
+  if (end > start)
+    selection_changed (self, start, end - start);
+}
+
+void
+gd_model_list_box_invert_selection (GdModelListBox *self)
+{
+  guint n_items;
+
+  g_return_if_fail (GD_IS_MODEL_LIST_BOX (self));
+  g_return_if_fail (self->selection_mode == GD_SELECTION_MULTIPLE);
+
+  if (self->model == NULL)
+    return;
+
+  n_items = g_list_model_get_n_items (self->model);
+  gd_range_set_invert (self->selection, n_items);
+  selection_changed (self, 0, n_items);
+}
+
+/**
+ * gd_model_list_box_set_declared_width:
+ * @width: The width to request, or -1 to unset
+ *
+ * Makes @self request @width instead of the widest row bound so far,
+ * which also saves measuring the width of every row that gets bound.
+ */
+void
+gd_model_list_box_set_declared_width (GdModelListBox *self,
+                                      int             width)
+{
+  g_return_if_fail (GD_IS_MODEL_LIST_BOX (self));
+
+  width = MAX (width, -1);
+  if (width == self->declared_width)
+    return;
+
+  self->declared_width = width;
+
+  /* The rows bound until now have not been measured. That includes pooled
+   * ones, they can come back without getting bound again. */
+  if (width < 0 && !is_widgetless (self))
+    {
+      guint p;
+
+      Foreach_Row
+        update_max_width (self, row);
+      }}
+
+      for (p = 0; p < self->pool->len; p ++)
+        update_max_width (self, g_ptr_array_index (self->pool, p));
+    }
+
+  gtk_widget_queue_resize (GTK_WIDGET (self));
+}
+
+int
+gd_model_list_box_get_declared_width (GdModelListBox *self)
+{
+  g_return_val_if_fail (GD_IS_MODEL_LIST_BOX (self), -1);
+
+  return self->declared_width;
+}
+
+/**
+ * gd_model_list_box_append_column:
+ * @width: Fixed width of the column, or -1 to make it as wide as the
+ *   widest natural width of its cells seen so far
+ * @expand: Whether the column gets a share of any extra width
+ *
+ * Adds a column to @self. Rows that are GdColumnBox widgets put their
+ * i-th cell into the i-th column. Column widths are worked out once per
+ * allocation and handed to all rows, instead of rows being measured
+ * against each other like with a GtkSizeGroup.
+ *
+ * Returns: The index of the new column
+ */
+guint
+gd_model_list_box_append_column (GdModelListBox *self,
+                                 int             width,
+                                 gboolean        expand)
+{
+  Column column;
+
+  g_return_val_if_fail (GD_IS_MODEL_LIST_BOX (self), 0);
+
+  column.declared_width = MAX (width, -1);
+  column.expand = expand;
+  column.measured_width = 0;
+  column.width = 0;
+  g_array_append_val (self->columns, column);
+
+  /* Existing rows haven't been measured for this one, including pooled ones
+   * that can come back without getting bound again */
+  if (!is_widgetless (self))
+    {
+      guint p;
+
+      Foreach_Row
+        measure_columns (self, row);
+      }}
+
+      for (p = 0; p < self->pool->len; p ++)
+        measure_columns (self, g_ptr_array_index (self->pool, p));
+    }
+
+  self->columns_width = -1;
+  gtk_widget_queue_resize (GTK_WIDGET (self));
+
+  return self->columns->len - 1;
+}
+
+guint
+gd_model_list_box_get_n_columns (GdModelListBox *self)
+{
+  g_return_val_if_fail (GD_IS_MODEL_LIST_BOX (self), 0);
+
+  return self->columns->len;
+}
+
+/**
+ * gd_model_list_box_get_column_width:
+ *
+ * Returns: The width rows should give their cell in @column
+ */
+int
+gd_model_list_box_get_column_width (GdModelListBox *self,
+                                    guint           column)
+{
+  g_return_val_if_fail (GD_IS_MODEL_LIST_BOX (self), 0);
+  g_return_val_if_fail (column < self->columns->len, 0);
+
+  /* Not negotiated yet, e.g. when measuring rows before the first allocation */
+  if (self->columns_width < 0)
+    return column_base_width (&g_array_index (self->columns, Column, column));
+
+  return g_array_index (self->columns, Column, column).width;
+}
+
+/**
+ * gd_model_list_box_invalidate_item:
+ *
+ * Tells @self that the item at @position changed, without it being replaced
+ * in the model. If it's visible, its row gets filled again, reusing the same
+ * widget, and everything else stays untouched.
+ */
+void
+gd_model_list_box_invalidate_item (GdModelListBox *self,
+                                   guint           position)
+{
+  g_return_if_fail (GD_IS_MODEL_LIST_BOX (self));
+
+  if (!is_widgetless (self))
+    {
+      guint i;
+
+      for (i = 0; i < self->pool->len; i ++)
+        if (affine_index (g_ptr_array_index (self->pool, i)) == position + 1)
+          release_widget (self, g_ptr_array_index (self->pool, i));
+    }
+
+  if (position < self->model_from || position >= self->model_to)
+    return;
+
+  /* Rows from changes_position on are out of date and get replaced anyway */
+  if (self->changes_pending && position >= self->changes_position)
+    return;
+
+  rebind_row (self, position - self->model_from);
+}
+
+/**
+ * gd_model_list_box_set_auto_invalidate:
+ *
+ * If @auto_invalidate is %TRUE, rows are refilled whenever their item
+ * emits GObject::notify, see gd_model_list_box_invalidate_item().
+ */
+void
+gd_model_list_box_set_auto_invalidate (GdModelListBox *self,
+                                       gboolean        auto_invalidate)
+{
+  g_return_if_fail (GD_IS_MODEL_LIST_BOX (self));
+
+  auto_invalidate = !!auto_invalidate;
+  if (auto_invalidate == self->auto_invalidate)
+    return;
+
+  /* Pooled widgets are either watched or would have missed notifications */
+  release_pool (self);
 
-  if (self->active_row != NULL)
+  if (!auto_invalidate)
     {
-      gtk_widget_unset_state_flags (self->active_row, GTK_STATE_FLAG_ACTIVE);
+      Foreach_Row
+        unwatch_item (self, bound_item (self, row));
+      }}
     }
 
-  self->active_row = NULL;
+  self->auto_invalidate = auto_invalidate;
+
+  if (auto_invalidate)
+    {
+      Foreach_Row
+        watch_item (self, bound_item (self, row));
+      }}
+    }
 }
 
-/* GtkWidget vfuncs {{{ */
-static void
-__size_allocate (GtkWidget           *widget,
-                 const GtkAllocation *allocation,
-                 int                  baseline)
+gboolean
+gd_model_list_box_get_auto_invalidate (GdModelListBox *self)
 {
-  GdModelListBox *self = GD_MODEL_LIST_BOX (widget);
-  static int k =0;
-
-
-  int this_k = k++;
-  g_debug (__FUNCTION__);
-  g_debug ("Start %s(%d)", __FUNCTION__, this_k);
-  ensure_visible_widgets (self);
+  g_return_val_if_fail (GD_IS_MODEL_LIST_BOX (self), FALSE);
 
-  if (self->widgets->len > 0)
-    {
-      GtkAllocation child_alloc;
-      int y;
+  return self->auto_invalidate;
+}
 
-      /* Now actually allocate sizes to all the rows */
-      y = bin_y (self);
+/**
+ * gd_model_list_box_set_prepare_func:
+ * @prepare_func: (nullable): Turns an item into a payload, on a worker thread
+ * @payload_destroy: (nullable): Frees a payload
+ *
+ * Splits binding a row in two: @prepare_func does the expensive part that
+ * doesn't need widgets, like formatting strings or parsing markup, and the
+ * fill_func only applies the result, which it gets via
+ * gd_model_list_box_get_payload().
+ *
+ * @prepare_func runs on worker threads, for the items about a screen above
+ * and below the visible ones, so it has to be thread safe and must not
+ * change @item. If a payload isn't ready when its row gets bound, it is
+ * prepared on the main thread instead.
+ */
+void
+gd_model_list_box_set_prepare_func (GdModelListBox            *self,
+                                    GdModelListBoxPrepareFunc  prepare_func,
+                                    GDestroyNotify             payload_destroy,
+                                    gpointer                   user_data,
+                                    GDestroyNotify             destroy_notify)
+{
+  g_return_if_fail (GD_IS_MODEL_LIST_BOX (self));
 
-      child_alloc.x = 0;
-      child_alloc.width = allocation->width;
+  clear_payloads (self);
+  g_clear_pointer (&self->prepare, prepare_funcs_unref);
 
-      Foreach_Row
-        int h;
+  if (prepare_func != NULL)
+    {
+      self->prepare = g_slice_new (PrepareFuncs);
+      self->prepare->ref_count = 1;
+      self->prepare->func = prepare_func;
+      self->prepare->payload_destroy = payload_destroy;
+      self->prepare->data = user_data;
+      self->prepare->data_destroy = destroy_notify;
+    }
 
-        gtk_widget_measure (row, GTK_ORIENTATION_VERTICAL, allocation->width,
-                            &h, NULL, NULL, NULL);
-        child_alloc.y = y;
-        child_alloc.height = h;
-        g_debug ("Allocation for row %u of %u: %d, %d, %d, %d",
-                   i, self->widgets->len,
-                   child_alloc.x,
-                   child_alloc.y,
-                   child_alloc.width,
-                   child_alloc.height);
-        gtk_widget_size_allocate (row, &child_alloc, -1);
+  /* Visible rows need to be bound again, now with (or without) payloads */
+  if (self->model != NULL)
+    {
+      guint i;
 
-        y += h;
-      }}
-      /* configure_adjustment is being called from ensure_visible_widgets already */
+      for (i = self->model_from; i < self->model_to; i ++)
+        gd_model_list_box_invalidate_item (self, i);
     }
 
-  g_debug ("End %s(%d)", __FUNCTION__, this_k);
+  gtk_widget_queue_allocate (GTK_WIDGET (self));
 }
 
-static void
-__snapshot (GtkWidget   *widget,
-            GtkSnapshot *snapshot)
+/**
+ * gd_model_list_box_get_payload:
+ *
+ * To be called from the fill_func (or the measure and snapshot functions in
+ * widgetless mode).
+ *
+ * Returns: (transfer none): The payload for the item at @item_index, or %NULL
+ *   if there is none.
+ */
+gpointer
+gd_model_list_box_get_payload (GdModelListBox *self,
+                               guint           item_index)
 {
-  GdModelListBox *self = GD_MODEL_LIST_BOX (widget);
+  gpointer payload;
 
-  gtk_snapshot_push_clip (snapshot,
-                          &GRAPHENE_RECT_INIT(
-                            0, 0,
-                            gtk_widget_get_width (widget),
-                            gtk_widget_get_height (widget)
-                          ));
+  g_return_val_if_fail (GD_IS_MODEL_LIST_BOX (self), NULL);
 
-  Foreach_Row
-    gtk_widget_snapshot_child (widget,
-                               row,
-                               snapshot);
-  }}
+  if (self->prepare == NULL)
+    return NULL;
 
-  gtk_snapshot_pop (snapshot);
+  payload = g_hash_table_lookup (self->payloads, GUINT_TO_POINTER (item_index));
+  if (payload == PAYLOAD_PENDING)
+    return NULL;
+
+  return payload;
 }
 
-static GtkWidget *
-__pick (GtkWidget *widget,
-        double     x,
-        double     y)
+/**
+ * gd_model_list_box_set_prewarm_func:
+ * @create_func: (nullable): Creates an empty row widget, like the fill_func
+ *   does when it gets a %NULL widget
+ * @expected_row_height: Roughly how high a row is going to be
+ *
+ * Fills the pool with row widgets from @create_func in idle time, so the
+ * first layout only needs to fill them instead of creating them from scratch.
+ * Enough widgets for a viewport full of @expected_row_height high rows are
+ * created, or a screen full if @self doesn't have a size yet.
+ *
+ * Pre-warmed widgets are not added to @self until they are first used.
+ */
+void
+gd_model_list_box_set_prewarm_func (GdModelListBox           *self,
+                                    GdModelListBoxCreateFunc  create_func,
+                                    int                       expected_row_height,
+                                    gpointer                  user_data,
+                                    GDestroyNotify            destroy_notify)
 {
-  if (x >= 0 && x <= gtk_widget_get_width (widget) &&
-      y >= 0 && y <= gtk_widget_get_height(widget))
-    {
-      return GTK_WIDGET_CLASS (gd_model_list_box_parent_class)->pick (widget, x, y);
-    }
-  else
-    {
-      if (gtk_widget_contains (widget, x, y))
-        return widget;
-      else
-        return NULL;
-    }
+  g_return_if_fail (GD_IS_MODEL_LIST_BOX (self));
+  g_return_if_fail (!is_widgetless (self));
+  g_return_if_fail (create_func == NULL || expected_row_height > 0);
+
+  clear_prewarm_func (self);
+
+  if (create_func == NULL)
+    return;
+
+  self->create_func = create_func;
+  self->create_func_data = user_data;
+  self->create_func_destroy = destroy_notify;
+  self->expected_row_height = expected_row_height;
+
+  self->prewarm_id = g_idle_add_full (G_PRIORITY_DEFAULT_IDLE, prewarm_idle_cb, self, NULL);
 }
 
-static void
-__measure (GtkWidget      *widget,
-           GtkOrientation  orientation,
-           int             for_size,
-           int            *minimum,
-           int            *natural,
-           int            *minimum_baseline,
-           int            *natural_baseline)
+/**
+ * gd_model_list_box_set_detach_pool:
+ *
+ * If @detach_pool is %TRUE, widgets that go into the pool are unparented
+ * after the frame in which they were scrolled out of view. They then don't
+ * take part in style changes and layout anymore, at the cost of having to
+ * compute their style again when they get reused.
+ *
+ * This is worth it for large pools of complex rows, or if rows use
+ * styles that change a lot, e.g. on hover.
+ */
+void
+gd_model_list_box_set_detach_pool (GdModelListBox *self,
+                                   gboolean        detach_pool)
 {
-  GdModelListBox *self = GD_MODEL_LIST_BOX (widget);
+  g_return_if_fail (GD_IS_MODEL_LIST_BOX (self));
 
-  if (orientation == GTK_ORIENTATION_HORIZONTAL)
-    {
-      int min_width = 0;
-      int nat_width = 0;
+  detach_pool = !!detach_pool;
+  if (detach_pool == self->detach_pool)
+    return;
 
-      Foreach_Row
-        int m, n;
-        gtk_widget_measure (row, GTK_ORIENTATION_HORIZONTAL, -1,
-                            &m, &n, NULL, NULL);
-        min_width = MAX (min_width, m);
-        nat_width = MAX (nat_width, n);
-      }}
+  self->detach_pool = detach_pool;
 
-      *minimum = min_width;
-      *natural = nat_width;
-    }
-  else /* VERTICAL */
-    {
-      *minimum = 0;
-      *natural = 0;
-    }
+  /* Already detached widgets get parented again when they are reused */
+  if (!detach_pool)
+    cancel_detach_pool (self);
+  else if (!is_widgetless (self) && self->pool->len > 0)
+    queue_detach_pool (self);
 }
-/* }}} */
 
-/* GObject vfuncs {{{ */
-static void
-__set_property (GObject      *object,
-                guint         prop_id,
-                const GValue *value,
-                GParamSpec   *pspec)
+gboolean
+gd_model_list_box_get_detach_pool (GdModelListBox *self)
 {
-  GdModelListBox *self = GD_MODEL_LIST_BOX (object);
+  g_return_val_if_fail (GD_IS_MODEL_LIST_BOX (self), FALSE);
 
-  switch (prop_id)
-    {
-      case PROP_HADJUSTMENT:
-        g_set_object (&self->hadjustment, g_value_get_object (value));
-        break;
-      case PROP_VADJUSTMENT:
-        if (self->vadjustment)
-          {
-            g_signal_handler_disconnect (self->vadjustment,
-                                         self->vadjustment_value_changed_id);
-          }
-        g_set_object (&self->vadjustment, g_value_get_object (value));
-        if (g_value_get_object (value))
-          {
-            self->last_value = gtk_adjustment_get_value (self->vadjustment);
-            self->vadjustment_value_changed_id =
-              g_signal_connect (G_OBJECT (self->vadjustment), "value-changed",
-                                G_CALLBACK (value_changed_cb), object);
-          }
-        break;
-      case PROP_HSCROLL_POLICY:
-      case PROP_VSCROLL_POLICY:
-        break;
-    }
+  return self->detach_pool;
 }
 
-static void
-__get_property (GObject    *object,
-                guint       prop_id,
-                GValue     *value,
-                GParamSpec *pspec)
+/**
+ * gd_model_list_box_get_scroll_state:
+ *
+ * Saves where @self is currently scrolled to, so it can be restored
+ * with gd_model_list_box_set_scroll_state(), e.g. after a restart.
+ */
+void
+gd_model_list_box_get_scroll_state (GdModelListBox            *self,
+                                    GdModelListBoxScrollState *state)
 {
-  GdModelListBox *self = GD_MODEL_LIST_BOX (object);
+  g_return_if_fail (GD_IS_MODEL_LIST_BOX (self));
+  g_return_if_fail (state != NULL);
 
-  switch (prop_id)
+  if (self->scroll_state_pending)
     {
-      case PROP_HADJUSTMENT:
-        g_value_set_object (value, self->hadjustment);
-        break;
-      case PROP_VADJUSTMENT:
-        g_value_set_object (value, self->vadjustment);
-        break;
-      case PROP_HSCROLL_POLICY:
-      case PROP_VSCROLL_POLICY:
-        break;
+      *state = self->scroll_state;
+      return;
     }
+
+  state->anchor_index   = self->model_from;
+  state->anchor_offset  = self->widgets->len > 0 ? MAX (0, - bin_y (self)) : 0;
+  state->average_height = estimated_row_height (self);
 }
 
-static void
-__finalize (GObject *obj)
+/**
+ * gd_model_list_box_set_scroll_state:
+ *
+ * Scrolls to a state saved with gd_model_list_box_get_scroll_state().
+ * This is applied in the next layout, so it should be called right
+ * after setting the model, before @self is shown. Only the rows at the
+ * saved position get bound then.
+ */
+void
+gd_model_list_box_set_scroll_state (GdModelListBox                  *self,
+                                    const GdModelListBoxScrollState *state)
 {
-  GdModelListBox *self = GD_MODEL_LIST_BOX (obj);
-  guint i;
+  g_return_if_fail (GD_IS_MODEL_LIST_BOX (self));
+  g_return_if_fail (state != NULL);
 
-  g_debug ("LISTBOX FINALIZE. Pool: %u, widgets: %u", self->pool->len, self->widgets->len);
+  self->scroll_state = *state;
+  self->scroll_state_pending = TRUE;
+  self->at_tail = FALSE;
 
-  for (i = 0; i < self->pool->len; i ++)
-    {
-      gtk_widget_unparent (g_ptr_array_index (self->pool, i));
-      g_object_unref (g_ptr_array_index (self->pool, i));
-    }
+  gtk_widget_queue_allocate (GTK_WIDGET (self));
+}
 
-  for (i = 0; i < self->widgets->len; i ++)
-    {
-      gtk_widget_unparent (g_ptr_array_index (self->widgets, i));
-      g_object_unref (g_ptr_array_index (self->widgets, i));
-    }
+/**
+ * gd_model_list_box_set_follow_tail:
+ *
+ * If @follow_tail is %TRUE, @self stays scrolled to the end of the list when
+ * items get appended while it's there, e.g. for log views. Scrolling up
+ * stops following the end, scrolling back down continues.
+ */
+void
+gd_model_list_box_set_follow_tail (GdModelListBox *self,
+                                   gboolean        follow_tail)
+{
+  g_return_if_fail (GD_IS_MODEL_LIST_BOX (self));
 
-  g_ptr_array_free (self->pool, TRUE);
-  g_ptr_array_free (self->widgets, TRUE);
+  follow_tail = !!follow_tail;
+  if (follow_tail == self->follow_tail)
+    return;
 
-  g_clear_object (&self->hadjustment);
-  g_clear_object (&self->vadjustment);
-  g_clear_object (&self->model);
+  self->follow_tail = follow_tail;
+  if (self->vadjustment != NULL)
+    self->at_tail = is_at_tail (self);
 
-  G_OBJECT_CLASS (gd_model_list_box_parent_class)->finalize (obj);
+  gtk_widget_queue_allocate (GTK_WIDGET (self));
 }
-/* }}} */
 
-GtkWidget *
-gd_model_list_box_new (void)
+gboolean
+gd_model_list_box_get_follow_tail (GdModelListBox *self)
 {
-  return GTK_WIDGET (g_object_new (GD_TYPE_MODEL_LIST_BOX, NULL));
+  g_return_val_if_fail (GD_IS_MODEL_LIST_BOX (self), FALSE);
+
+  return self->follow_tail;
 }
 
+/**
+ * gd_model_list_box_start_recording:
+ *
+ * Starts recording a scroll trace of @self, i.e. all vadjustment value changes,
+ * allocation sizes and model changes, see #GdScrollTrace.
+ * The recording starts with the current state of @self.
+ */
 void
-gd_model_list_box_set_model (GdModelListBox           *self,
-                             GListModel               *model,
-                             GdModelListBoxFillFunc    fill_func,
-                             gpointer                  fill_data,
-                             GDestroyNotify            fill_destroy_notify,
-                             GdModelListBoxRemoveFunc  remove_func,
-                             gpointer                  remove_data,
-                             GDestroyNotify            remove_destroy_notify)
+gd_model_list_box_start_recording (GdModelListBox *self)
 {
   g_return_if_fail (GD_IS_MODEL_LIST_BOX (self));
 
-  if (self->model != NULL)
-    {
-      g_signal_handlers_disconnect_by_func (self->model,
-                                            G_CALLBACK (items_changed_cb), self);
-      g_object_unref (self->model);
-    }
-
-  self->model = model;
-  if (model != NULL)
-    {
-      g_signal_connect (G_OBJECT (model), "items-changed", G_CALLBACK (items_changed_cb), self);
-      g_object_ref (model);
-    }
+  g_clear_pointer (&self->trace, gd_scroll_trace_free);
 
-  self->fill_func = fill_func;
-  self->fill_func_data = fill_data;
+  self->trace = gd_scroll_trace_new (self->model != NULL ? g_list_model_get_n_items (self->model) : 0);
+  self->trace_width = gtk_widget_get_width (GTK_WIDGET (self));
+  self->trace_height = gtk_widget_get_height (GTK_WIDGET (self));
 
-  self->remove_func = remove_func;
-  self->remove_func_data = remove_data;
+  gd_scroll_trace_add (self->trace, GD_SCROLL_TRACE_ALLOCATION,
+                       self->trace_width, self->trace_height, 0);
+  if (self->vadjustment != NULL)
+    gd_scroll_trace_add (self->trace, GD_SCROLL_TRACE_VALUE,
+                         gtk_adjustment_get_value (self->vadjustment), 0, 0);
+}
 
-  ensure_visible_widgets (self);
+/**
+ * gd_model_list_box_stop_recording:
+ *
+ * Returns: (transfer full) (nullable): The trace recorded since the last
+ *   gd_model_list_box_start_recording() call. Free with gd_scroll_trace_free().
+ */
+GdScrollTrace *
+gd_model_list_box_stop_recording (GdModelListBox *self)
+{
+  g_return_val_if_fail (GD_IS_MODEL_LIST_BOX (self), NULL);
 
-  gtk_widget_queue_resize (GTK_WIDGET (self));
+  return g_steal_pointer (&self->trace);
 }
 
-GListModel *
-gd_model_list_box_get_model (GdModelListBox *self)
+/* With and without Control, like the GtkScrolledWindow ones */
+static void
+add_scroll_binding (GtkBindingSet *binding_set,
+                    guint          keyval,
+                    guint          keypad_keyval,
+                    GtkScrollType  scroll)
 {
-  return self->model;
+  gtk_binding_entry_add_signal (binding_set, keyval, 0, "scroll-by", 1, GTK_TYPE_SCROLL_TYPE, scroll);
+  gtk_binding_entry_add_signal (binding_set, keypad_keyval, 0, "scroll-by", 1, GTK_TYPE_SCROLL_TYPE, scroll);
+  gtk_binding_entry_add_signal (binding_set, keyval, GDK_CONTROL_MASK, "scroll-by", 1, GTK_TYPE_SCROLL_TYPE, scroll);
+  gtk_binding_entry_add_signal (binding_set, keypad_keyval, GDK_CONTROL_MASK, "scroll-by", 1, GTK_TYPE_SCROLL_TYPE, scroll);
 }
 
 static void
@@ -945,6 +3508,7 @@ gd_model_list_box_class_init (GdModelListBoxClass *class)
 {
   GObjectClass      *object_class = G_OBJECT_CLASS (class);
   GtkWidgetClass    *widget_class = GTK_WIDGET_CLASS (class);
+  GtkBindingSet     *binding_set;
 
   object_class->set_property = __set_property;
   object_class->get_property = __get_property;
@@ -968,7 +3532,42 @@ gd_model_list_box_class_init (GdModelListBoxClass *class)
                                                 NULL, G_TYPE_NONE,
                                                 3, GTK_TYPE_WIDGET, G_TYPE_POINTER, G_TYPE_UINT);
 
+  signals[SIGNAL_SELECTION_CHANGED] = g_signal_new ("selection-changed",
+                                                    G_OBJECT_CLASS_TYPE (object_class),
+                                                    G_SIGNAL_RUN_FIRST,
+                                                    0,
+                                                    NULL, NULL,
+                                                    NULL, G_TYPE_NONE,
+                                                    2, G_TYPE_UINT, G_TYPE_UINT);
+
+  /**
+   * GdModelListBox::scroll-by:
+   * @scroll: a step or page up or down
+   *
+   * Keybinding signal. Only handled while the list is taller than the
+   * vadjustment can represent, when the GtkScrolledWindow bindings would
+   * scroll by more than a step or page.
+   */
+  signals[SIGNAL_SCROLL_BY] = g_signal_new_class_handler ("scroll-by",
+                                                          G_OBJECT_CLASS_TYPE (object_class),
+                                                          G_SIGNAL_RUN_LAST | G_SIGNAL_ACTION,
+                                                          G_CALLBACK (__scroll_by),
+                                                          g_signal_accumulator_true_handled, NULL,
+                                                          NULL, G_TYPE_BOOLEAN,
+                                                          1, GTK_TYPE_SCROLL_TYPE);
+
+  binding_set = gtk_binding_set_by_class (class);
+  add_scroll_binding (binding_set, GDK_KEY_Up,        GDK_KEY_KP_Up,        GTK_SCROLL_STEP_UP);
+  add_scroll_binding (binding_set, GDK_KEY_Down,      GDK_KEY_KP_Down,      GTK_SCROLL_STEP_DOWN);
+  add_scroll_binding (binding_set, GDK_KEY_Page_Up,   GDK_KEY_KP_Page_Up,   GTK_SCROLL_PAGE_UP);
+  add_scroll_binding (binding_set, GDK_KEY_Page_Down, GDK_KEY_KP_Page_Down, GTK_SCROLL_PAGE_DOWN);
+
   gtk_widget_class_set_css_name (widget_class, "list");
+
+  bound_item_quark = g_quark_from_static_string ("gd-model-list-box-bound-item");
+  bound_index_quark = g_quark_from_static_string ("gd-model-list-box-bound-index");
+
+  gd_debug_init ();
 }
 
 static void
@@ -980,12 +3579,27 @@ gd_model_list_box_init (GdModelListBox *self)
 
   self->widgets    = g_ptr_array_sized_new (20);
   self->pool       = g_ptr_array_sized_new (10);
+  self->teleport   = g_ptr_array_sized_new (20);
   self->model_from = 0;
   self->model_to   = 0;
   self->bin_y_diff = 0;
+  self->adjustment_scale = 1.0;
+  self->selection  = gd_range_set_new ();
+  self->selection_anchor = G_MAXUINT;
+  self->at_tail    = TRUE;
+  self->active_index = G_MAXUINT;
+  self->columns    = g_array_new (FALSE, FALSE, sizeof (Column));
+  self->columns_width = -1;
+  self->declared_width = -1;
+  self->payloads   = g_hash_table_new (NULL, NULL);
 
   press_gesture = gtk_gesture_multi_press_new ();
   g_signal_connect (press_gesture, "pressed", G_CALLBACK (pressed_cb), self);
   g_signal_connect (press_gesture, "released", G_CALLBACK (released_cb), self);
   gtk_widget_add_controller (GTK_WIDGET (self), GTK_EVENT_CONTROLLER (press_gesture));
+
+  self->scroll_controller = gtk_event_controller_scroll_new (GTK_EVENT_CONTROLLER_SCROLL_VERTICAL);
+  g_signal_connect (self->scroll_controller, "scroll", G_CALLBACK (scroll_cb), self);
+  gtk_widget_add_controller (GTK_WIDGET (self), self->scroll_controller);
+  update_scroll_controller (self);
 }
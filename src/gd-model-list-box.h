@@ -2,6 +2,8 @@
 #define _GD_MODEL_LIST_BOX_H_
 
 #include <gtk/gtk.h>
+#include "gd-scroll-trace.h"
+#include "gd-range-set.h"
 
 typedef GtkWidget * (*GdModelListBoxFillFunc)   (gpointer  item,
                                                  GtkWidget *widget,
@@ -11,6 +13,70 @@ typedef void        (*GdModelListBoxRemoveFunc) (GtkWidget *widget,
                                                  gpointer   item,
                                                  gpointer   user_data);
 
+/* Creates an empty row widget, see gd_model_list_box_set_prewarm_func() */
+typedef GtkWidget * (*GdModelListBoxCreateFunc) (gpointer user_data);
+
+/* Turns @item into an immutable payload for the fill_func. Called on worker
+ * threads, see gd_model_list_box_set_prepare_func() */
+typedef gpointer    (*GdModelListBoxPrepareFunc) (gpointer  item,
+                                                  guint     item_index,
+                                                  gpointer  user_data);
+
+/* Widgetless mode, see gd_model_list_box_set_snapshot_model() */
+typedef int         (*GdModelListBoxMeasureFunc)  (gpointer       item,
+                                                   guint          item_index,
+                                                   int            width,
+                                                   gpointer       user_data);
+typedef void        (*GdModelListBoxSnapshotFunc) (gpointer       item,
+                                                   guint          item_index,
+                                                   GtkSnapshot   *snapshot,
+                                                   int            width,
+                                                   int            height,
+                                                   GtkStateFlags  state,
+                                                   gpointer       user_data);
+
+typedef enum {
+  GD_SELECTION_NONE,
+  GD_SELECTION_SINGLE,
+  GD_SELECTION_MULTIPLE,
+} GdSelectionMode;
+
+/* Counters since creation or the last gd_model_list_box_reset_stats() call.
+ * Times are in microseconds. */
+typedef struct
+{
+  guint64 fill_calls;
+  guint64 pool_hits;
+  guint64 pool_misses;
+  /* Pool hits that got back the widget still showing the same item,
+   * which skips the fill_func. Needs a model that doesn't create a new
+   * item object every time it's asked for one. */
+  guint64 affine_hits;
+  guint64 widgets_created;
+  guint64 measure_calls;
+  guint   measure_calls_last_frame;
+  guint64 out_of_sight_resets;
+  /* Rows that were bound to a new item in place after an out-of-sight jump */
+  guint64 rows_teleported;
+  /* Payloads that were prepared in time, or that had to be prepared in bind */
+  guint64 prepare_hits;
+  guint64 prepare_misses;
+  guint64 rows_realized;
+  gint64  ensure_visible_time;
+  gint64  size_allocate_time;
+} GdModelListBoxStats;
+
+/* Where a list is scrolled to, in terms of items rather than pixels */
+typedef struct
+{
+  /* The topmost (partially) visible item */
+  guint anchor_index;
+  /* How much of it is scrolled out at the top, in pixels */
+  int   anchor_offset;
+  /* Average row height, for estimating the list height. 0 if unknown */
+  int   average_height;
+} GdModelListBoxScrollState;
+
 struct _GdModelListBox
 {
   GtkWidget parent_instance;
@@ -21,19 +87,108 @@ struct _GdModelListBox
 
   GPtrArray *widgets;
   GPtrArray *pool;
+  /* Rows waiting to be re-targeted during an out-of-sight jump */
+  GPtrArray *teleport;
+  /* Unparent pooled widgets, see gd_model_list_box_set_detach_pool() */
+  gboolean detach_pool;
+  guint detach_id;
   GdModelListBoxRemoveFunc remove_func;
   GdModelListBoxFillFunc fill_func;
   gpointer fill_func_data;
   gpointer remove_func_data;
   GListModel *model;
 
+  /* If set, rows are drawn by these instead of being widgets. self->widgets
+   * and self->pool then contain row data, not widgets. */
+  GdModelListBoxMeasureFunc measure_func;
+  GdModelListBoxSnapshotFunc snapshot_func;
+  gpointer snapshot_func_data;
+  GDestroyNotify snapshot_func_destroy;
+  /* The width widgetless rows were measured for */
+  int row_width;
+  guint active_index;
+
+  /* Pool pre-warming, see gd_model_list_box_set_prewarm_func() */
+  GdModelListBoxCreateFunc create_func;
+  gpointer create_func_data;
+  GDestroyNotify create_func_destroy;
+  int expected_row_height;
+  guint prewarm_id;
+
+  /* Worker thread stage before binding, see gd_model_list_box_set_prepare_func() */
+  struct _GdPrepareFuncs *prepare;
+  /* Item index → payload, for the rows around the visible ones */
+  GHashTable *payloads;
+  guint prepare_generation;
+  guint prepare_jobs;
+
+  /* Rebind rows when their item emits notify */
+  gboolean auto_invalidate;
+  gboolean rebinding;
+
+  /* Widest min/natural width of all rows bound since the model was set */
+  int max_min_width;
+  int max_nat_width;
+  gboolean max_width_changed;
+  /* Resizes once the layout is done, if the widest row changed */
+  guint resize_id;
+
+  /* Heights of all rows bound since the model or width changed, for
+   * estimating the height of the rows that aren't */
+  guint64 height_sum;
+  guint64 height_count;
+  int height_stats_width;
+
+  /* -1 if unset, see gd_model_list_box_set_declared_width() */
+  int declared_width;
+
+  /* Columns, see gd_model_list_box_append_column() */
+  GArray *columns;
+  /* The width columns were negotiated for, -1 if they need to be again */
+  int columns_width;
+
   guint model_from;
   guint model_to;
-  double bin_y_diff;
+  gint64 bin_y_diff;
+  /* How far the user scrolled since the last layout, see DRIFT_CORRECTION */
+  gint64 scroll_delta;
+
+  /* All items-changed emissions between two layouts, merged into one splice */
+  gboolean changes_pending;
+  guint changes_position;
+  guint changes_removed;
+  guint changes_added;
 
   double last_value;
 
+  /* The vadjustment value and upper in list pixels. Lists taller than an
+   * int are scaled down onto the vadjustment, see set_list_upper() */
+  gint64 list_value;
+  gint64 list_upper;
+  double adjustment_scale;
+  /* Only active while scaled, see update_scroll_controller() */
+  GtkEventController *scroll_controller;
+
+  /* Applied in the next layout, see gd_model_list_box_set_scroll_state() */
+  gboolean scroll_state_pending;
+  GdModelListBoxScrollState scroll_state;
+
+  /* Keep the view at the end of the list while it's there */
+  gboolean follow_tail;
+  gboolean at_tail;
+
   GtkWidget *active_row;
+
+  GdSelectionMode selection_mode;
+  GdRangeSet *selection;
+  /* Where shift-click ranges start, G_MAXUINT if unset */
+  guint selection_anchor;
+
+  GdModelListBoxStats stats;
+
+  GdScrollTrace *trace;
+  int trace_width;
+  int trace_height;
 };
 
 struct _GdModelListBoxClass
@@ -56,6 +211,88 @@ void         gd_model_list_box_set_model       (GdModelListBox           *box,
                                                 GdModelListBoxRemoveFunc  remove_func,
                                                 gpointer                  remove_data,
                                                 GDestroyNotify            remove_destroy_notify);
+void         gd_model_list_box_set_snapshot_model (GdModelListBox             *box,
+                                                   GListModel                 *model,
+                                                   GdModelListBoxMeasureFunc   measure_func,
+                                                   GdModelListBoxSnapshotFunc  snapshot_func,
+                                                   gpointer                    user_data,
+                                                   GDestroyNotify              destroy_notify);
 GListModel * gd_model_list_box_get_model       (GdModelListBox *box);
+guint        gd_model_list_box_get_item_at_y   (GdModelListBox *box,
+                                                double          y);
+void         gd_model_list_box_scroll_to_item  (GdModelListBox *box,
+                                                guint           position);
+void         gd_model_list_box_get_stats       (GdModelListBox      *box,
+                                                GdModelListBoxStats *stats);
+void         gd_model_list_box_reset_stats     (GdModelListBox *box);
+
+void            gd_model_list_box_set_selection_mode (GdModelListBox  *box,
+                                                      GdSelectionMode  mode);
+GdSelectionMode gd_model_list_box_get_selection_mode (GdModelListBox  *box);
+GdRangeSet *    gd_model_list_box_get_selection      (GdModelListBox  *box);
+gboolean        gd_model_list_box_is_selected        (GdModelListBox  *box,
+                                                      guint            position);
+void            gd_model_list_box_select_item        (GdModelListBox  *box,
+                                                      guint            position,
+                                                      gboolean         unselect_rest);
+void            gd_model_list_box_unselect_item      (GdModelListBox  *box,
+                                                      guint            position);
+void            gd_model_list_box_select_range       (GdModelListBox  *box,
+                                                      guint            position,
+                                                      guint            n_items,
+                                                      gboolean         unselect_rest);
+void            gd_model_list_box_unselect_range     (GdModelListBox  *box,
+                                                      guint            position,
+                                                      guint            n_items);
+void            gd_model_list_box_select_all         (GdModelListBox  *box);
+void            gd_model_list_box_unselect_all       (GdModelListBox  *box);
+void            gd_model_list_box_invert_selection   (GdModelListBox  *box);
+
+void            gd_model_list_box_set_declared_width (GdModelListBox *box,
+                                                      int             width);
+int             gd_model_list_box_get_declared_width (GdModelListBox *box);
+
+guint           gd_model_list_box_append_column    (GdModelListBox *box,
+                                                    int             width,
+                                                    gboolean        expand);
+guint           gd_model_list_box_get_n_columns    (GdModelListBox *box);
+int             gd_model_list_box_get_column_width (GdModelListBox *box,
+                                                    guint           column);
+
+void            gd_model_list_box_invalidate_item      (GdModelListBox *box,
+                                                        guint           position);
+void            gd_model_list_box_set_auto_invalidate  (GdModelListBox *box,
+                                                        gboolean        auto_invalidate);
+gboolean        gd_model_list_box_get_auto_invalidate  (GdModelListBox *box);
+
+void            gd_model_list_box_set_prepare_func     (GdModelListBox            *box,
+                                                        GdModelListBoxPrepareFunc  prepare_func,
+                                                        GDestroyNotify             payload_destroy,
+                                                        gpointer                   user_data,
+                                                        GDestroyNotify             destroy_notify);
+gpointer        gd_model_list_box_get_payload          (GdModelListBox            *box,
+                                                        guint                      item_index);
+
+void            gd_model_list_box_set_prewarm_func (GdModelListBox           *box,
+                                                    GdModelListBoxCreateFunc  create_func,
+                                                    int                       expected_row_height,
+                                                    gpointer                  user_data,
+                                                    GDestroyNotify            destroy_notify);
+
+void            gd_model_list_box_set_detach_pool  (GdModelListBox *box,
+                                                    gboolean        detach_pool);
+gboolean        gd_model_list_box_get_detach_pool  (GdModelListBox *box);
+
+void            gd_model_list_box_get_scroll_state (GdModelListBox                  *box,
+                                                    GdModelListBoxScrollState       *state);
+void            gd_model_list_box_set_scroll_state (GdModelListBox                  *box,
+                                                    const GdModelListBoxScrollState *state);
+
+void            gd_model_list_box_set_follow_tail (GdModelListBox *box,
+                                                   gboolean        follow_tail);
+gboolean        gd_model_list_box_get_follow_tail (GdModelListBox *box);
+
+void            gd_model_list_box_start_recording (GdModelListBox *box);
+GdScrollTrace * gd_model_list_box_stop_recording  (GdModelListBox *box);
 
 #endif
@@ -0,0 +1,271 @@
+/*
+ *  Copyright 2017 Timm Bäder
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "gd-range-set.h"
+
+typedef struct
+{
+  guint start;
+  guint end; /* Exclusive */
+} Range;
+
+struct _GdRangeSet
+{
+  GArray *ranges;
+};
+
+#define RANGE(set, i) (g_array_index ((set)->ranges, Range, (i)))
+
+GdRangeSet *
+gd_range_set_new (void)
+{
+  GdRangeSet *set = g_slice_new (GdRangeSet);
+
+  set->ranges = g_array_new (FALSE, FALSE, sizeof (Range));
+
+  return set;
+}
+
+void
+gd_range_set_free (GdRangeSet *set)
+{
+  g_array_free (set->ranges, TRUE);
+  g_slice_free (GdRangeSet, set);
+}
+
+/* Index of the first range with range.end > position (or >= if @inclusive),
+ * i.e. the first one that could contain (or touch) @position */
+static guint
+first_range_ending_after (GdRangeSet *set,
+                          guint       position,
+                          gboolean    inclusive)
+{
+  guint low = 0;
+  guint high = set->ranges->len;
+
+  while (low < high)
+    {
+      guint mid = low + (high - low) / 2;
+      guint end = RANGE (set, mid).end;
+
+      if (end > position || (inclusive && end == position))
+        high = mid;
+      else
+        low = mid + 1;
+    }
+
+  return low;
+}
+
+gboolean
+gd_range_set_contains (GdRangeSet *set,
+                       guint       position)
+{
+  guint i = first_range_ending_after (set, position, FALSE);
+
+  return i < set->ranges->len && RANGE (set, i).start <= position;
+}
+
+void
+gd_range_set_add (GdRangeSet *set,
+                  guint       start,
+                  guint       n_items)
+{
+  Range new_range = { start, start + n_items };
+  guint first, last;
+
+  if (n_items == 0)
+    return;
+
+  /* All ranges in [first, last) overlap or touch the new one and get merged into it */
+  first = first_range_ending_after (set, start, TRUE);
+  for (last = first;
+       last < set->ranges->len && RANGE (set, last).start <= new_range.end;
+       last ++)
+    ;
+
+  if (first < last)
+    {
+      new_range.start = MIN (new_range.start, RANGE (set, first).start);
+      new_range.end   = MAX (new_range.end, RANGE (set, last - 1).end);
+      g_array_remove_range (set->ranges, first, last - first);
+    }
+
+  g_array_insert_val (set->ranges, first, new_range);
+}
+
+void
+gd_range_set_remove (GdRangeSet *set,
+                     guint       start,
+                     guint       n_items)
+{
+  guint end = start + n_items;
+  guint first, last;
+  Range pieces[2];
+  guint n_pieces = 0;
+
+  if (n_items == 0)
+    return;
+
+  /* All ranges in [first, last) overlap the removed one */
+  first = first_range_ending_after (set, start, FALSE);
+  for (last = first;
+       last < set->ranges->len && RANGE (set, last).start < end;
+       last ++)
+    ;
+
+  if (first == last)
+    return;
+
+  /* What's left of them are at most two pieces at the edges */
+  if (RANGE (set, first).start < start)
+    {
+      pieces[n_pieces].start = RANGE (set, first).start;
+      pieces[n_pieces].end   = start;
+      n_pieces ++;
+    }
+
+  if (RANGE (set, last - 1).end > end)
+    {
+      pieces[n_pieces].start = end;
+      pieces[n_pieces].end   = RANGE (set, last - 1).end;
+      n_pieces ++;
+    }
+
+  g_array_remove_range (set->ranges, first, last - first);
+  g_array_insert_vals (set->ranges, first, pieces, n_pieces);
+}
+
+void
+gd_range_set_clear (GdRangeSet *set)
+{
+  g_array_set_size (set->ranges, 0);
+}
+
+/* Inverts the set in [0, n_items) */
+void
+gd_range_set_invert (GdRangeSet *set,
+                     guint       n_items)
+{
+  GArray *inverted = g_array_sized_new (FALSE, FALSE, sizeof (Range), set->ranges->len + 1);
+  guint prev_end = 0;
+  guint i;
+
+  for (i = 0; i < set->ranges->len && RANGE (set, i).start < n_items; i ++)
+    {
+      if (RANGE (set, i).start > prev_end)
+        {
+          Range r = { prev_end, RANGE (set, i).start };
+          g_array_append_val (inverted, r);
+        }
+
+      prev_end = RANGE (set, i).end;
+    }
+
+  if (prev_end < n_items)
+    {
+      Range r = { prev_end, n_items };
+      g_array_append_val (inverted, r);
+    }
+
+  g_array_free (set->ranges, TRUE);
+  set->ranges = inverted;
+}
+
+/*
+ * Applies an items-changed splice: positions in [position, position + removed)
+ * are dropped, positions after that move by added - removed. The added
+ * positions are not contained in the set.
+ */
+void
+gd_range_set_splice (GdRangeSet *set,
+                     guint       position,
+                     guint       removed,
+                     guint       added)
+{
+  guint i;
+
+  gd_range_set_remove (set, position, removed);
+
+  /* Split a range spanning @position, the added items go in between */
+  i = first_range_ending_after (set, position, FALSE);
+  if (added > 0 && i < set->ranges->len && RANGE (set, i).start < position)
+    {
+      Range tail = { position, RANGE (set, i).end };
+
+      RANGE (set, i).end = position;
+      i ++;
+      g_array_insert_val (set->ranges, i, tail);
+    }
+
+  if (added != removed)
+    {
+      guint k;
+
+      for (k = i; k < set->ranges->len; k ++)
+        {
+          RANGE (set, k).start = RANGE (set, k).start - removed + added;
+          RANGE (set, k).end   = RANGE (set, k).end - removed + added;
+        }
+    }
+
+  /* If items were only removed, the ranges around them might touch now */
+  if (i > 0 && i < set->ranges->len &&
+      RANGE (set, i - 1).end == RANGE (set, i).start)
+    {
+      RANGE (set, i - 1).end = RANGE (set, i).end;
+      g_array_remove_index (set->ranges, i);
+    }
+}
+
+gboolean
+gd_range_set_is_empty (GdRangeSet *set)
+{
+  return set->ranges->len == 0;
+}
+
+/* Number of contained positions */
+guint
+gd_range_set_get_size (GdRangeSet *set)
+{
+  guint size = 0;
+  guint i;
+
+  for (i = 0; i < set->ranges->len; i ++)
+    size += RANGE (set, i).end - RANGE (set, i).start;
+
+  return size;
+}
+
+guint
+gd_range_set_get_n_ranges (GdRangeSet *set)
+{
+  return set->ranges->len;
+}
+
+void
+gd_range_set_get_range (GdRangeSet *set,
+                        guint       index,
+                        guint      *start,
+                        guint      *n_items)
+{
+  g_return_if_fail (index < set->ranges->len);
+
+  *start   = RANGE (set, index).start;
+  *n_items = RANGE (set, index).end - RANGE (set, index).start;
+}
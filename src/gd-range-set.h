@@ -0,0 +1,36 @@
+#ifndef _GD_RANGE_SET_H_
+#define _GD_RANGE_SET_H_
+
+#include <glib.h>
+
+/* A set of item positions, stored as sorted, disjoint and non-adjacent
+ * [start, start + n_items) ranges. All operations are O(log ranges) or
+ * O(ranges), independent of how many items are contained. */
+typedef struct _GdRangeSet GdRangeSet;
+
+GdRangeSet * gd_range_set_new         (void);
+void         gd_range_set_free        (GdRangeSet *set);
+gboolean     gd_range_set_contains    (GdRangeSet *set,
+                                       guint       position);
+void         gd_range_set_add         (GdRangeSet *set,
+                                       guint       start,
+                                       guint       n_items);
+void         gd_range_set_remove      (GdRangeSet *set,
+                                       guint       start,
+                                       guint       n_items);
+void         gd_range_set_clear       (GdRangeSet *set);
+void         gd_range_set_invert      (GdRangeSet *set,
+                                       guint       n_items);
+void         gd_range_set_splice      (GdRangeSet *set,
+                                       guint       position,
+                                       guint       removed,
+                                       guint       added);
+gboolean     gd_range_set_is_empty    (GdRangeSet *set);
+guint        gd_range_set_get_size    (GdRangeSet *set);
+guint        gd_range_set_get_n_ranges (GdRangeSet *set);
+void         gd_range_set_get_range   (GdRangeSet *set,
+                                       guint       index,
+                                       guint      *start,
+                                       guint      *n_items);
+
+#endif
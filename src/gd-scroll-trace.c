@@ -0,0 +1,206 @@
+/*
+ *  Copyright 2017 Timm Bäder
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "gd-scroll-trace.h"
+
+#include <gio/gio.h>
+#include <string.h>
+
+/*
+ * A scroll trace is everything that changed a GdModelListBox's layout from
+ * the outside, with timestamps: vadjustment values, allocation sizes and
+ * model splices. Feeding the same events back in the same order reproduces
+ * the same layout work, so traces can be attached to bug reports and used
+ * to compare branches against the same workload.
+ *
+ * The file format is line based:
+ *
+ *   n-items <number of items when the recording started>
+ *   <time> value <value>
+ *   <time> allocation <width> <height>
+ *   <time> splice <position> <removed> <added>
+ */
+
+struct _GdScrollTrace
+{
+  guint n_items;
+  gint64 start_time;
+  GArray *events;
+};
+
+static const char *event_names[] = { "value", "allocation", "splice" };
+static const guint event_n_values[] = { 1, 2, 3 };
+
+GdScrollTrace *
+gd_scroll_trace_new (guint n_items)
+{
+  GdScrollTrace *trace = g_slice_new (GdScrollTrace);
+
+  trace->n_items = n_items;
+  trace->start_time = g_get_monotonic_time ();
+  trace->events = g_array_new (FALSE, FALSE, sizeof (GdScrollTraceEvent));
+
+  return trace;
+}
+
+void
+gd_scroll_trace_free (GdScrollTrace *trace)
+{
+  g_array_free (trace->events, TRUE);
+  g_slice_free (GdScrollTrace, trace);
+}
+
+void
+gd_scroll_trace_add (GdScrollTrace          *trace,
+                     GdScrollTraceEventType  type,
+                     double                  value1,
+                     double                  value2,
+                     double                  value3)
+{
+  GdScrollTraceEvent event;
+
+  event.time = g_get_monotonic_time () - trace->start_time;
+  event.type = type;
+  event.values[0] = value1;
+  event.values[1] = value2;
+  event.values[2] = value3;
+
+  g_array_append_val (trace->events, event);
+}
+
+guint
+gd_scroll_trace_get_n_items (GdScrollTrace *trace)
+{
+  return trace->n_items;
+}
+
+const GdScrollTraceEvent *
+gd_scroll_trace_get_events (GdScrollTrace *trace,
+                            guint         *n_events)
+{
+  *n_events = trace->events->len;
+
+  return (const GdScrollTraceEvent *)trace->events->data;
+}
+
+gboolean
+gd_scroll_trace_save (GdScrollTrace  *trace,
+                      const char     *filename,
+                      GError        **error)
+{
+  GString *str = g_string_new (NULL);
+  char buf[G_ASCII_DTOSTR_BUF_SIZE];
+  gboolean result;
+  guint i, k;
+
+  g_string_append_printf (str, "n-items %u\n", trace->n_items);
+
+  for (i = 0; i < trace->events->len; i ++)
+    {
+      const GdScrollTraceEvent *event = &g_array_index (trace->events, GdScrollTraceEvent, i);
+
+      g_string_append_printf (str, "%" G_GINT64_FORMAT " %s", event->time, event_names[event->type]);
+
+      for (k = 0; k < event_n_values[event->type]; k ++)
+        {
+          g_string_append_c (str, ' ');
+          g_string_append (str, g_ascii_dtostr (buf, sizeof (buf), event->values[k]));
+        }
+
+      g_string_append_c (str, '\n');
+    }
+
+  result = g_file_set_contents (filename, str->str, str->len, error);
+  g_string_free (str, TRUE);
+
+  return result;
+}
+
+GdScrollTrace *
+gd_scroll_trace_load (const char  *filename,
+                      GError     **error)
+{
+  GdScrollTrace *trace = NULL;
+  char *contents;
+  char **lines;
+  guint i, k;
+
+  if (!g_file_get_contents (filename, &contents, NULL, error))
+    return NULL;
+
+  lines = g_strsplit (contents, "\n", -1);
+
+  if (lines[0] == NULL || !g_str_has_prefix (lines[0], "n-items "))
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                   "%s: Not a scroll trace", filename);
+      goto out;
+    }
+
+  trace = gd_scroll_trace_new (g_ascii_strtoull (lines[0] + strlen ("n-items "), NULL, 10));
+
+  for (i = 1; lines[i] != NULL; i ++)
+    {
+      char **parts;
+      GdScrollTraceEvent event = { 0, };
+      gboolean valid = FALSE;
+
+      if (lines[i][0] == '\0')
+        continue;
+
+      parts = g_strsplit (lines[i], " ", -1);
+
+      if (g_strv_length (parts) >= 2)
+        {
+          for (k = 0; k < G_N_ELEMENTS (event_names); k ++)
+            {
+              if (strcmp (parts[1], event_names[k]) == 0 &&
+                  g_strv_length (parts) == 2 + event_n_values[k])
+                {
+                  guint v;
+
+                  event.time = g_ascii_strtoll (parts[0], NULL, 10);
+                  event.type = k;
+                  for (v = 0; v < event_n_values[k]; v ++)
+                    event.values[v] = g_ascii_strtod (parts[2 + v], NULL);
+
+                  valid = TRUE;
+                  break;
+                }
+            }
+        }
+
+      g_strfreev (parts);
+
+      if (!valid)
+        {
+          g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                       "%s:%u: Invalid event", filename, i + 1);
+          g_clear_pointer (&trace, gd_scroll_trace_free);
+          goto out;
+        }
+
+      g_array_append_val (trace->events, event);
+    }
+
+out:
+  g_strfreev (lines);
+  g_free (contents);
+
+  return trace;
+}
@@ -0,0 +1,37 @@
+#ifndef _GD_SCROLL_TRACE_H_
+#define _GD_SCROLL_TRACE_H_
+
+#include <glib.h>
+
+typedef enum {
+  GD_SCROLL_TRACE_VALUE,      /* values[0]: new vadjustment value */
+  GD_SCROLL_TRACE_ALLOCATION, /* values[0], values[1]: width and height */
+  GD_SCROLL_TRACE_SPLICE,     /* values[0..2]: position, removed, added */
+} GdScrollTraceEventType;
+
+typedef struct
+{
+  gint64 time; /* µs since the recording started */
+  GdScrollTraceEventType type;
+  double values[3];
+} GdScrollTraceEvent;
+
+typedef struct _GdScrollTrace GdScrollTrace;
+
+GdScrollTrace *            gd_scroll_trace_new         (guint                   n_items);
+void                       gd_scroll_trace_free        (GdScrollTrace          *trace);
+void                       gd_scroll_trace_add         (GdScrollTrace          *trace,
+                                                        GdScrollTraceEventType  type,
+                                                        double                  value1,
+                                                        double                  value2,
+                                                        double                  value3);
+guint                      gd_scroll_trace_get_n_items (GdScrollTrace          *trace);
+const GdScrollTraceEvent * gd_scroll_trace_get_events  (GdScrollTrace          *trace,
+                                                        guint                  *n_events);
+gboolean                   gd_scroll_trace_save        (GdScrollTrace          *trace,
+                                                        const char             *filename,
+                                                        GError                **error);
+GdScrollTrace *            gd_scroll_trace_load        (const char             *filename,
+                                                        GError                **error);
+
+#endif
@@ -0,0 +1,642 @@
+/*
+ *  Copyright 2017 Timm Bäder
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+
+#include "gd-search-index.h"
+#include "gd-range-set.h"
+
+#include <string.h>
+
+/*
+ * A sorted index of the casefolded keys of all items in a GListModel, for
+ * type-ahead search. Looking up a prefix is two binary searches.
+ *
+ * Like in GdSortFilterModel, keys are extracted on the main thread, but
+ * normalizing and sorting a large batch of them happens on a worker thread.
+ * Items added later are collected until the next idle (or lookup), indexed
+ * as a batch of their own and merged into the existing index, and
+ * items-changed otherwise just drops or renumbers entries, so the index is
+ * never rebuilt from scratch.
+ *
+ * While a batch is being sorted, lookups only find the items indexed before.
+ */
+
+/* Batches smaller than this are sorted right away, and merged in place */
+#define MIN_THREADED_BATCH 4096
+
+typedef struct
+{
+  char *key;
+  guint position;
+} Entry;
+
+typedef struct
+{
+  guint position;
+  guint removed;
+  guint added;
+} Change;
+
+struct _GdSearchIndex
+{
+  GObject parent_instance;
+
+  GListModel *model;
+  GdSearchIndexKeyFunc key_func;
+  gpointer key_func_data;
+  GDestroyNotify key_func_destroy;
+
+  /* Entry, sorted by key, then position */
+  GArray *entries;
+  /* No entry has a position at or after this */
+  guint entries_end;
+  /* Positions that are in neither @entries nor a running batch */
+  GdRangeSet *missing;
+  guint flush_id;
+
+  gboolean building;
+  /* Model changes since the running batch was started, to be applied to it */
+  GArray *changes;
+};
+
+G_DEFINE_TYPE (GdSearchIndex, gd_search_index, G_TYPE_OBJECT)
+
+/* Entries {{{ */
+static void
+entry_clear (gpointer data)
+{
+  Entry *entry = data;
+
+  g_free (entry->key);
+}
+
+static GArray *
+entries_new (guint reserved_size)
+{
+  GArray *entries = g_array_sized_new (FALSE, FALSE, sizeof (Entry), reserved_size);
+
+  g_array_set_clear_func (entries, entry_clear);
+
+  return entries;
+}
+
+static char *
+fold_key (const char *text)
+{
+  char *normalized;
+  char *folded;
+
+  if (text == NULL)
+    return g_strdup ("");
+
+  normalized = g_utf8_normalize (text, -1, G_NORMALIZE_ALL);
+  if (normalized == NULL)
+    return g_strdup ("");
+
+  folded = g_utf8_casefold (normalized, -1);
+  g_free (normalized);
+
+  return folded;
+}
+
+static int
+compare_entries (gconstpointer a,
+                 gconstpointer b)
+{
+  const Entry *entry_a = a;
+  const Entry *entry_b = b;
+  int result;
+
+  result = strcmp (entry_a->key, entry_b->key);
+  if (result != 0)
+    return result;
+
+  return entry_a->position < entry_b->position ? -1 : (entry_a->position > entry_b->position ? 1 : 0);
+}
+
+/* Turns the raw keys in @batch into folded ones and sorts it */
+static void
+batch_prepare (GArray *batch)
+{
+  guint i;
+
+  for (i = 0; i < batch->len; i ++)
+    {
+      Entry *entry = &g_array_index (batch, Entry, i);
+      char *folded = fold_key (entry->key);
+
+      g_free (entry->key);
+      entry->key = folded;
+    }
+
+  g_array_sort (batch, compare_entries);
+}
+
+/* Applies an items-changed to the positions in @entries, in one pass */
+static void
+entries_splice (GArray *entries,
+                guint   position,
+                guint   removed,
+                guint   added)
+{
+  guint i, j;
+
+  if (removed == 0 && added == 0)
+    return;
+
+  for (i = 0, j = 0; i < entries->len; i ++)
+    {
+      Entry *entry = &g_array_index (entries, Entry, i);
+
+      if (entry->position >= position && entry->position < position + removed)
+        {
+          g_free (entry->key);
+          continue;
+        }
+
+      if (entry->position >= position + removed)
+        entry->position = entry->position - removed + added;
+
+      g_array_index (entries, Entry, j) = *entry;
+      j ++;
+    }
+
+  /* The dropped keys are freed already */
+  g_array_set_clear_func (entries, NULL);
+  g_array_set_size (entries, j);
+  g_array_set_clear_func (entries, entry_clear);
+}
+
+/* Index of the first of the first @n_entries entries that sorts after @entry */
+static guint
+entries_upper_bound (GArray      *entries,
+                     guint        n_entries,
+                     const Entry *entry)
+{
+  guint lo = 0;
+  guint hi = n_entries;
+
+  while (lo < hi)
+    {
+      guint mid = lo + (hi - lo) / 2;
+
+      if (compare_entries (&g_array_index (entries, Entry, mid), entry) <= 0)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+
+  return lo;
+}
+
+/* Merges the small sorted @batch into the sorted @entries, back to front,
+ * with one binary search per batch entry. Entries sorting before all of
+ * @batch are not touched, all others get moved once. Takes @batch. */
+static void
+entries_merge_in_place (GArray *entries,
+                        GArray *batch)
+{
+  guint end = entries->len;
+  guint j;
+
+  g_array_set_size (entries, entries->len + batch->len);
+
+  for (j = batch->len; j > 0; j --)
+    {
+      const Entry *entry = &g_array_index (batch, Entry, j - 1);
+      guint pos = entries_upper_bound (entries, end, entry);
+
+      /* Everything in [pos, end) sorts after the j remaining batch entries */
+      memmove (&g_array_index (entries, Entry, pos + j),
+               &g_array_index (entries, Entry, pos),
+               (end - pos) * sizeof (Entry));
+      g_array_index (entries, Entry, pos + j - 1) = *entry;
+      end = pos;
+    }
+
+  /* All keys belong to @entries now */
+  g_array_set_clear_func (batch, NULL);
+  g_array_unref (batch);
+}
+
+/* Merges the sorted @batch into the sorted @entries. Takes @batch. */
+static GArray *
+entries_merge (GArray *entries,
+               GArray *batch)
+{
+  GArray *merged;
+  guint i = 0, j = 0;
+
+  if (batch->len == 0)
+    {
+      g_array_unref (batch);
+      return entries;
+    }
+
+  if (batch->len < MIN_THREADED_BATCH)
+    {
+      entries_merge_in_place (entries, batch);
+      return entries;
+    }
+
+  merged = entries_new (entries->len + batch->len);
+
+  while (i < entries->len && j < batch->len)
+    {
+      const Entry *a = &g_array_index (entries, Entry, i);
+      const Entry *b = &g_array_index (batch, Entry, j);
+
+      if (compare_entries (a, b) <= 0)
+        {
+          g_array_append_val (merged, *a);
+          i ++;
+        }
+      else
+        {
+          g_array_append_val (merged, *b);
+          j ++;
+        }
+    }
+
+  g_array_append_vals (merged, &g_array_index (entries, Entry, i), entries->len - i);
+  g_array_append_vals (merged, &g_array_index (batch, Entry, j), batch->len - j);
+
+  /* All keys belong to @merged now */
+  g_array_set_clear_func (entries, NULL);
+  g_array_set_clear_func (batch, NULL);
+  g_array_unref (entries);
+  g_array_unref (batch);
+
+  return merged;
+}
+
+/* Index of the first entry whose key doesn't sort before @prefix, or, if
+ * @after is set, the first one that sorts after all keys starting with it. */
+static guint
+entries_bisect (GArray     *entries,
+                const char *prefix,
+                gsize       prefix_len,
+                gboolean    after)
+{
+  guint lo = 0;
+  guint hi = entries->len;
+
+  while (lo < hi)
+    {
+      guint mid = lo + (hi - lo) / 2;
+      int result = strncmp (g_array_index (entries, Entry, mid).key, prefix, prefix_len);
+
+      if (result < 0 || (after && result == 0))
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+
+  return lo;
+}
+/* }}} */
+
+/* Batches {{{ */
+static void flush_missing (GdSearchIndex *self);
+
+/* Applies an items-changed to @entries, skipping the pass over all of them
+ * if it only affects positions after the last one */
+static void
+splice_entries (GdSearchIndex *self,
+                guint          position,
+                guint          removed,
+                guint          added)
+{
+  if (position >= self->entries_end)
+    return;
+
+  entries_splice (self->entries, position, removed, added);
+
+  if (self->entries_end > position + removed)
+    self->entries_end = self->entries_end - removed + added;
+  else
+    self->entries_end = position;
+}
+
+static void
+merge_batch (GdSearchIndex *self,
+             GArray        *batch)
+{
+  guint i;
+
+  for (i = 0; i < batch->len; i ++)
+    self->entries_end = MAX (self->entries_end, g_array_index (batch, Entry, i).position + 1);
+
+  self->entries = entries_merge (self->entries, batch);
+}
+
+static void
+batch_thread (GTask        *task,
+              gpointer      source_object,
+              gpointer      task_data,
+              GCancellable *cancellable)
+{
+  GArray *batch = task_data;
+
+  batch_prepare (batch);
+
+  g_task_return_boolean (task, TRUE);
+}
+
+static void
+batch_done (GObject      *source_object,
+            GAsyncResult *result,
+            gpointer      user_data)
+{
+  GdSearchIndex *self = GD_SEARCH_INDEX (source_object);
+  GArray *batch = g_array_ref (g_task_get_task_data (G_TASK (result)));
+  guint i;
+
+  g_task_propagate_boolean (G_TASK (result), NULL);
+
+  /* Catch up with everything that happened while it was being sorted.
+   * Renumbering keeps the order intact. */
+  for (i = 0; i < self->changes->len; i ++)
+    {
+      const Change *change = &g_array_index (self->changes, Change, i);
+
+      entries_splice (batch, change->position, change->removed, change->added);
+    }
+  g_array_set_size (self->changes, 0);
+
+  merge_batch (self, batch);
+  self->building = FALSE;
+
+  flush_missing (self);
+}
+
+/* Indexes everything in self->missing */
+static void
+flush_missing (GdSearchIndex *self)
+{
+  GArray *batch;
+  guint n_ranges;
+  guint r, i;
+
+  if (self->flush_id != 0)
+    {
+      g_source_remove (self->flush_id);
+      self->flush_id = 0;
+    }
+
+  if (self->building || gd_range_set_is_empty (self->missing))
+    return;
+
+  batch = entries_new (gd_range_set_get_size (self->missing));
+  n_ranges = gd_range_set_get_n_ranges (self->missing);
+
+  for (r = 0; r < n_ranges; r ++)
+    {
+      guint start, n_items;
+
+      gd_range_set_get_range (self->missing, r, &start, &n_items);
+
+      for (i = start; i < start + n_items; i ++)
+        {
+          gpointer item = g_list_model_get_item (self->model, i);
+          Entry entry;
+
+          entry.key = self->key_func (item, self->key_func_data);
+          entry.position = i;
+          g_array_append_val (batch, entry);
+
+          g_object_unref (item);
+        }
+    }
+
+  gd_range_set_clear (self->missing);
+
+  if (batch->len < MIN_THREADED_BATCH)
+    {
+      batch_prepare (batch);
+      merge_batch (self, batch);
+    }
+  else
+    {
+      GTask *task;
+
+      self->building = TRUE;
+
+      task = g_task_new (self, NULL, batch_done, NULL);
+      g_task_set_task_data (task, batch, (GDestroyNotify) g_array_unref);
+      g_task_run_in_thread (task, batch_thread);
+      g_object_unref (task);
+    }
+}
+
+static gboolean
+flush_missing_idle_cb (gpointer user_data)
+{
+  GdSearchIndex *self = user_data;
+
+  self->flush_id = 0;
+  flush_missing (self);
+
+  return G_SOURCE_REMOVE;
+}
+
+/* Lets consecutive changes of the model end up in one batch */
+static void
+queue_flush_missing (GdSearchIndex *self)
+{
+  if (self->flush_id == 0)
+    self->flush_id = g_idle_add_full (G_PRIORITY_DEFAULT_IDLE, flush_missing_idle_cb, self, NULL);
+}
+/* }}} */
+
+static void
+model_items_changed_cb (GListModel *model,
+                        guint       position,
+                        guint       removed,
+                        guint       added,
+                        gpointer    user_data)
+{
+  GdSearchIndex *self = user_data;
+
+  splice_entries (self, position, removed, added);
+  gd_range_set_splice (self->missing, position, removed, added);
+  gd_range_set_add (self->missing, position, added);
+
+  if (self->building)
+    {
+      Change change = { position, removed, added };
+
+      g_array_append_val (self->changes, change);
+      return;
+    }
+
+  if (!gd_range_set_is_empty (self->missing))
+    queue_flush_missing (self);
+}
+
+static void
+gd_search_index_finalize (GObject *object)
+{
+  GdSearchIndex *self = GD_SEARCH_INDEX (object);
+
+  /* Running batches keep a reference on us */
+  g_assert (!self->building);
+
+  if (self->flush_id != 0)
+    g_source_remove (self->flush_id);
+
+  g_signal_handlers_disconnect_by_func (self->model, model_items_changed_cb, self);
+  g_object_unref (self->model);
+
+  if (self->key_func_destroy)
+    self->key_func_destroy (self->key_func_data);
+
+  g_array_unref (self->entries);
+  g_array_unref (self->changes);
+  gd_range_set_free (self->missing);
+
+  G_OBJECT_CLASS (gd_search_index_parent_class)->finalize (object);
+}
+
+static void
+gd_search_index_class_init (GdSearchIndexClass *class)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (class);
+
+  object_class->finalize = gd_search_index_finalize;
+}
+
+static void
+gd_search_index_init (GdSearchIndex *self)
+{
+  self->entries = entries_new (0);
+  self->missing = gd_range_set_new ();
+  self->changes = g_array_new (FALSE, FALSE, sizeof (Change));
+}
+
+/**
+ * gd_search_index_new:
+ * @model: The model to index
+ * @key_func: Returns the string to find an item by
+ *
+ * Creates a new search index for @model and starts building it. It follows
+ * all changes of @model from then on.
+ */
+GdSearchIndex *
+gd_search_index_new (GListModel           *model,
+                     GdSearchIndexKeyFunc  key_func,
+                     gpointer              user_data,
+                     GDestroyNotify        user_destroy)
+{
+  GdSearchIndex *self;
+
+  g_return_val_if_fail (G_IS_LIST_MODEL (model), NULL);
+  g_return_val_if_fail (key_func != NULL, NULL);
+
+  self = g_object_new (GD_TYPE_SEARCH_INDEX, NULL);
+  self->model = g_object_ref (model);
+  self->key_func = key_func;
+  self->key_func_data = user_data;
+  self->key_func_destroy = user_destroy;
+
+  g_signal_connect (model, "items-changed", G_CALLBACK (model_items_changed_cb), self);
+  model_items_changed_cb (model, 0, 0, g_list_model_get_n_items (model), self);
+  flush_missing (self);
+
+  return self;
+}
+
+/**
+ * gd_search_index_lookup:
+ * @prefix: What the key has to start with, compared case-insensitively
+ * @nth: Which of the matches to return, so repeated lookups can cycle
+ *   through all of them
+ *
+ * Matches are ordered by their key, then by their position.
+ *
+ * Returns: The position of the @nth item whose key starts with @prefix,
+ *   or %G_MAXUINT if there are not that many.
+ */
+guint
+gd_search_index_lookup (GdSearchIndex *self,
+                        const char    *prefix,
+                        guint          nth)
+{
+  char *folded;
+  gsize len;
+  guint first, last;
+
+  g_return_val_if_fail (GD_IS_SEARCH_INDEX (self), G_MAXUINT);
+  g_return_val_if_fail (prefix != NULL, G_MAXUINT);
+
+  if (self->flush_id != 0)
+    flush_missing (self);
+
+  folded = fold_key (prefix);
+  len = strlen (folded);
+  first = entries_bisect (self->entries, folded, len, FALSE);
+  last = entries_bisect (self->entries, folded, len, TRUE);
+  g_free (folded);
+
+  if (nth >= last - first)
+    return G_MAXUINT;
+
+  return g_array_index (self->entries, Entry, first + nth).position;
+}
+
+/**
+ * gd_search_index_count:
+ *
+ * Returns: The number of items whose key starts with @prefix
+ */
+guint
+gd_search_index_count (GdSearchIndex *self,
+                       const char    *prefix)
+{
+  char *folded;
+  gsize len;
+  guint count;
+
+  g_return_val_if_fail (GD_IS_SEARCH_INDEX (self), 0);
+  g_return_val_if_fail (prefix != NULL, 0);
+
+  if (self->flush_id != 0)
+    flush_missing (self);
+
+  folded = fold_key (prefix);
+  len = strlen (folded);
+  count = entries_bisect (self->entries, folded, len, TRUE) -
+          entries_bisect (self->entries, folded, len, FALSE);
+  g_free (folded);
+
+  return count;
+}
+
+/**
+ * gd_search_index_is_building:
+ *
+ * Returns: %TRUE while items are being indexed on another thread.
+ *   Lookups don't find them until that's done.
+ */
+gboolean
+gd_search_index_is_building (GdSearchIndex *self)
+{
+  g_return_val_if_fail (GD_IS_SEARCH_INDEX (self), FALSE);
+
+  return self->building;
+}
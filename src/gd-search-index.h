@@ -0,0 +1,26 @@
+#ifndef _GD_SEARCH_INDEX_H_
+#define _GD_SEARCH_INDEX_H_
+
+#include <gio/gio.h>
+
+/* Returns a newly allocated UTF-8 string @item can be found by.
+ * Called on the main thread, once per item. */
+typedef char * (*GdSearchIndexKeyFunc) (gpointer item,
+                                        gpointer user_data);
+
+#define GD_TYPE_SEARCH_INDEX gd_search_index_get_type ()
+
+G_DECLARE_FINAL_TYPE (GdSearchIndex, gd_search_index, GD, SEARCH_INDEX, GObject)
+
+GdSearchIndex * gd_search_index_new         (GListModel           *model,
+                                             GdSearchIndexKeyFunc  key_func,
+                                             gpointer              user_data,
+                                             GDestroyNotify        user_destroy);
+guint           gd_search_index_lookup      (GdSearchIndex        *self,
+                                             const char           *prefix,
+                                             guint                 nth);
+guint           gd_search_index_count       (GdSearchIndex        *self,
+                                             const char           *prefix);
+gboolean        gd_search_index_is_building (GdSearchIndex        *self);
+
+#endif
@@ -0,0 +1,1140 @@
+/*
+ *  Copyright 2017 Timm Bäder
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "gd-sort-filter-model.h"
+
+#include <string.h>
+
+/*
+ * A GListModel presenting the items of another model sorted by and/or filtered
+ * by a string key.
+ *
+ * Keys are extracted once per item on the main thread (GObjects are generally not
+ * thread safe) and turned into a collation key for sorting and a casefolded
+ * string for filtering. The actual sorting and filtering runs on worker threads:
+ * Filtering in parallel chunks, sorting as a parallel merge sort over chunks
+ * that are sorted in parallel first. The result is published with the smallest
+ * single items-changed splice covering all changes.
+ *
+ * When the filter text gets more specific (e.g. a type-ahead string grows), only
+ * the items that matched before are filtered again, and since that keeps their
+ * order, they don't need to be sorted again either.
+ *
+ * Changes to the source are collected until the next idle. Items appended to
+ * the source only need to be filtered and sorted among themselves and can then
+ * be merged into the current result, everything else starts over.
+ */
+
+#define MIN_CHUNK_SIZE 4096
+/* How many items a chunk looks at between checking whether it got cancelled */
+#define CANCEL_CHECK_INTERVAL 4096
+
+typedef struct
+{
+  volatile gint ref_count;
+  char *sort_key;
+  char *filter_key;
+} ItemKey;
+
+struct _GdSortFilterModel
+{
+  GObject parent_instance;
+
+  GListModel *source;
+  GdSortFilterKeyFunc key_func;
+  gpointer key_func_data;
+  GDestroyNotify key_func_destroy;
+
+  /* ItemKey, one per source item. ItemKeys are never modified once created,
+   * so worker threads can just take a reference. */
+  GPtrArray *keys;
+  /* Number of running jobs reading @keys. As long as there are any, @keys
+   * needs to be copied before changing it. */
+  guint keys_readers;
+
+  /* guint source positions, in the order we present them */
+  GArray *visible;
+  /* Same as @keys_readers, for @visible */
+  guint visible_readers;
+  char *visible_filter;
+
+  gboolean sorted;
+  char *filter;
+
+  /* Source changes that are not in @visible yet. Items from @appended_from on
+   * (G_MAXUINT if there are none) only need to be merged in, @needs_full means
+   * everything needs to be sorted and filtered again. */
+  guint appended_from;
+  gboolean needs_full;
+  guint flush_id;
+
+  guint generation;
+  GCancellable *cancellable;
+};
+
+static void gd_sort_filter_model_list_model_init (GListModelInterface *iface);
+
+G_DEFINE_TYPE_WITH_CODE (GdSortFilterModel, gd_sort_filter_model, G_TYPE_OBJECT,
+                         G_IMPLEMENT_INTERFACE (G_TYPE_LIST_MODEL, gd_sort_filter_model_list_model_init))
+
+/* Keys {{{ */
+static ItemKey *
+item_key_new (const char *text)
+{
+  ItemKey *key = g_slice_new (ItemKey);
+  char *normalized;
+
+  if (text == NULL)
+    text = "";
+
+  normalized = g_utf8_normalize (text, -1, G_NORMALIZE_ALL);
+
+  key->ref_count = 1;
+  key->sort_key = g_utf8_collate_key (text, -1);
+  key->filter_key = normalized != NULL ? g_utf8_casefold (normalized, -1) : g_strdup ("");
+
+  g_free (normalized);
+
+  return key;
+}
+
+static ItemKey *
+item_key_ref (ItemKey *key)
+{
+  g_atomic_int_inc (&key->ref_count);
+
+  return key;
+}
+
+static void
+item_key_unref (gpointer data)
+{
+  ItemKey *key = data;
+
+  if (g_atomic_int_dec_and_test (&key->ref_count))
+    {
+      g_free (key->sort_key);
+      g_free (key->filter_key);
+      g_slice_free (ItemKey, key);
+    }
+}
+
+static char *
+normalize_filter (const char *text)
+{
+  char *normalized;
+  char *filter;
+
+  if (text == NULL || text[0] == '\0')
+    return NULL;
+
+  normalized = g_utf8_normalize (text, -1, G_NORMALIZE_ALL);
+  if (normalized == NULL)
+    return NULL;
+
+  filter = g_utf8_casefold (normalized, -1);
+  g_free (normalized);
+
+  return filter;
+}
+
+#define KEY(keys, pos) ((ItemKey *) g_ptr_array_index ((keys), (pos)))
+
+static int
+compare_positions (gconstpointer a,
+                   gconstpointer b,
+                   gpointer      user_data)
+{
+  GPtrArray *keys = user_data;
+  guint pos_a = *(const guint *)a;
+  guint pos_b = *(const guint *)b;
+  int result;
+
+  result = strcmp (KEY (keys, pos_a)->sort_key, KEY (keys, pos_b)->sort_key);
+  if (result != 0)
+    return result;
+
+  /* Keep it stable */
+  return pos_a < pos_b ? -1 : (pos_a > pos_b ? 1 : 0);
+}
+/* }}} */
+
+/* Parallel chunks {{{ */
+typedef struct
+{
+  GMutex mutex;
+  GCond cond;
+  guint pending;
+} ChunkGroup;
+
+typedef struct _Chunk Chunk;
+struct _Chunk
+{
+  void (* func) (Chunk *chunk);
+  GPtrArray *keys;
+  const char *filter;
+  guint *src;
+  guint *dest;
+  guint start;
+  guint mid;
+  guint end;
+  GArray *result;
+  GCancellable *cancellable;
+  ChunkGroup *group;
+};
+
+static void
+chunk_thread_func (gpointer data,
+                   gpointer user_data)
+{
+  Chunk *chunk = data;
+
+  chunk->func (chunk);
+
+  g_mutex_lock (&chunk->group->mutex);
+  chunk->group->pending --;
+  g_cond_signal (&chunk->group->cond);
+  g_mutex_unlock (&chunk->group->mutex);
+}
+
+static GThreadPool *
+get_chunk_pool (void)
+{
+  static GThreadPool *pool = NULL;
+
+  if (g_once_init_enter (&pool))
+    {
+      GThreadPool *new_pool;
+
+      new_pool = g_thread_pool_new (chunk_thread_func, NULL, g_get_num_processors (), FALSE, NULL);
+      g_once_init_leave (&pool, new_pool);
+    }
+
+  return pool;
+}
+
+/* Runs all @chunks on the chunk thread pool and waits for them to finish */
+static void
+run_chunks (Chunk *chunks,
+            guint  n_chunks)
+{
+  ChunkGroup group;
+  guint i;
+
+  if (n_chunks == 1)
+    {
+      chunks[0].func (&chunks[0]);
+      return;
+    }
+
+  g_mutex_init (&group.mutex);
+  g_cond_init (&group.cond);
+  group.pending = n_chunks;
+
+  for (i = 0; i < n_chunks; i ++)
+    {
+      chunks[i].group = &group;
+      g_thread_pool_push (get_chunk_pool (), &chunks[i], NULL);
+    }
+
+  g_mutex_lock (&group.mutex);
+  while (group.pending > 0)
+    g_cond_wait (&group.cond, &group.mutex);
+  g_mutex_unlock (&group.mutex);
+
+  g_mutex_clear (&group.mutex);
+  g_cond_clear (&group.cond);
+}
+
+static guint
+get_n_chunks (guint n_items)
+{
+  return CLAMP (n_items / MIN_CHUNK_SIZE, 1, g_get_num_processors ());
+}
+
+static void
+filter_chunk (Chunk *chunk)
+{
+  guint i;
+
+  for (i = chunk->start; i < chunk->end; i ++)
+    {
+      guint pos = chunk->src[i];
+
+      if ((i - chunk->start) % CANCEL_CHECK_INTERVAL == 0 &&
+          g_cancellable_is_cancelled (chunk->cancellable))
+        return;
+
+      if (strstr (KEY (chunk->keys, pos)->filter_key, chunk->filter) != NULL)
+        g_array_append_val (chunk->result, pos);
+    }
+}
+
+/* Returns the positions in @positions matching @filter, in the same order.
+ * If @cancellable gets cancelled, the result is incomplete. */
+static GArray *
+parallel_filter (GArray       *positions,
+                 GPtrArray    *keys,
+                 const char   *filter,
+                 GCancellable *cancellable)
+{
+  guint n_chunks = get_n_chunks (positions->len);
+  Chunk *chunks = g_new0 (Chunk, n_chunks);
+  GArray *result;
+  guint i;
+
+  for (i = 0; i < n_chunks; i ++)
+    {
+      chunks[i].func = filter_chunk;
+      chunks[i].keys = keys;
+      chunks[i].filter = filter;
+      chunks[i].src = (guint *)positions->data;
+      chunks[i].start = (guint64) positions->len * i / n_chunks;
+      chunks[i].end = (guint64) positions->len * (i + 1) / n_chunks;
+      chunks[i].result = g_array_new (FALSE, FALSE, sizeof (guint));
+      chunks[i].cancellable = cancellable;
+    }
+
+  run_chunks (chunks, n_chunks);
+
+  result = chunks[0].result;
+  for (i = 1; i < n_chunks; i ++)
+    {
+      g_array_append_vals (result, chunks[i].result->data, chunks[i].result->len);
+      g_array_unref (chunks[i].result);
+    }
+
+  g_free (chunks);
+
+  return result;
+}
+
+static void
+sort_chunk (Chunk *chunk)
+{
+  g_qsort_with_data (chunk->src + chunk->start,
+                     chunk->end - chunk->start,
+                     sizeof (guint),
+                     compare_positions,
+                     chunk->keys);
+}
+
+/* Merges the sorted runs src[start, mid) and src[mid, end) into dest[start, end) */
+static void
+merge_chunk (Chunk *chunk)
+{
+  guint i = chunk->start;
+  guint j = chunk->mid;
+  guint k = chunk->start;
+
+  while (i < chunk->mid && j < chunk->end)
+    {
+      if ((k - chunk->start) % CANCEL_CHECK_INTERVAL == 0 &&
+          g_cancellable_is_cancelled (chunk->cancellable))
+        return;
+
+      if (compare_positions (&chunk->src[i], &chunk->src[j], chunk->keys) <= 0)
+        chunk->dest[k++] = chunk->src[i++];
+      else
+        chunk->dest[k++] = chunk->src[j++];
+    }
+
+  while (i < chunk->mid)
+    chunk->dest[k++] = chunk->src[i++];
+
+  while (j < chunk->end)
+    chunk->dest[k++] = chunk->src[j++];
+}
+
+/* If @cancellable gets cancelled, @positions ends up in no particular order */
+static void
+parallel_sort (GArray       *positions,
+               GPtrArray    *keys,
+               GCancellable *cancellable)
+{
+  guint n = positions->len;
+  guint n_runs = get_n_chunks (n);
+  Chunk *chunks = g_new0 (Chunk, n_runs);
+  guint *runs = g_new (guint, n_runs + 1);
+  guint *scratch = g_new (guint, MAX (n, 1));
+  guint *src = (guint *)positions->data;
+  guint *dest = scratch;
+  guint i;
+
+  /* First, sort n_runs slices independently... */
+  for (i = 0; i < n_runs; i ++)
+    {
+      runs[i] = (guint64) n * i / n_runs;
+
+      chunks[i].func = sort_chunk;
+      chunks[i].keys = keys;
+      chunks[i].src = src;
+      chunks[i].start = (guint64) n * i / n_runs;
+      chunks[i].end = (guint64) n * (i + 1) / n_runs;
+    }
+  runs[n_runs] = n;
+
+  run_chunks (chunks, n_runs);
+
+  /* ... then merge neighbouring runs in parallel until only one is left */
+  while (n_runs > 1 && !g_cancellable_is_cancelled (cancellable))
+    {
+      guint n_merges = n_runs / 2;
+      guint *tmp;
+
+      for (i = 0; i < n_merges; i ++)
+        {
+          chunks[i].func = merge_chunk;
+          chunks[i].keys = keys;
+          chunks[i].src = src;
+          chunks[i].dest = dest;
+          chunks[i].start = runs[2 * i];
+          chunks[i].mid = runs[2 * i + 1];
+          chunks[i].end = runs[2 * i + 2];
+          chunks[i].cancellable = cancellable;
+        }
+
+      /* An odd run out just gets copied over */
+      if (n_runs % 2 == 1)
+        memcpy (dest + runs[n_runs - 1], src + runs[n_runs - 1],
+                (n - runs[n_runs - 1]) * sizeof (guint));
+
+      run_chunks (chunks, n_merges);
+
+      for (i = 0; i < (n_runs + 1) / 2; i ++)
+        runs[i] = runs[2 * i];
+      n_runs = (n_runs + 1) / 2;
+      runs[n_runs] = n;
+
+      tmp = src;
+      src = dest;
+      dest = tmp;
+    }
+
+  if (src != (guint *)positions->data)
+    memcpy (positions->data, src, n * sizeof (guint));
+
+  g_free (scratch);
+  g_free (runs);
+  g_free (chunks);
+}
+/* }}} */
+
+/* Jobs {{{ */
+typedef struct
+{
+  GPtrArray *keys;
+  /* Source positions to start from, in order. NULL for all of them */
+  GArray *candidates;
+  /* Set for jobs that only look at the keys of appended items. Positions in
+   * the result are relative to @offset then and get merged into @visible. */
+  gboolean merge;
+  guint offset;
+  gboolean sort;
+  char *filter;
+  guint generation;
+} Job;
+
+static void
+job_free (gpointer data)
+{
+  Job *job = data;
+
+  g_ptr_array_unref (job->keys);
+  if (job->candidates)
+    g_array_unref (job->candidates);
+  g_free (job->filter);
+  g_slice_free (Job, job);
+}
+
+static GArray *
+identity_positions (guint n_items)
+{
+  GArray *positions = g_array_sized_new (FALSE, FALSE, sizeof (guint), n_items);
+  guint i;
+
+  g_array_set_size (positions, n_items);
+  for (i = 0; i < n_items; i ++)
+    g_array_index (positions, guint, i) = i;
+
+  return positions;
+}
+
+static void
+sort_filter_thread (GTask        *task,
+                    gpointer      source_object,
+                    gpointer      task_data,
+                    GCancellable *cancellable)
+{
+  Job *job = task_data;
+  GArray *positions;
+
+  if (job->candidates != NULL)
+    positions = g_array_ref (job->candidates);
+  else
+    positions = identity_positions (job->keys->len);
+
+  if (job->filter != NULL)
+    {
+      GArray *filtered = parallel_filter (positions, job->keys, job->filter, cancellable);
+
+      g_array_unref (positions);
+      positions = filtered;
+    }
+
+  if (g_task_return_error_if_cancelled (task))
+    {
+      g_array_unref (positions);
+      return;
+    }
+
+  if (job->sort)
+    parallel_sort (positions, job->keys, cancellable);
+
+  if (g_task_return_error_if_cancelled (task))
+    {
+      g_array_unref (positions);
+      return;
+    }
+
+  g_task_return_pointer (task, positions, (GDestroyNotify) g_array_unref);
+}
+
+static void
+ensure_keys_writable (GdSortFilterModel *self)
+{
+  GPtrArray *keys;
+  guint i;
+
+  if (self->keys_readers == 0)
+    return;
+
+  keys = g_ptr_array_new_full (self->keys->len, item_key_unref);
+  for (i = 0; i < self->keys->len; i ++)
+    g_ptr_array_add (keys, item_key_ref (KEY (self->keys, i)));
+
+  g_ptr_array_unref (self->keys);
+  self->keys = keys;
+  self->keys_readers = 0;
+}
+
+static void
+ensure_visible_writable (GdSortFilterModel *self)
+{
+  GArray *visible;
+
+  if (self->visible_readers == 0)
+    return;
+
+  visible = g_array_sized_new (FALSE, FALSE, sizeof (guint), self->visible->len);
+  g_array_append_vals (visible, self->visible->data, self->visible->len);
+
+  g_array_unref (self->visible);
+  self->visible = visible;
+  self->visible_readers = 0;
+}
+
+/* Replaces @visible with @positions, emitting one items-changed
+ * for everything between the common prefix and suffix */
+static void
+publish (GdSortFilterModel *self,
+         GArray            *positions,
+         const char        *filter)
+{
+  guint old_len = self->visible->len;
+  guint new_len = positions->len;
+  guint prefix = 0;
+  guint suffix = 0;
+
+  while (prefix < old_len && prefix < new_len &&
+         g_array_index (self->visible, guint, prefix) == g_array_index (positions, guint, prefix))
+    prefix ++;
+
+  while (suffix < old_len - prefix && suffix < new_len - prefix &&
+         g_array_index (self->visible, guint, old_len - suffix - 1) ==
+         g_array_index (positions, guint, new_len - suffix - 1))
+    suffix ++;
+
+  g_array_unref (self->visible);
+  self->visible = positions;
+  self->visible_readers = 0;
+  g_free (self->visible_filter);
+  self->visible_filter = g_strdup (filter);
+
+  if (old_len != new_len || prefix < old_len)
+    g_list_model_items_changed (G_LIST_MODEL (self),
+                                prefix,
+                                old_len - prefix - suffix,
+                                new_len - prefix - suffix);
+}
+
+/* Merges the positions of appended items, already filtered and sorted among
+ * themselves, into @visible */
+static void
+merge_appended (GdSortFilterModel *self,
+                GArray            *appended,
+                const char        *filter)
+{
+  guint n_visible = self->visible->len;
+  guint n_appended = appended->len;
+  GArray *merged;
+  guint i, j, k;
+
+  if (n_appended == 0)
+    {
+      g_array_unref (appended);
+      return;
+    }
+
+  /* Appended items go last in source order */
+  if (!self->sorted)
+    {
+      ensure_visible_writable (self);
+      g_array_append_vals (self->visible, appended->data, n_appended);
+      g_array_unref (appended);
+
+      g_list_model_items_changed (G_LIST_MODEL (self), n_visible, 0, n_appended);
+      return;
+    }
+
+  merged = g_array_sized_new (FALSE, FALSE, sizeof (guint), n_visible + n_appended);
+  g_array_set_size (merged, n_visible + n_appended);
+
+  for (i = 0, j = 0, k = 0; i < n_visible && j < n_appended; k ++)
+    {
+      guint *a = &g_array_index (self->visible, guint, i);
+      guint *b = &g_array_index (appended, guint, j);
+
+      if (compare_positions (a, b, self->keys) <= 0)
+        {
+          g_array_index (merged, guint, k) = *a;
+          i ++;
+        }
+      else
+        {
+          g_array_index (merged, guint, k) = *b;
+          j ++;
+        }
+    }
+
+  for (; i < n_visible; i ++, k ++)
+    g_array_index (merged, guint, k) = g_array_index (self->visible, guint, i);
+
+  for (; j < n_appended; j ++, k ++)
+    g_array_index (merged, guint, k) = g_array_index (appended, guint, j);
+
+  g_array_unref (appended);
+  publish (self, merged, filter);
+}
+
+static void flush_changes (GdSortFilterModel *self);
+
+static void
+sort_filter_done (GObject      *source_object,
+                  GAsyncResult *result,
+                  gpointer      user_data)
+{
+  GdSortFilterModel *self = GD_SORT_FILTER_MODEL (source_object);
+  Job *job = g_task_get_task_data (G_TASK (result));
+  GArray *positions;
+  guint i;
+
+  /* The job doesn't read anything anymore, cancelled or not */
+  if (job->keys == self->keys)
+    self->keys_readers --;
+  if (job->candidates != NULL && job->candidates == self->visible)
+    self->visible_readers --;
+
+  positions = g_task_propagate_pointer (G_TASK (result), NULL);
+  if (positions == NULL)
+    return;
+
+  /* Something changed in the meantime and another job is running already */
+  if (job->generation != self->generation)
+    {
+      g_array_unref (positions);
+      return;
+    }
+
+  g_clear_object (&self->cancellable);
+
+  if (job->merge)
+    {
+      for (i = 0; i < positions->len; i ++)
+        g_array_index (positions, guint, i) += job->offset;
+
+      merge_appended (self, positions, job->filter);
+    }
+  else
+    {
+      publish (self, positions, job->filter);
+    }
+
+  /* Items might have been appended while the job was running */
+  flush_changes (self);
+}
+
+static void
+cancel_job (GdSortFilterModel *self)
+{
+  if (self->cancellable != NULL)
+    {
+      g_cancellable_cancel (self->cancellable);
+      g_clear_object (&self->cancellable);
+    }
+}
+
+static void
+start_job (GdSortFilterModel *self,
+           Job               *job)
+{
+  GTask *task;
+
+  self->generation ++;
+  job->generation = self->generation;
+
+  self->cancellable = g_cancellable_new ();
+  task = g_task_new (self, self->cancellable, sort_filter_done, NULL);
+  g_task_set_task_data (task, job, job_free);
+  g_task_run_in_thread (task, sort_filter_thread);
+  g_object_unref (task);
+}
+
+static void
+clear_pending (GdSortFilterModel *self)
+{
+  self->appended_from = G_MAXUINT;
+  self->needs_full = FALSE;
+
+  if (self->flush_id != 0)
+    {
+      g_source_remove (self->flush_id);
+      self->flush_id = 0;
+    }
+}
+
+static void
+update (GdSortFilterModel *self,
+        GArray            *candidates)
+{
+  Job *job;
+
+  cancel_job (self);
+  clear_pending (self);
+
+  /* The source order is our order, nothing to do on another thread */
+  if (!self->sorted && self->filter == NULL)
+    {
+      if (candidates)
+        g_array_unref (candidates);
+
+      self->generation ++;
+      publish (self, identity_positions (self->keys->len), NULL);
+      return;
+    }
+
+  job = g_slice_new0 (Job);
+  job->keys = g_ptr_array_ref (self->keys);
+  self->keys_readers ++;
+  job->candidates = candidates;
+  if (candidates != NULL)
+    self->visible_readers ++;
+  /* Candidates are always in the right order already */
+  job->sort = self->sorted && candidates == NULL;
+  job->filter = g_strdup (self->filter);
+
+  start_job (self, job);
+}
+
+/* Filters and sorts only the items from @appended_from on, the result gets
+ * merged into @visible. The job gets its own array with just their keys. */
+static void
+update_appended (GdSortFilterModel *self)
+{
+  Job *job;
+  guint i;
+
+  job = g_slice_new0 (Job);
+  job->keys = g_ptr_array_new_full (self->keys->len - self->appended_from, item_key_unref);
+  for (i = self->appended_from; i < self->keys->len; i ++)
+    g_ptr_array_add (job->keys, item_key_ref (KEY (self->keys, i)));
+  job->merge = TRUE;
+  job->offset = self->appended_from;
+  job->sort = self->sorted;
+  job->filter = g_strdup (self->filter);
+
+  self->appended_from = G_MAXUINT;
+  start_job (self, job);
+}
+
+/* Starts a job for the source changes collected so far, unless one is
+ * running already. sort_filter_done() calls this again then. */
+static void
+flush_changes (GdSortFilterModel *self)
+{
+  if (self->cancellable != NULL)
+    return;
+
+  if (self->needs_full)
+    update (self, NULL);
+  else if (self->appended_from != G_MAXUINT)
+    update_appended (self);
+}
+
+static gboolean
+flush_changes_idle_cb (gpointer user_data)
+{
+  GdSortFilterModel *self = user_data;
+
+  self->flush_id = 0;
+  flush_changes (self);
+
+  return G_SOURCE_REMOVE;
+}
+
+static void
+queue_flush_changes (GdSortFilterModel *self)
+{
+  if (self->flush_id == 0)
+    self->flush_id = g_idle_add_full (G_PRIORITY_DEFAULT_IDLE, flush_changes_idle_cb, self, NULL);
+}
+/* }}} */
+
+/* Source changes {{{ */
+static void
+splice_keys (GdSortFilterModel *self,
+             guint              position,
+             guint              removed,
+             guint              added)
+{
+  guint n_keys;
+  guint i;
+
+  ensure_keys_writable (self);
+
+  if (removed > 0)
+    g_ptr_array_remove_range (self->keys, position, removed);
+
+  if (added == 0)
+    return;
+
+  n_keys = self->keys->len;
+  g_ptr_array_set_size (self->keys, n_keys + added);
+  memmove (&self->keys->pdata[position + added],
+           &self->keys->pdata[position],
+           (n_keys - position) * sizeof (gpointer));
+
+  for (i = position; i < position + added; i ++)
+    {
+      gpointer item = g_list_model_get_item (self->source, i);
+      char *text = self->key_func (item, self->key_func_data);
+
+      self->keys->pdata[i] = item_key_new (text);
+
+      g_free (text);
+      g_object_unref (item);
+    }
+}
+
+/* Removed items can be dropped from @visible right away, which doesn't change
+ * the order of the others. The positions after them move. */
+static void
+splice_visible (GdSortFilterModel *self,
+                guint              position,
+                guint              removed,
+                guint              added)
+{
+  guint first_dropped = G_MAXUINT;
+  guint last_dropped = 0;
+  guint n_dropped = 0;
+  guint i, j;
+
+  ensure_visible_writable (self);
+
+  for (i = 0, j = 0; i < self->visible->len; i ++)
+    {
+      guint pos = g_array_index (self->visible, guint, i);
+
+      if (pos >= position && pos < position + removed)
+        {
+          first_dropped = MIN (first_dropped, i);
+          last_dropped = i;
+          n_dropped ++;
+          continue;
+        }
+
+      if (pos >= position + removed)
+        pos = pos - removed + added;
+
+      g_array_index (self->visible, guint, j) = pos;
+      j ++;
+    }
+
+  g_array_set_size (self->visible, j);
+
+  if (n_dropped > 0)
+    g_list_model_items_changed (G_LIST_MODEL (self),
+                                first_dropped,
+                                last_dropped - first_dropped + 1,
+                                last_dropped - first_dropped + 1 - n_dropped);
+}
+
+static void
+source_items_changed_cb (GListModel *source,
+                         guint       position,
+                         guint       removed,
+                         guint       added,
+                         gpointer    user_data)
+{
+  GdSortFilterModel *self = user_data;
+  gboolean appended = removed == 0 && position == self->keys->len;
+  guint i;
+
+  if (removed == 0 && added == 0)
+    return;
+
+  splice_keys (self, position, removed, added);
+
+  /* Appending to the source doesn't move any position */
+  if (!appended)
+    splice_visible (self, position, removed, added);
+
+  /* The source order is our order, so added items can go in right away */
+  if (!self->sorted && self->filter == NULL)
+    {
+      guint n_visible = self->visible->len;
+
+      if (added == 0)
+        return;
+
+      ensure_visible_writable (self);
+      g_array_set_size (self->visible, n_visible + added);
+      memmove (&g_array_index (self->visible, guint, position + added),
+               &g_array_index (self->visible, guint, position),
+               (n_visible - position) * sizeof (guint));
+      for (i = position; i < position + added; i ++)
+        g_array_index (self->visible, guint, i) = i;
+
+      g_list_model_items_changed (G_LIST_MODEL (self), position, 0, added);
+      return;
+    }
+
+  /* The running job works with positions that just changed. Appending keeps
+   * them valid, the appended items just get merged in afterwards. */
+  if (self->cancellable != NULL && !appended)
+    {
+      cancel_job (self);
+      self->needs_full = TRUE;
+    }
+
+  if (self->appended_from != G_MAXUINT && position < self->appended_from)
+    {
+      if (position + removed <= self->appended_from)
+        self->appended_from -= removed;
+      else
+        self->appended_from = position;
+    }
+
+  if (added > 0)
+    {
+      if (position + added == self->keys->len)
+        self->appended_from = MIN (self->appended_from, position);
+      else
+        self->needs_full = TRUE;
+    }
+
+  if (self->needs_full || self->appended_from != G_MAXUINT)
+    queue_flush_changes (self);
+}
+/* }}} */
+
+/* GListModel {{{ */
+static GType
+gd_sort_filter_model_get_item_type (GListModel *model)
+{
+  GdSortFilterModel *self = GD_SORT_FILTER_MODEL (model);
+
+  return g_list_model_get_item_type (self->source);
+}
+
+static guint
+gd_sort_filter_model_get_n_items (GListModel *model)
+{
+  GdSortFilterModel *self = GD_SORT_FILTER_MODEL (model);
+
+  return self->visible->len;
+}
+
+static gpointer
+gd_sort_filter_model_get_item (GListModel *model,
+                               guint       position)
+{
+  GdSortFilterModel *self = GD_SORT_FILTER_MODEL (model);
+
+  if (position >= self->visible->len)
+    return NULL;
+
+  return g_list_model_get_item (self->source, g_array_index (self->visible, guint, position));
+}
+
+static void
+gd_sort_filter_model_list_model_init (GListModelInterface *iface)
+{
+  iface->get_item_type = gd_sort_filter_model_get_item_type;
+  iface->get_n_items   = gd_sort_filter_model_get_n_items;
+  iface->get_item      = gd_sort_filter_model_get_item;
+}
+/* }}} */
+
+static void
+gd_sort_filter_model_finalize (GObject *object)
+{
+  GdSortFilterModel *self = GD_SORT_FILTER_MODEL (object);
+
+  /* Running jobs keep a reference on us, so there are none */
+  g_assert (self->cancellable == NULL);
+
+  clear_pending (self);
+
+  g_signal_handlers_disconnect_by_func (self->source, source_items_changed_cb, self);
+  g_object_unref (self->source);
+
+  if (self->key_func_destroy)
+    self->key_func_destroy (self->key_func_data);
+
+  g_ptr_array_unref (self->keys);
+  g_array_unref (self->visible);
+  g_free (self->visible_filter);
+  g_free (self->filter);
+
+  G_OBJECT_CLASS (gd_sort_filter_model_parent_class)->finalize (object);
+}
+
+static void
+gd_sort_filter_model_class_init (GdSortFilterModelClass *class)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (class);
+
+  object_class->finalize = gd_sort_filter_model_finalize;
+}
+
+static void
+gd_sort_filter_model_init (GdSortFilterModel *self)
+{
+  self->keys = g_ptr_array_new_with_free_func (item_key_unref);
+  self->visible = g_array_new (FALSE, FALSE, sizeof (guint));
+  self->appended_from = G_MAXUINT;
+}
+
+/**
+ * gd_sort_filter_model_new:
+ * @source: The model to sort and filter
+ * @key_func: Returns the string to sort and filter an item by
+ *
+ * Creates a new sort/filter model on top of @source. It starts out unsorted and
+ * unfiltered, i.e. showing all items of @source in order.
+ */
+GdSortFilterModel *
+gd_sort_filter_model_new (GListModel          *source,
+                          GdSortFilterKeyFunc  key_func,
+                          gpointer             user_data,
+                          GDestroyNotify       user_destroy)
+{
+  GdSortFilterModel *self;
+
+  g_return_val_if_fail (G_IS_LIST_MODEL (source), NULL);
+  g_return_val_if_fail (key_func != NULL, NULL);
+
+  self = g_object_new (GD_TYPE_SORT_FILTER_MODEL, NULL);
+  self->source = g_object_ref (source);
+  self->key_func = key_func;
+  self->key_func_data = user_data;
+  self->key_func_destroy = user_destroy;
+
+  g_signal_connect (source, "items-changed", G_CALLBACK (source_items_changed_cb), self);
+  source_items_changed_cb (source, 0, 0, g_list_model_get_n_items (source), self);
+
+  return self;
+}
+
+void
+gd_sort_filter_model_set_sorted (GdSortFilterModel *self,
+                                 gboolean           sorted)
+{
+  g_return_if_fail (GD_IS_SORT_FILTER_MODEL (self));
+
+  sorted = !!sorted;
+  if (sorted == self->sorted)
+    return;
+
+  self->sorted = sorted;
+  update (self, NULL);
+}
+
+gboolean
+gd_sort_filter_model_get_sorted (GdSortFilterModel *self)
+{
+  g_return_val_if_fail (GD_IS_SORT_FILTER_MODEL (self), FALSE);
+
+  return self->sorted;
+}
+
+/**
+ * gd_sort_filter_model_set_filter_text:
+ * @text: (nullable): Only show items whose key contains this, case-insensitively
+ */
+void
+gd_sort_filter_model_set_filter_text (GdSortFilterModel *self,
+                                      const char        *text)
+{
+  GArray *candidates = NULL;
+  char *filter;
+
+  g_return_if_fail (GD_IS_SORT_FILTER_MODEL (self));
+
+  filter = normalize_filter (text);
+  if (g_strcmp0 (filter, self->filter) == 0)
+    {
+      g_free (filter);
+      return;
+    }
+
+  /* If the new filter is more specific than the one @visible was made with,
+   * everything matching it is in @visible already */
+  if (filter != NULL &&
+      self->cancellable == NULL &&
+      self->appended_from == G_MAXUINT &&
+      !self->needs_full &&
+      (self->visible_filter == NULL || strstr (filter, self->visible_filter) != NULL))
+    candidates = g_array_ref (self->visible);
+
+  g_free (self->filter);
+  self->filter = filter;
+
+  update (self, candidates);
+}
+
+/* Whether a sort or filter job is running or queued and the model contents
+ * will change */
+gboolean
+gd_sort_filter_model_is_pending (GdSortFilterModel *self)
+{
+  g_return_val_if_fail (GD_IS_SORT_FILTER_MODEL (self), FALSE);
+
+  return self->cancellable != NULL || self->flush_id != 0;
+}
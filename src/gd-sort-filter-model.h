@@ -0,0 +1,26 @@
+#ifndef _GD_SORT_FILTER_MODEL_H_
+#define _GD_SORT_FILTER_MODEL_H_
+
+#include <gio/gio.h>
+
+/* Returns a newly allocated UTF-8 string for @item that is used for both sorting
+ * and filtering. Called on the main thread, once per item. */
+typedef char * (*GdSortFilterKeyFunc) (gpointer item,
+                                       gpointer user_data);
+
+#define GD_TYPE_SORT_FILTER_MODEL gd_sort_filter_model_get_type ()
+
+G_DECLARE_FINAL_TYPE (GdSortFilterModel, gd_sort_filter_model, GD, SORT_FILTER_MODEL, GObject)
+
+GdSortFilterModel * gd_sort_filter_model_new             (GListModel          *source,
+                                                          GdSortFilterKeyFunc  key_func,
+                                                          gpointer             user_data,
+                                                          GDestroyNotify       user_destroy);
+void                gd_sort_filter_model_set_sorted      (GdSortFilterModel   *self,
+                                                          gboolean             sorted);
+gboolean            gd_sort_filter_model_get_sorted      (GdSortFilterModel   *self);
+void                gd_sort_filter_model_set_filter_text (GdSortFilterModel   *self,
+                                                          const char          *text);
+gboolean            gd_sort_filter_model_is_pending      (GdSortFilterModel   *self);
+
+#endif
@@ -0,0 +1,522 @@
+/*
+ *  Copyright 2017 Timm Bäder
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "gd-text-file-model.h"
+
+#include <string.h>
+
+/*
+ * A GListModel of the lines of a text file.
+ *
+ * The file is memory-mapped and split into chunks that are scanned for line
+ * breaks on worker threads (memchr() being about as fast as that gets). Chunks
+ * are published to the model in order as soon as they and all chunks before
+ * them are done, so the first lines are available right away while the rest of
+ * the file is still being indexed.
+ *
+ * Items are GdTextLine objects pointing into the mapping, nothing gets copied.
+ * Lines are only ever appended, so while a line is alive, asking for it again
+ * returns the same object. That's how GdModelListBox tells that a pooled row
+ * still shows it.
+ */
+
+#define CHUNK_SIZE (8 * 1024 * 1024)
+
+typedef struct
+{
+  volatile gint ref_count;
+
+  GMappedFile *file;
+  const char *contents;
+  gsize size;
+
+  guint n_chunks;
+  /* guint64 line offsets per chunk, set by the scanning thread */
+  GArray **chunk_lines;
+
+  GMutex mutex;
+  GdTextFileModel *model;
+  guint idle_id;
+  guint n_published;
+  gboolean cancelled;
+} Scan;
+
+typedef struct
+{
+  Scan *scan;
+  guint index;
+} ScanChunk;
+
+struct _GdTextFileModel
+{
+  GObject parent_instance;
+
+  GMappedFile *file;
+  const char *contents;
+  gsize size;
+
+  /* guint64 offset of the start of each line */
+  GArray *lines;
+  /* Line number → live GdTextLine, not owning them */
+  GHashTable *items;
+
+  Scan *scan;
+};
+
+struct _GdTextLine
+{
+  GObject parent_instance;
+
+  GMappedFile *file;
+  const char *text;
+  gsize length;
+  guint number;
+};
+
+static void gd_text_file_model_list_model_init (GListModelInterface *iface);
+
+G_DEFINE_TYPE_WITH_CODE (GdTextFileModel, gd_text_file_model, G_TYPE_OBJECT,
+                         G_IMPLEMENT_INTERFACE (G_TYPE_LIST_MODEL, gd_text_file_model_list_model_init))
+
+G_DEFINE_TYPE (GdTextLine, gd_text_line, G_TYPE_OBJECT)
+
+/* GdTextLine {{{ */
+static void
+gd_text_line_finalize (GObject *object)
+{
+  GdTextLine *line = GD_TEXT_LINE (object);
+
+  g_mapped_file_unref (line->file);
+
+  G_OBJECT_CLASS (gd_text_line_parent_class)->finalize (object);
+}
+
+static void
+gd_text_line_class_init (GdTextLineClass *class)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (class);
+
+  object_class->finalize = gd_text_line_finalize;
+}
+
+static void
+gd_text_line_init (GdTextLine *line)
+{
+}
+
+/**
+ * gd_text_line_get_text:
+ * @length: (out): Return location for the length of the text in bytes
+ *
+ * Returns: (transfer none): The text of @line, without the line break.
+ *   It is NOT nul-terminated.
+ */
+const char *
+gd_text_line_get_text (GdTextLine *line,
+                       gsize      *length)
+{
+  g_return_val_if_fail (GD_IS_TEXT_LINE (line), NULL);
+  g_return_val_if_fail (length != NULL, NULL);
+
+  *length = line->length;
+
+  return line->text;
+}
+
+char *
+gd_text_line_dup_text (GdTextLine *line)
+{
+  g_return_val_if_fail (GD_IS_TEXT_LINE (line), NULL);
+
+  return g_strndup (line->text, line->length);
+}
+
+/* 0-based */
+guint
+gd_text_line_get_number (GdTextLine *line)
+{
+  g_return_val_if_fail (GD_IS_TEXT_LINE (line), 0);
+
+  return line->number;
+}
+/* }}} */
+
+/* Scanning {{{ */
+static Scan *
+scan_ref (Scan *scan)
+{
+  g_atomic_int_inc (&scan->ref_count);
+
+  return scan;
+}
+
+static void
+scan_unref (gpointer data)
+{
+  Scan *scan = data;
+  guint i;
+
+  if (!g_atomic_int_dec_and_test (&scan->ref_count))
+    return;
+
+  for (i = 0; i < scan->n_chunks; i ++)
+    if (scan->chunk_lines[i] != NULL)
+      g_array_unref (scan->chunk_lines[i]);
+
+  g_free (scan->chunk_lines);
+  g_mutex_clear (&scan->mutex);
+  g_mapped_file_unref (scan->file);
+  g_slice_free (Scan, scan);
+}
+
+static GArray *
+scan_chunk (Scan  *scan,
+            guint  index)
+{
+  GArray *lines = g_array_new (FALSE, FALSE, sizeof (guint64));
+  const char *p = scan->contents + (gsize)index * CHUNK_SIZE;
+  const char *limit = scan->contents + MIN ((gsize)(index + 1) * CHUNK_SIZE, scan->size);
+
+  if (index == 0)
+    {
+      guint64 offset = 0;
+
+      g_array_append_val (lines, offset);
+    }
+
+  while ((p = memchr (p, '\n', limit - p)) != NULL)
+    {
+      guint64 offset = p - scan->contents + 1;
+
+      /* A line break at the very end doesn't start another line */
+      if (offset < scan->size)
+        g_array_append_val (lines, offset);
+
+      p ++;
+    }
+
+  return lines;
+}
+
+/* Main thread. Appends all chunks that are done and have no pending chunk before them */
+static gboolean
+publish_lines_idle (gpointer user_data)
+{
+  Scan *scan = user_data;
+  GdTextFileModel *self;
+  guint old_n_lines;
+
+  g_mutex_lock (&scan->mutex);
+
+  scan->idle_id = 0;
+  self = scan->model;
+
+  if (self == NULL)
+    {
+      g_mutex_unlock (&scan->mutex);
+      return G_SOURCE_REMOVE;
+    }
+
+  old_n_lines = self->lines->len;
+
+  while (scan->n_published < scan->n_chunks &&
+         scan->chunk_lines[scan->n_published] != NULL)
+    {
+      GArray *lines = scan->chunk_lines[scan->n_published];
+
+      g_array_append_vals (self->lines, lines->data, lines->len);
+      g_array_unref (lines);
+      scan->chunk_lines[scan->n_published] = NULL;
+      scan->n_published ++;
+    }
+
+  g_mutex_unlock (&scan->mutex);
+
+  if (self->lines->len > old_n_lines)
+    g_list_model_items_changed (G_LIST_MODEL (self), old_n_lines, 0, self->lines->len - old_n_lines);
+
+  return G_SOURCE_REMOVE;
+}
+
+static void
+scan_chunk_thread_func (gpointer data,
+                        gpointer user_data)
+{
+  ScanChunk *chunk = data;
+  Scan *scan = chunk->scan;
+
+  if (!g_atomic_int_get (&scan->cancelled))
+    {
+      GArray *lines = scan_chunk (scan, chunk->index);
+
+      g_mutex_lock (&scan->mutex);
+      scan->chunk_lines[chunk->index] = lines;
+
+      if (scan->model != NULL && scan->idle_id == 0)
+        scan->idle_id = g_idle_add_full (G_PRIORITY_DEFAULT_IDLE,
+                                         publish_lines_idle,
+                                         scan_ref (scan),
+                                         scan_unref);
+      g_mutex_unlock (&scan->mutex);
+    }
+
+  scan_unref (scan);
+  g_slice_free (ScanChunk, chunk);
+}
+
+static GThreadPool *
+get_scan_pool (void)
+{
+  static GThreadPool *pool = NULL;
+
+  if (g_once_init_enter (&pool))
+    {
+      GThreadPool *new_pool;
+
+      new_pool = g_thread_pool_new (scan_chunk_thread_func, NULL, g_get_num_processors (), FALSE, NULL);
+      g_once_init_leave (&pool, new_pool);
+    }
+
+  return pool;
+}
+
+static void
+start_scan (GdTextFileModel *self)
+{
+  Scan *scan = g_slice_new0 (Scan);
+  guint i;
+
+  scan->ref_count = 1;
+  scan->file = g_mapped_file_ref (self->file);
+  scan->contents = self->contents;
+  scan->size = self->size;
+  scan->n_chunks = (self->size + CHUNK_SIZE - 1) / CHUNK_SIZE;
+  scan->chunk_lines = g_new0 (GArray *, scan->n_chunks);
+  scan->model = self;
+  g_mutex_init (&scan->mutex);
+
+  self->scan = scan;
+
+  if (scan->n_chunks == 0)
+    return;
+
+  /* Do the first chunk right away so the model is never empty for a non-empty file */
+  scan->chunk_lines[0] = scan_chunk (scan, 0);
+  publish_lines_idle (scan);
+
+  for (i = 1; i < scan->n_chunks; i ++)
+    {
+      ScanChunk *chunk = g_slice_new (ScanChunk);
+
+      chunk->scan = scan_ref (scan);
+      chunk->index = i;
+      g_thread_pool_push (get_scan_pool (), chunk, NULL);
+    }
+}
+/* }}} */
+
+/* GListModel {{{ */
+static void
+line_finalized_cb (gpointer  data,
+                   GObject  *where_the_object_was)
+{
+  GdTextFileModel *self = data;
+
+  g_hash_table_remove (self->items, GUINT_TO_POINTER (((GdTextLine *)where_the_object_was)->number));
+}
+
+static GType
+gd_text_file_model_get_item_type (GListModel *model)
+{
+  return GD_TYPE_TEXT_LINE;
+}
+
+static guint
+gd_text_file_model_get_n_items (GListModel *model)
+{
+  GdTextFileModel *self = GD_TEXT_FILE_MODEL (model);
+
+  return self->lines->len;
+}
+
+static gpointer
+gd_text_file_model_get_item (GListModel *model,
+                             guint       position)
+{
+  GdTextFileModel *self = GD_TEXT_FILE_MODEL (model);
+  GdTextLine *line;
+
+  if (position >= self->lines->len)
+    return NULL;
+
+  line = g_hash_table_lookup (self->items, GUINT_TO_POINTER (position));
+  if (line != NULL)
+    return g_object_ref (line);
+
+  line = g_object_new (GD_TYPE_TEXT_LINE, NULL);
+  line->file = g_mapped_file_ref (self->file);
+  line->text = gd_text_file_model_get_line (self, position, &line->length);
+  line->number = position;
+
+  g_hash_table_insert (self->items, GUINT_TO_POINTER (position), line);
+  g_object_weak_ref (G_OBJECT (line), line_finalized_cb, self);
+
+  return line;
+}
+
+static void
+gd_text_file_model_list_model_init (GListModelInterface *iface)
+{
+  iface->get_item_type = gd_text_file_model_get_item_type;
+  iface->get_n_items   = gd_text_file_model_get_n_items;
+  iface->get_item      = gd_text_file_model_get_item;
+}
+/* }}} */
+
+static void
+gd_text_file_model_finalize (GObject *object)
+{
+  GdTextFileModel *self = GD_TEXT_FILE_MODEL (object);
+  GHashTableIter iter;
+  gpointer line;
+
+  if (self->scan != NULL)
+    {
+      g_mutex_lock (&self->scan->mutex);
+      self->scan->model = NULL;
+      g_atomic_int_set (&self->scan->cancelled, TRUE);
+      if (self->scan->idle_id != 0)
+        g_source_remove (self->scan->idle_id);
+      self->scan->idle_id = 0;
+      g_mutex_unlock (&self->scan->mutex);
+
+      scan_unref (self->scan);
+    }
+
+  /* Lines keep the mapping alive, not us */
+  g_hash_table_iter_init (&iter, self->items);
+  while (g_hash_table_iter_next (&iter, NULL, &line))
+    g_object_weak_unref (line, line_finalized_cb, self);
+  g_hash_table_unref (self->items);
+
+  g_array_unref (self->lines);
+  if (self->file != NULL)
+    g_mapped_file_unref (self->file);
+
+  G_OBJECT_CLASS (gd_text_file_model_parent_class)->finalize (object);
+}
+
+static void
+gd_text_file_model_class_init (GdTextFileModelClass *class)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (class);
+
+  object_class->finalize = gd_text_file_model_finalize;
+}
+
+static void
+gd_text_file_model_init (GdTextFileModel *self)
+{
+  self->lines = g_array_new (FALSE, FALSE, sizeof (guint64));
+  self->items = g_hash_table_new (NULL, NULL);
+}
+
+/**
+ * gd_text_file_model_new:
+ *
+ * Maps @filename and starts indexing its lines. The file must not be modified
+ * while the model is alive.
+ *
+ * Returns: (nullable): A new model, or %NULL on error
+ */
+GdTextFileModel *
+gd_text_file_model_new (const char  *filename,
+                        GError     **error)
+{
+  GdTextFileModel *self;
+  GMappedFile *file;
+
+  g_return_val_if_fail (filename != NULL, NULL);
+  g_return_val_if_fail (error == NULL || *error == NULL, NULL);
+
+  file = g_mapped_file_new (filename, FALSE, error);
+  if (file == NULL)
+    return NULL;
+
+  self = g_object_new (GD_TYPE_TEXT_FILE_MODEL, NULL);
+  self->file = file;
+  self->contents = g_mapped_file_get_contents (file);
+  self->size = g_mapped_file_get_length (file);
+
+  start_scan (self);
+
+  return self;
+}
+
+/**
+ * gd_text_file_model_get_line:
+ * @line: 0-based line number
+ * @length: (out): Return location for the length of the line in bytes
+ *
+ * Like gd_text_line_get_text(), without creating an item.
+ *
+ * Returns: (transfer none): The text of @line, without the line break.
+ *   It is NOT nul-terminated.
+ */
+const char *
+gd_text_file_model_get_line (GdTextFileModel *self,
+                             guint            line,
+                             gsize           *length)
+{
+  guint64 start;
+  guint64 end;
+
+  g_return_val_if_fail (GD_IS_TEXT_FILE_MODEL (self), NULL);
+  g_return_val_if_fail (line < self->lines->len, NULL);
+  g_return_val_if_fail (length != NULL, NULL);
+
+  start = g_array_index (self->lines, guint64, line);
+
+  if (line + 1 < self->lines->len)
+    {
+      end = g_array_index (self->lines, guint64, line + 1) - 1;
+    }
+  else
+    {
+      /* The last line we know of, which might end in a chunk still being scanned */
+      const char *newline = memchr (self->contents + start, '\n', self->size - start);
+
+      end = newline != NULL ? (guint64)(newline - self->contents) : self->size;
+    }
+
+  if (end > start && self->contents[end - 1] == '\r')
+    end --;
+
+  *length = end - start;
+
+  return self->contents + start;
+}
+
+/* Whether lines are still being indexed and will be appended to the model */
+gboolean
+gd_text_file_model_is_loading (GdTextFileModel *self)
+{
+  g_return_val_if_fail (GD_IS_TEXT_FILE_MODEL (self), FALSE);
+
+  return self->scan != NULL && self->scan->n_published < self->scan->n_chunks;
+}
@@ -0,0 +1,26 @@
+#ifndef _GD_TEXT_FILE_MODEL_H_
+#define _GD_TEXT_FILE_MODEL_H_
+
+#include <gio/gio.h>
+
+#define GD_TYPE_TEXT_FILE_MODEL gd_text_file_model_get_type ()
+
+G_DECLARE_FINAL_TYPE (GdTextFileModel, gd_text_file_model, GD, TEXT_FILE_MODEL, GObject)
+
+#define GD_TYPE_TEXT_LINE gd_text_line_get_type ()
+
+G_DECLARE_FINAL_TYPE (GdTextLine, gd_text_line, GD, TEXT_LINE, GObject)
+
+GdTextFileModel * gd_text_file_model_new        (const char       *filename,
+                                                 GError          **error);
+const char *      gd_text_file_model_get_line   (GdTextFileModel  *self,
+                                                 guint             line,
+                                                 gsize            *length);
+gboolean          gd_text_file_model_is_loading (GdTextFileModel  *self);
+
+const char *      gd_text_line_get_text         (GdTextLine       *line,
+                                                 gsize            *length);
+char *            gd_text_line_dup_text         (GdTextLine       *line);
+guint             gd_text_line_get_number       (GdTextLine       *line);
+
+#endif
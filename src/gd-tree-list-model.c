@@ -0,0 +1,617 @@
+/*
+ *  Copyright 2017 Timm Bäder
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+
+#include "gd-tree-list-model.h"
+
+#include <string.h>
+
+/*
+ * A GListModel presenting a tree as a flat list of its expanded rows, in
+ * depth-first order.
+ *
+ * Every expanded node keeps a Fenwick tree over the number of rows its
+ * children occupy (1 for the child itself, plus all rows below it if it is
+ * expanded), so mapping a position to a node walks down the tree doing one
+ * O(log n) search per level, and mapping a node to its position sums one
+ * prefix per level on the way up. Expanding or collapsing a node only
+ * updates the prefix sums of its ancestors and emits a single items-changed
+ * for the rows below it. Nothing outside the expanded nodes is ever looked at.
+ *
+ * Children are fetched via the create_func only when a node gets expanded,
+ * and are dropped again, together with all expanded nodes below, when it gets
+ * collapsed.
+ */
+
+typedef struct _TreeNode TreeNode;
+
+struct _TreeNode
+{
+  GdTreeListModel *tree;
+  TreeNode *parent;
+  /* Position of this node in parent->model */
+  guint index;
+
+  GListModel *model;
+  gulong items_changed_id;
+  guint n_children;
+  /* n_children + 1 entries, 1-based */
+  guint *fenwick;
+  /* Expanded children, NULL for all others. Allocated once the first child
+   * gets expanded. */
+  TreeNode **children;
+  /* Number of rows below this node */
+  guint size;
+};
+
+struct _GdTreeListModel
+{
+  GObject parent_instance;
+
+  GdTreeListModelCreateFunc create_func;
+  gpointer create_func_data;
+  GDestroyNotify create_func_destroy;
+
+  /* Always expanded; its rows are all of ours */
+  TreeNode *root;
+};
+
+static void gd_tree_list_model_list_model_init (GListModelInterface *iface);
+
+G_DEFINE_TYPE_WITH_CODE (GdTreeListModel, gd_tree_list_model, G_TYPE_OBJECT,
+                         G_IMPLEMENT_INTERFACE (G_TYPE_LIST_MODEL, gd_tree_list_model_list_model_init))
+
+/* Fenwick trees {{{ */
+/* Sum of the first @n entries */
+static inline guint
+fenwick_prefix (const guint *fenwick,
+                guint        n)
+{
+  guint sum = 0;
+
+  for (; n > 0; n -= n & -n)
+    sum += fenwick[n];
+
+  return sum;
+}
+
+static inline void
+fenwick_add (guint *fenwick,
+             guint  n_entries,
+             guint  index,
+             int    delta)
+{
+  for (index = index + 1; index <= n_entries; index += index & -index)
+    fenwick[index] += delta;
+}
+
+/* Appends an entry of @value to a tree of @n_entries entries, which needs
+ * room for it. No entry before it changes, which is why appends and removals
+ * at the end never need to rebuild the tree. */
+static inline void
+fenwick_append (guint *fenwick,
+                guint  n_entries,
+                guint  value)
+{
+  guint index = n_entries + 1;
+
+  /* fenwick[index] covers the entries (index - lowbit (index), index] */
+  fenwick[index] = value + fenwick_prefix (fenwick, n_entries)
+                         - fenwick_prefix (fenwick, index - (index & -index));
+}
+
+/* Returns the index of the entry covering *offset and makes *offset
+ * relative to the start of that entry. */
+static inline guint
+fenwick_find (const guint *fenwick,
+              guint        n_entries,
+              guint       *offset)
+{
+  guint index = 0;
+  guint mask;
+
+  if (n_entries == 0)
+    return 0;
+
+  for (mask = 1u << (g_bit_storage (n_entries) - 1); mask > 0; mask >>= 1)
+    {
+      guint next = index + mask;
+
+      if (next <= n_entries && fenwick[next] <= *offset)
+        {
+          index = next;
+          *offset -= fenwick[next];
+        }
+    }
+
+  return index;
+}
+/* }}} */
+
+/* Nodes {{{ */
+static void node_items_changed_cb (GListModel *model,
+                                   guint       position,
+                                   guint       removed,
+                                   guint       added,
+                                   gpointer    user_data);
+
+/* Recomputes node->fenwick and node->size from scratch, in O(n_children) */
+static void
+node_rebuild (TreeNode *node)
+{
+  guint n = node->n_children;
+  guint size = 0;
+  guint i;
+
+  node->fenwick = g_renew (guint, node->fenwick, n + 1);
+  node->fenwick[0] = 0;
+
+  for (i = 0; i < n; i ++)
+    {
+      guint rows = 1;
+
+      if (node->children != NULL && node->children[i] != NULL)
+        rows += node->children[i]->size;
+
+      node->fenwick[i + 1] = rows;
+      size += rows;
+    }
+
+  for (i = 1; i <= n; i ++)
+    {
+      guint parent = i + (i & -i);
+
+      if (parent <= n)
+        node->fenwick[parent] += node->fenwick[i];
+    }
+
+  node->size = size;
+}
+
+static TreeNode *
+node_new (GdTreeListModel *tree,
+          TreeNode        *parent,
+          guint            index,
+          GListModel      *model)
+{
+  TreeNode *node = g_slice_new0 (TreeNode);
+
+  node->tree = tree;
+  node->parent = parent;
+  node->index = index;
+  node->model = model;
+  node->n_children = g_list_model_get_n_items (model);
+  node_rebuild (node);
+
+  node->items_changed_id = g_signal_connect (model, "items-changed",
+                                             G_CALLBACK (node_items_changed_cb), node);
+
+  return node;
+}
+
+static void
+node_free (TreeNode *node)
+{
+  guint i;
+
+  g_signal_handler_disconnect (node->model, node->items_changed_id);
+
+  if (node->children != NULL)
+    {
+      for (i = 0; i < node->n_children; i ++)
+        if (node->children[i] != NULL)
+          node_free (node->children[i]);
+
+      g_free (node->children);
+    }
+
+  g_object_unref (node->model);
+  g_free (node->fenwick);
+  g_slice_free (TreeNode, node);
+}
+
+/* Adds @delta rows below the child at @index of @node and all its ancestors */
+static void
+node_add_rows (TreeNode *node,
+               guint     index,
+               int       delta)
+{
+  for (;;)
+    {
+      fenwick_add (node->fenwick, node->n_children, index, delta);
+      node->size += delta;
+
+      if (node->parent == NULL)
+        break;
+
+      index = node->index;
+      node = node->parent;
+    }
+}
+
+/* Position of the first row below @node */
+static guint
+node_get_children_position (TreeNode *node)
+{
+  guint position = 0;
+
+  for (; node->parent != NULL; node = node->parent)
+    position += fenwick_prefix (node->parent->fenwick, node->index) + 1;
+
+  return position;
+}
+
+/* Finds the node whose child is shown at @position */
+static TreeNode *
+lookup (GdTreeListModel *self,
+        guint            position,
+        guint           *child_index)
+{
+  TreeNode *node = self->root;
+
+  g_assert (position < self->root->size);
+
+  for (;;)
+    {
+      guint index = fenwick_find (node->fenwick, node->n_children, &position);
+
+      if (position == 0)
+        {
+          *child_index = index;
+          return node;
+        }
+
+      /* Somewhere below the child, which is then necessarily expanded */
+      position --;
+      node = node->children[index];
+    }
+}
+
+static void
+node_items_changed_cb (GListModel *model,
+                       guint       position,
+                       guint       removed,
+                       guint       added,
+                       gpointer    user_data)
+{
+  TreeNode *node = user_data;
+  guint old_n = node->n_children;
+  guint new_n = old_n - removed + added;
+  guint first_row;
+  guint removed_rows;
+  guint old_size;
+  guint i;
+
+  first_row = fenwick_prefix (node->fenwick, position);
+  removed_rows = fenwick_prefix (node->fenwick, position + removed) - first_row;
+  first_row += node_get_children_position (node);
+
+  if (node->children != NULL)
+    {
+      for (i = position; i < position + removed; i ++)
+        if (node->children[i] != NULL)
+          node_free (node->children[i]);
+
+      if (new_n > old_n)
+        node->children = g_renew (TreeNode *, node->children, new_n);
+
+      memmove (node->children + position + added,
+               node->children + position + removed,
+               (old_n - position - removed) * sizeof (TreeNode *));
+      memset (node->children + position, 0, added * sizeof (TreeNode *));
+
+      if (new_n < old_n)
+        node->children = g_renew (TreeNode *, node->children, new_n);
+
+      for (i = position + added; i < new_n; i ++)
+        if (node->children[i] != NULL)
+          node->children[i]->index = i;
+    }
+
+  old_size = node->size;
+  node->n_children = new_n;
+
+  /* Changes at the end leave all entries before @position as they are,
+   * added children are collapsed and take one row each */
+  if (position + removed == old_n)
+    {
+      node->fenwick = g_renew (guint, node->fenwick, new_n + 1);
+      for (i = position; i < new_n; i ++)
+        fenwick_append (node->fenwick, i, 1);
+
+      node->size = old_size - removed_rows + added;
+    }
+  else
+    {
+      node_rebuild (node);
+    }
+
+  if (node->parent != NULL)
+    node_add_rows (node->parent, node->index, (int)node->size - (int)old_size);
+
+  g_list_model_items_changed (G_LIST_MODEL (node->tree), first_row, removed_rows, added);
+}
+/* }}} */
+
+/* GListModel {{{ */
+static GType
+gd_tree_list_model_get_item_type (GListModel *model)
+{
+  GdTreeListModel *self = GD_TREE_LIST_MODEL (model);
+
+  return g_list_model_get_item_type (self->root->model);
+}
+
+static guint
+gd_tree_list_model_get_n_items (GListModel *model)
+{
+  GdTreeListModel *self = GD_TREE_LIST_MODEL (model);
+
+  return self->root->size;
+}
+
+static gpointer
+gd_tree_list_model_get_item (GListModel *model,
+                             guint       position)
+{
+  GdTreeListModel *self = GD_TREE_LIST_MODEL (model);
+  TreeNode *node;
+  guint index;
+
+  if (position >= self->root->size)
+    return NULL;
+
+  node = lookup (self, position, &index);
+
+  return g_list_model_get_item (node->model, index);
+}
+
+static void
+gd_tree_list_model_list_model_init (GListModelInterface *iface)
+{
+  iface->get_item_type = gd_tree_list_model_get_item_type;
+  iface->get_n_items   = gd_tree_list_model_get_n_items;
+  iface->get_item      = gd_tree_list_model_get_item;
+}
+/* }}} */
+
+static void
+gd_tree_list_model_finalize (GObject *object)
+{
+  GdTreeListModel *self = GD_TREE_LIST_MODEL (object);
+
+  node_free (self->root);
+
+  if (self->create_func_destroy != NULL)
+    self->create_func_destroy (self->create_func_data);
+
+  G_OBJECT_CLASS (gd_tree_list_model_parent_class)->finalize (object);
+}
+
+static void
+gd_tree_list_model_class_init (GdTreeListModelClass *class)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (class);
+
+  object_class->finalize = gd_tree_list_model_finalize;
+}
+
+static void
+gd_tree_list_model_init (GdTreeListModel *self)
+{
+}
+
+/**
+ * gd_tree_list_model_new:
+ * @root: The top level items
+ * @create_func: Called to get the children of an item when it gets expanded
+ */
+GdTreeListModel *
+gd_tree_list_model_new (GListModel                *root,
+                        GdTreeListModelCreateFunc  create_func,
+                        gpointer                   user_data,
+                        GDestroyNotify             user_destroy)
+{
+  GdTreeListModel *self;
+
+  g_return_val_if_fail (G_IS_LIST_MODEL (root), NULL);
+  g_return_val_if_fail (create_func != NULL, NULL);
+
+  self = g_object_new (GD_TYPE_TREE_LIST_MODEL, NULL);
+  self->create_func = create_func;
+  self->create_func_data = user_data;
+  self->create_func_destroy = user_destroy;
+  self->root = node_new (self, NULL, 0, g_object_ref (root));
+
+  return self;
+}
+
+/**
+ * gd_tree_list_model_set_expanded:
+ *
+ * Expands or collapses the item at @position. Expanding an item that has
+ * no children, i.e. create_func returns %NULL or an empty model, does nothing. Collapsing an item also forgets which items
+ * below it were expanded.
+ */
+void
+gd_tree_list_model_set_expanded (GdTreeListModel *self,
+                                 guint            position,
+                                 gboolean         expanded)
+{
+  TreeNode *node;
+  TreeNode *child;
+  guint index;
+  guint n_rows;
+
+  g_return_if_fail (GD_IS_TREE_LIST_MODEL (self));
+  g_return_if_fail (position < self->root->size);
+
+  node = lookup (self, position, &index);
+  child = node->children != NULL ? node->children[index] : NULL;
+
+  if (expanded == (child != NULL))
+    return;
+
+  if (expanded)
+    {
+      gpointer item = g_list_model_get_item (node->model, index);
+      GListModel *model = self->create_func (item, self->create_func_data);
+
+      g_object_unref (item);
+
+      /* Not even a node for empty models, the item stays collapsed */
+      if (model == NULL)
+        return;
+
+      if (g_list_model_get_n_items (model) == 0)
+        {
+          g_object_unref (model);
+          return;
+        }
+
+      if (node->children == NULL)
+        node->children = g_new0 (TreeNode *, node->n_children);
+
+      child = node_new (self, node, index, model);
+      node->children[index] = child;
+      n_rows = child->size;
+
+      node_add_rows (node, index, n_rows);
+      g_list_model_items_changed (G_LIST_MODEL (self), position + 1, 0, n_rows);
+    }
+  else
+    {
+      n_rows = child->size;
+      node->children[index] = NULL;
+      node_free (child);
+
+      node_add_rows (node, index, - (int)n_rows);
+      g_list_model_items_changed (G_LIST_MODEL (self), position + 1, n_rows, 0);
+    }
+}
+
+gboolean
+gd_tree_list_model_get_expanded (GdTreeListModel *self,
+                                 guint            position)
+{
+  TreeNode *node;
+  guint index;
+
+  g_return_val_if_fail (GD_IS_TREE_LIST_MODEL (self), FALSE);
+  g_return_val_if_fail (position < self->root->size, FALSE);
+
+  node = lookup (self, position, &index);
+
+  return node->children != NULL && node->children[index] != NULL;
+}
+
+/**
+ * gd_tree_list_model_get_depth:
+ *
+ * Returns: The depth of the item at @position, 0 for top level items.
+ */
+guint
+gd_tree_list_model_get_depth (GdTreeListModel *self,
+                              guint            position)
+{
+  TreeNode *node;
+  guint index;
+  guint depth = 0;
+
+  g_return_val_if_fail (GD_IS_TREE_LIST_MODEL (self), 0);
+  g_return_val_if_fail (position < self->root->size, 0);
+
+  for (node = lookup (self, position, &index); node->parent != NULL; node = node->parent)
+    depth ++;
+
+  return depth;
+}
+
+/**
+ * gd_tree_list_model_get_path:
+ * @depth: (out): Return location for the number of indices
+ *
+ * Returns: (transfer full): The indices of the item at @position and of all
+ *   its ancestors in their respective models, starting at the top level.
+ */
+guint *
+gd_tree_list_model_get_path (GdTreeListModel *self,
+                             guint            position,
+                             guint           *depth)
+{
+  TreeNode *node;
+  TreeNode *n;
+  guint index;
+  guint *indices;
+  guint i;
+
+  g_return_val_if_fail (GD_IS_TREE_LIST_MODEL (self), NULL);
+  g_return_val_if_fail (position < self->root->size, NULL);
+  g_return_val_if_fail (depth != NULL, NULL);
+
+  node = lookup (self, position, &index);
+
+  *depth = 1;
+  for (n = node; n->parent != NULL; n = n->parent)
+    (*depth) ++;
+
+  indices = g_new (guint, *depth);
+  indices[*depth - 1] = index;
+  for (i = *depth - 1, n = node; n->parent != NULL; n = n->parent)
+    indices[-- i] = n->index;
+
+  return indices;
+}
+
+/**
+ * gd_tree_list_model_get_position_for_path:
+ * @indices: (array length=depth): As returned by gd_tree_list_model_get_path()
+ *
+ * Returns: The position of the item at the given path, or %G_MAXUINT if it
+ *   doesn't exist or one of its ancestors is collapsed.
+ */
+guint
+gd_tree_list_model_get_position_for_path (GdTreeListModel *self,
+                                          const guint     *indices,
+                                          guint            depth)
+{
+  TreeNode *node;
+  guint position = 0;
+  guint i;
+
+  g_return_val_if_fail (GD_IS_TREE_LIST_MODEL (self), G_MAXUINT);
+  g_return_val_if_fail (depth > 0, G_MAXUINT);
+
+  node = self->root;
+  for (i = 0; ; i ++)
+    {
+      if (indices[i] >= node->n_children)
+        return G_MAXUINT;
+
+      position += fenwick_prefix (node->fenwick, indices[i]);
+
+      if (i == depth - 1)
+        return position;
+
+      if (node->children == NULL || node->children[indices[i]] == NULL)
+        return G_MAXUINT;
+
+      node = node->children[indices[i]];
+      position ++;
+    }
+}
@@ -0,0 +1,33 @@
+#ifndef _GD_TREE_LIST_MODEL_H_
+#define _GD_TREE_LIST_MODEL_H_
+
+#include <gio/gio.h>
+
+/* Returns a new reference to a model of @item's children, or %NULL if @item
+ * can't be expanded. Called whenever @item gets expanded. */
+typedef GListModel * (*GdTreeListModelCreateFunc) (gpointer item,
+                                                   gpointer user_data);
+
+#define GD_TYPE_TREE_LIST_MODEL gd_tree_list_model_get_type ()
+
+G_DECLARE_FINAL_TYPE (GdTreeListModel, gd_tree_list_model, GD, TREE_LIST_MODEL, GObject)
+
+GdTreeListModel * gd_tree_list_model_new                   (GListModel                *root,
+                                                            GdTreeListModelCreateFunc  create_func,
+                                                            gpointer                   user_data,
+                                                            GDestroyNotify             user_destroy);
+void              gd_tree_list_model_set_expanded          (GdTreeListModel           *self,
+                                                            guint                      position,
+                                                            gboolean                   expanded);
+gboolean          gd_tree_list_model_get_expanded          (GdTreeListModel           *self,
+                                                            guint                      position);
+guint             gd_tree_list_model_get_depth             (GdTreeListModel           *self,
+                                                            guint                      position);
+guint *           gd_tree_list_model_get_path              (GdTreeListModel           *self,
+                                                            guint                      position,
+                                                            guint                     *depth);
+guint             gd_tree_list_model_get_position_for_path (GdTreeListModel           *self,
+                                                            const guint               *indices,
+                                                            guint                      depth);
+
+#endif
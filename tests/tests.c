@@ -1,5 +1,14 @@
 #include <glib.h>
+#include <glib/gstdio.h>
+#include <string.h>
+#include <unistd.h>
 #include "gd-model-list-box.h"
+#include "gd-sort-filter-model.h"
+#include "gd-array-model.h"
+#include "gd-text-file-model.h"
+#include "gd-column-box.h"
+#include "gd-tree-list-model.h"
+#include "gd-search-index.h"
 
 #define ROW_WIDTH  300
 #define ROW_HEIGHT 100
@@ -658,9 +667,1697 @@ model_change_at_bottom (void)
   gtk_widget_size_allocate (scroller, &fake_alloc, -1);
 }
 
+static void
+model_change_batched (void)
+{
+  GtkWidget *listbox = gd_model_list_box_new ();
+  GtkWidget *scroller = gtk_scrolled_window_new (NULL, NULL);
+  GListStore *store = g_list_store_new (GTK_TYPE_LABEL); // Shrug
+  GdModelListBox *box = GD_MODEL_LIST_BOX (listbox);
+  int min;
+  GtkAllocation fake_alloc;
+  GtkAdjustment *vadjustment;
+  int i;
+
+  gtk_container_add (GTK_CONTAINER (scroller), listbox);
+  g_object_ref_sink (G_OBJECT (scroller));
+
+  vadjustment = gtk_scrolled_window_get_vadjustment (GTK_SCROLLED_WINDOW (scroller));
+
+  gd_model_list_box_set_model (box,
+                               G_LIST_MODEL (store),
+                               label_from_label, NULL, NULL,
+                               NULL, NULL, NULL);
+
+  for (i = 0; i < 10; i ++)
+    {
+      GtkWidget *w = gtk_label_new ("FOO!");
+      g_object_set_data (G_OBJECT (w), "height", GINT_TO_POINTER (ROW_HEIGHT));
+      g_list_store_append (store, w);
+    }
+
+  // Nothing happens before the next layout
+  g_assert_cmpint (box->widgets->len, ==, 0);
+  g_assert_true (box->changes_pending);
+
+  gtk_widget_measure (scroller, GTK_ORIENTATION_HORIZONTAL, -1, &min, NULL, NULL, NULL);
+  fake_alloc.x = 0;
+  fake_alloc.y = 0;
+  fake_alloc.width = MAX (min, 300);
+  fake_alloc.height = 500;
+  gtk_widget_size_allocate (scroller, &fake_alloc, -1);
+
+  g_assert_false (box->changes_pending);
+  g_assert_cmpint (box->widgets->len, ==, 5);
+
+  // Lots of appends below the visible range end up as one splice
+  for (i = 0; i < 1000; i ++)
+    {
+      GtkWidget *w = gtk_label_new ("FOO!");
+      g_object_set_data (G_OBJECT (w), "height", GINT_TO_POINTER (ROW_HEIGHT));
+      g_list_store_append (store, w);
+    }
+  g_assert_true (box->changes_pending);
+  g_assert_cmpuint (box->changes_position, ==, 10);
+  g_assert_cmpuint (box->changes_removed, ==, 0);
+  g_assert_cmpuint (box->changes_added, ==, 1000);
+
+  // Removing the first one as well extends the splice to the top
+  g_list_store_remove (store, 0);
+  g_assert_cmpuint (box->changes_position, ==, 0);
+  g_assert_cmpuint (box->changes_removed, ==, 10);
+  g_assert_cmpuint (box->changes_added, ==, 1009);
+
+  gtk_widget_measure (scroller, GTK_ORIENTATION_HORIZONTAL, -1, &min, NULL, NULL, NULL);
+  gtk_widget_size_allocate (scroller, &fake_alloc, -1);
+
+  g_assert_false (box->changes_pending);
+  g_assert_cmpint (box->widgets->len, ==, 5);
+  g_assert_cmpint ((int)gtk_adjustment_get_upper (vadjustment), ==, 1009 * ROW_HEIGHT);
+
+  g_object_unref (G_OBJECT (scroller));
+}
+
+static void
+stats (void)
+{
+  GtkWidget *listbox = gd_model_list_box_new ();
+  GtkWidget *scroller = gtk_scrolled_window_new (NULL, NULL);
+  GListStore *store = g_list_store_new (GTK_TYPE_LABEL); // Shrug
+  GdModelListBox *box = GD_MODEL_LIST_BOX (listbox);
+  GdModelListBoxStats stats;
+  guint64 height_count;
+  int min;
+  GtkAllocation fake_alloc;
+  GtkAdjustment *vadjustment;
+  int i;
+
+  gtk_container_add (GTK_CONTAINER (scroller), listbox);
+  g_object_ref_sink (G_OBJECT (scroller));
+
+  vadjustment = gtk_scrolled_window_get_vadjustment (GTK_SCROLLED_WINDOW (scroller));
+
+  gd_model_list_box_set_model (GD_MODEL_LIST_BOX (listbox),
+                               G_LIST_MODEL (store),
+                               label_from_label, NULL, NULL,
+                               NULL, NULL, NULL);
+
+  for (i = 0; i < 20; i ++)
+    {
+      GtkWidget *w = gtk_label_new ("FOO!");
+      g_object_set_data (G_OBJECT (w), "height", GINT_TO_POINTER (ROW_HEIGHT));
+      g_list_store_append (store, w);
+    }
+
+  gtk_widget_measure (scroller, GTK_ORIENTATION_HORIZONTAL, -1, &min, NULL, NULL, NULL);
+  fake_alloc.x = 0;
+  fake_alloc.y = 0;
+  fake_alloc.width = MAX (min, 300);
+  fake_alloc.height = 500;
+  gtk_widget_size_allocate (scroller, &fake_alloc, -1);
+
+  // 5 rows visible, all of them newly created
+  gd_model_list_box_get_stats (GD_MODEL_LIST_BOX (listbox), &stats);
+  g_assert_cmpuint (stats.fill_calls, ==, 5);
+  g_assert_cmpuint (stats.widgets_created, ==, 5);
+  g_assert_cmpuint (stats.pool_misses, ==, 5);
+  g_assert_cmpuint (stats.pool_hits, ==, 0);
+  g_assert_cmpuint (stats.rows_realized, ==, 5);
+  g_assert_cmpuint (stats.out_of_sight_resets, ==, 0);
+  g_assert_cmpuint (stats.measure_calls_last_frame, >, 0);
+
+  gd_model_list_box_reset_stats (GD_MODEL_LIST_BOX (listbox));
+
+  // Scroll a bit more than one row. The top row stays in the pool for
+  // its item to come back, so both new rows at the bottom need new widgets.
+  gtk_adjustment_set_value (vadjustment, ROW_HEIGHT + 10);
+  gtk_widget_measure (scroller, GTK_ORIENTATION_HORIZONTAL, -1, &min, NULL, NULL, NULL);
+  gtk_widget_size_allocate (scroller, &fake_alloc, -1);
+
+  gd_model_list_box_get_stats (GD_MODEL_LIST_BOX (listbox), &stats);
+  g_assert_cmpuint (stats.fill_calls, ==, 2);
+  g_assert_cmpuint (stats.pool_hits, ==, 0);
+  g_assert_cmpuint (stats.widgets_created, ==, 2);
+
+  gd_model_list_box_reset_stats (GD_MODEL_LIST_BOX (listbox));
+
+  // And back. The first row gets its old widget back without binding it again,
+  // which doesn't count as another row height for the estimate either
+  height_count = box->height_count;
+  gtk_adjustment_set_value (vadjustment, 0);
+  gtk_widget_measure (scroller, GTK_ORIENTATION_HORIZONTAL, -1, &min, NULL, NULL, NULL);
+  gtk_widget_size_allocate (scroller, &fake_alloc, -1);
+
+  gd_model_list_box_get_stats (GD_MODEL_LIST_BOX (listbox), &stats);
+  g_assert_cmpuint (stats.fill_calls, ==, 0);
+  g_assert_cmpuint (stats.pool_hits, ==, 1);
+  g_assert_cmpuint (stats.affine_hits, ==, 1);
+  g_assert_cmpuint (box->height_count, ==, height_count);
+
+  gd_model_list_box_reset_stats (GD_MODEL_LIST_BOX (listbox));
+
+  // Removing the first row changes the index of all the others,
+  // so they all get bound again
+  g_list_store_remove (store, 0);
+  gtk_widget_measure (scroller, GTK_ORIENTATION_HORIZONTAL, -1, &min, NULL, NULL, NULL);
+  gtk_widget_size_allocate (scroller, &fake_alloc, -1);
+
+  gd_model_list_box_get_stats (GD_MODEL_LIST_BOX (listbox), &stats);
+  g_assert_cmpuint (stats.fill_calls, ==, 5);
+  g_assert_cmpuint (stats.affine_hits, ==, 0);
+
+  // Jump to the very bottom
+  gtk_adjustment_set_value (vadjustment,
+                            gtk_adjustment_get_upper (vadjustment) - gtk_adjustment_get_page_size (vadjustment));
+  gtk_widget_measure (scroller, GTK_ORIENTATION_HORIZONTAL, -1, &min, NULL, NULL, NULL);
+  gtk_widget_size_allocate (scroller, &fake_alloc, -1);
+
+  gd_model_list_box_get_stats (GD_MODEL_LIST_BOX (listbox), &stats);
+  g_assert_cmpuint (stats.out_of_sight_resets, ==, 1);
+
+  g_object_unref (G_OBJECT (scroller));
+}
+
+static void
+count_selection_changed_cb (GdModelListBox *box,
+                            guint           position,
+                            guint           n_items,
+                            gpointer        user_data)
+{
+  GArray *emissions = user_data;
+
+  g_array_append_val (emissions, position);
+  g_array_append_val (emissions, n_items);
+}
+
+static void
+selection (void)
+{
+  GtkWidget *listbox = gd_model_list_box_new ();
+  GdModelListBox *box = GD_MODEL_LIST_BOX (listbox);
+  GListStore *store = g_list_store_new (GTK_TYPE_LABEL); // Shrug
+  GdRangeSet *selection;
+  GArray *emissions;
+  int i;
+
+  g_object_ref_sink (G_OBJECT (listbox));
+
+  gd_model_list_box_set_model (box,
+                               G_LIST_MODEL (store),
+                               label_from_label, NULL, NULL,
+                               NULL, NULL, NULL);
+
+  for (i = 0; i < 100; i ++)
+    g_list_store_append (store, gtk_label_new ("FOO!"));
+
+  selection = gd_model_list_box_get_selection (box);
+  gd_model_list_box_set_selection_mode (box, GD_SELECTION_MULTIPLE);
+
+  gd_model_list_box_select_all (box);
+  g_assert_cmpuint (gd_range_set_get_n_ranges (selection), ==, 1);
+  g_assert_cmpuint (gd_range_set_get_size (selection), ==, 100);
+
+  gd_model_list_box_unselect_range (box, 10, 10);
+  g_assert_cmpuint (gd_range_set_get_n_ranges (selection), ==, 2);
+  g_assert_true (gd_model_list_box_is_selected (box, 9));
+  g_assert_false (gd_model_list_box_is_selected (box, 10));
+  g_assert_false (gd_model_list_box_is_selected (box, 19));
+  g_assert_true (gd_model_list_box_is_selected (box, 20));
+
+  // Unselecting only reports the items that were selected before
+  emissions = g_array_new (FALSE, FALSE, sizeof (guint));
+  g_signal_connect (box, "selection-changed", G_CALLBACK (count_selection_changed_cb), emissions);
+  gd_model_list_box_unselect_range (box, 12, 4);
+  g_assert_cmpuint (emissions->len, ==, 0);
+  gd_model_list_box_unselect_range (box, 5, 20);
+  g_assert_cmpuint (emissions->len, ==, 4);
+  g_assert_cmpuint (g_array_index (emissions, guint, 0), ==, 5);
+  g_assert_cmpuint (g_array_index (emissions, guint, 1), ==, 5);
+  g_assert_cmpuint (g_array_index (emissions, guint, 2), ==, 20);
+  g_assert_cmpuint (g_array_index (emissions, guint, 3), ==, 5);
+  g_signal_handlers_disconnect_by_func (box, count_selection_changed_cb, emissions);
+  g_array_free (emissions, TRUE);
+  gd_model_list_box_select_range (box, 5, 20, FALSE);
+  g_assert_cmpuint (gd_range_set_get_n_ranges (selection), ==, 1);
+
+  // Now only [10, 20) is selected
+  gd_model_list_box_invert_selection (box);
+  g_assert_cmpuint (gd_range_set_get_n_ranges (selection), ==, 1);
+  g_assert_cmpuint (gd_range_set_get_size (selection), ==, 10);
+  g_assert_true (gd_model_list_box_is_selected (box, 10));
+
+  // Removing an item before the selection moves it up...
+  g_list_store_remove (store, 0);
+  g_assert_true (gd_model_list_box_is_selected (box, 9));
+  g_assert_false (gd_model_list_box_is_selected (box, 19));
+
+  // ... removing a selected one shrinks it...
+  g_list_store_remove (store, 10);
+  g_assert_cmpuint (gd_range_set_get_n_ranges (selection), ==, 1);
+  g_assert_cmpuint (gd_range_set_get_size (selection), ==, 9);
+
+  // ... and inserting one in the middle splits it
+  g_list_store_insert (store, 12, gtk_label_new ("FOO!"));
+  g_assert_cmpuint (gd_range_set_get_n_ranges (selection), ==, 2);
+  g_assert_cmpuint (gd_range_set_get_size (selection), ==, 9);
+  g_assert_true (gd_model_list_box_is_selected (box, 11));
+  g_assert_false (gd_model_list_box_is_selected (box, 12));
+  g_assert_true (gd_model_list_box_is_selected (box, 13));
+
+  gd_model_list_box_set_selection_mode (box, GD_SELECTION_SINGLE);
+  g_assert_true (gd_range_set_is_empty (selection));
+  gd_model_list_box_select_item (box, 5, FALSE);
+  gd_model_list_box_select_item (box, 7, FALSE);
+  g_assert_false (gd_model_list_box_is_selected (box, 5));
+  g_assert_true (gd_model_list_box_is_selected (box, 7));
+  g_assert_cmpuint (gd_range_set_get_size (selection), ==, 1);
+
+  g_object_unref (G_OBJECT (listbox));
+}
+
+static char *
+label_key (gpointer item,
+           gpointer user_data)
+{
+  return g_strdup (gtk_label_get_label (GTK_LABEL (item)));
+}
+
+static void
+wait_for_sort_filter (GdSortFilterModel *model)
+{
+  while (gd_sort_filter_model_is_pending (model))
+    g_main_context_iteration (NULL, TRUE);
+}
+
+static const char *
+sort_filter_label (GdSortFilterModel *model,
+                   guint              position)
+{
+  GtkWidget *label = g_list_model_get_item (G_LIST_MODEL (model), position);
+  const char *text = gtk_label_get_label (GTK_LABEL (label));
+
+  g_object_unref (label);
+
+  return text;
+}
+
+static void
+sort_filter (void)
+{
+  GListStore *store = g_list_store_new (GTK_TYPE_LABEL);
+  GdSortFilterModel *model;
+  const char *words[] = { "delta", "Alpha", "charlie", "bravo", "alphabet", "echo" };
+  guint i;
+
+  for (i = 0; i < G_N_ELEMENTS (words); i ++)
+    g_list_store_append (store, gtk_label_new (words[i]));
+
+  model = gd_sort_filter_model_new (G_LIST_MODEL (store), label_key, NULL, NULL);
+
+  // Unsorted and unfiltered, it's just the source model
+  g_assert_false (gd_sort_filter_model_is_pending (model));
+  g_assert_cmpuint (g_list_model_get_n_items (G_LIST_MODEL (model)), ==, G_N_ELEMENTS (words));
+  g_assert_cmpstr (sort_filter_label (model, 0), ==, "delta");
+
+  gd_sort_filter_model_set_sorted (model, TRUE);
+  wait_for_sort_filter (model);
+  g_assert_cmpuint (g_list_model_get_n_items (G_LIST_MODEL (model)), ==, G_N_ELEMENTS (words));
+  g_assert_cmpstr (sort_filter_label (model, 0), ==, "Alpha");
+  g_assert_cmpstr (sort_filter_label (model, 5), ==, "echo");
+
+  gd_sort_filter_model_set_filter_text (model, "AL");
+  wait_for_sort_filter (model);
+  g_assert_cmpuint (g_list_model_get_n_items (G_LIST_MODEL (model)), ==, 2);
+  g_assert_cmpstr (sort_filter_label (model, 0), ==, "Alpha");
+  g_assert_cmpstr (sort_filter_label (model, 1), ==, "alphabet");
+
+  // More specific, only refines the current result
+  gd_sort_filter_model_set_filter_text (model, "alphab");
+  wait_for_sort_filter (model);
+  g_assert_cmpuint (g_list_model_get_n_items (G_LIST_MODEL (model)), ==, 1);
+  g_assert_cmpstr (sort_filter_label (model, 0), ==, "alphabet");
+
+  // Removals from the source are applied right away
+  g_list_store_remove (store, 4);
+  g_assert_false (gd_sort_filter_model_is_pending (model));
+  g_assert_cmpuint (g_list_model_get_n_items (G_LIST_MODEL (model)), ==, 0);
+
+  g_list_store_append (store, gtk_label_new ("Alphabetical"));
+  wait_for_sort_filter (model);
+  g_assert_cmpuint (g_list_model_get_n_items (G_LIST_MODEL (model)), ==, 1);
+
+  gd_sort_filter_model_set_filter_text (model, NULL);
+  wait_for_sort_filter (model);
+  g_assert_cmpuint (g_list_model_get_n_items (G_LIST_MODEL (model)), ==, G_N_ELEMENTS (words));
+  g_assert_cmpstr (sort_filter_label (model, 1), ==, "Alphabetical");
+
+  g_object_unref (model);
+  g_object_unref (store);
+}
+
+static void
+count_items_changed (GListModel *model,
+                     guint       position,
+                     guint       removed,
+                     guint       added,
+                     gpointer    user_data)
+{
+  guint *n_emissions = user_data;
+
+  (*n_emissions) ++;
+}
+
+static void
+sort_filter_append (void)
+{
+  GListStore *store = g_list_store_new (GTK_TYPE_LABEL);
+  GdSortFilterModel *model;
+  guint n_emissions = 0;
+
+  g_list_store_append (store, gtk_label_new ("delta"));
+  g_list_store_append (store, gtk_label_new ("bravo"));
+
+  model = gd_sort_filter_model_new (G_LIST_MODEL (store), label_key, NULL, NULL);
+  gd_sort_filter_model_set_sorted (model, TRUE);
+  gd_sort_filter_model_set_filter_text (model, "a");
+  wait_for_sort_filter (model);
+  g_assert_cmpstr (sort_filter_label (model, 0), ==, "bravo");
+
+  g_signal_connect (model, "items-changed", G_CALLBACK (count_items_changed), &n_emissions);
+
+  // Appended items get collected and merged into the result in one go
+  g_list_store_append (store, gtk_label_new ("charlie"));
+  g_list_store_append (store, gtk_label_new ("echo"));
+  g_list_store_append (store, gtk_label_new ("alpha"));
+  g_assert_true (gd_sort_filter_model_is_pending (model));
+  g_assert_cmpuint (n_emissions, ==, 0);
+  wait_for_sort_filter (model);
+  g_assert_cmpuint (n_emissions, ==, 1);
+  g_assert_cmpuint (g_list_model_get_n_items (G_LIST_MODEL (model)), ==, 4);
+  g_assert_cmpstr (sort_filter_label (model, 0), ==, "alpha");
+  g_assert_cmpstr (sort_filter_label (model, 2), ==, "charlie");
+  g_assert_cmpstr (sort_filter_label (model, 3), ==, "delta");
+
+  // Inserting anywhere else sorts and filters everything again
+  g_list_store_insert (store, 0, gtk_label_new ("beta"));
+  wait_for_sort_filter (model);
+  g_assert_cmpuint (g_list_model_get_n_items (G_LIST_MODEL (model)), ==, 5);
+  g_assert_cmpstr (sort_filter_label (model, 1), ==, "beta");
+
+  // Unsorted, appended items just go last
+  gd_sort_filter_model_set_sorted (model, FALSE);
+  wait_for_sort_filter (model);
+  g_assert_cmpstr (sort_filter_label (model, 0), ==, "beta");
+  g_list_store_append (store, gtk_label_new ("papa"));
+  wait_for_sort_filter (model);
+  g_assert_cmpuint (g_list_model_get_n_items (G_LIST_MODEL (model)), ==, 6);
+  g_assert_cmpstr (sort_filter_label (model, 5), ==, "papa");
+
+  g_signal_handlers_disconnect_by_func (model, count_items_changed, &n_emissions);
+  g_object_unref (model);
+  g_object_unref (store);
+}
+
+typedef struct
+{
+  guint id;
+  int height;
+} TestRecord;
+
+static GtkWidget *
+label_from_record (gpointer  item,
+                   GtkWidget *widget,
+                   guint      item_index,
+                   gpointer   user_data)
+{
+  GdArrayModel *model = user_data;
+  const TestRecord *record = gd_array_model_get_record (model, item_index);
+  char *text;
+
+  g_assert (gd_array_model_item_get_record (item) == record);
+
+  if (widget == NULL)
+    widget = gtk_label_new ("");
+
+  text = g_strdup_printf ("%u", record->id);
+  gtk_label_set_label (GTK_LABEL (widget), text);
+  gtk_widget_set_size_request (widget, ROW_WIDTH, record->height);
+  g_free (text);
+
+  return widget;
+}
+
+static void
+array_model (void)
+{
+  GtkWidget *scroller = gtk_scrolled_window_new (NULL, NULL);
+  GtkWidget *listbox = gd_model_list_box_new ();
+  GdModelListBox *box = GD_MODEL_LIST_BOX (listbox);
+  GdArrayModel *model = gd_array_model_new (sizeof (TestRecord), NULL);
+  TestRecord records[100];
+  GdArrayModelItem *item;
+  GdArrayModelItem *other;
+  GtkAllocation fake_alloc;
+  int min;
+  guint i;
+
+  g_object_ref_sink (G_OBJECT (scroller));
+  gtk_container_add (GTK_CONTAINER (scroller), listbox);
+
+  for (i = 0; i < G_N_ELEMENTS (records); i ++)
+    {
+      records[i].id = i;
+      records[i].height = ROW_HEIGHT;
+    }
+
+  gd_array_model_append (model, records, G_N_ELEMENTS (records));
+  g_assert_cmpuint (g_list_model_get_n_items (G_LIST_MODEL (model)), ==, 100);
+  g_assert_cmpuint (((TestRecord *)gd_array_model_get_record (model, 42))->id, ==, 42);
+
+  gd_model_list_box_set_model (box,
+                               G_LIST_MODEL (model),
+                               label_from_record, model, NULL,
+                               NULL, NULL, NULL);
+  gtk_widget_measure (scroller, GTK_ORIENTATION_HORIZONTAL, -1, &min, NULL, NULL, NULL);
+  fake_alloc.x = 0;
+  fake_alloc.y = 0;
+  fake_alloc.width = MAX (min, ROW_WIDTH);
+  fake_alloc.height = ROW_HEIGHT * 3;
+  gtk_widget_size_allocate (scroller, &fake_alloc, -1);
+  g_assert_cmpint (box->widgets->len, ==, 3);
+
+  // The first row holds on to its item, so that's what we get again
+  item = g_list_model_get_item (G_LIST_MODEL (model), 0);
+  other = g_list_model_get_item (G_LIST_MODEL (model), 0);
+  g_assert_true (item == other);
+  g_object_unref (other);
+
+  // Zero-filled records in the middle
+  gd_array_model_splice (model, 10, 5, NULL, 2);
+  g_assert_cmpuint (g_list_model_get_n_items (G_LIST_MODEL (model)), ==, 97);
+
+  // Which only affects the items after it
+  other = g_list_model_get_item (G_LIST_MODEL (model), 0);
+  g_assert_true (item == other);
+  g_object_unref (other);
+  g_object_unref (item);
+  g_assert_cmpuint (((TestRecord *)gd_array_model_get_record (model, 10))->id, ==, 0);
+  g_assert_cmpuint (((TestRecord *)gd_array_model_get_record (model, 12))->id, ==, 15);
+
+  item = g_list_model_get_item (G_LIST_MODEL (model), 96);
+  g_assert_cmpuint (gd_array_model_item_get_position (item), ==, 96);
+  g_assert_cmpuint (((TestRecord *)gd_array_model_item_get_record (item))->id, ==, 99);
+  g_object_unref (item);
+
+  gd_array_model_remove_all (model);
+  g_assert_cmpuint (g_list_model_get_n_items (G_LIST_MODEL (model)), ==, 0);
+
+  g_object_unref (G_OBJECT (scroller));
+  g_object_unref (model);
+}
+
+static void
+text_file_model (void)
+{
+  const char contents[] = "one\ntwo\r\n\nfour";
+  GdTextFileModel *model;
+  GdTextLine *line;
+  GError *error = NULL;
+  char *filename;
+  const char *text;
+  gsize length;
+  char *dup;
+  int fd;
+
+  fd = g_file_open_tmp ("listbox-test-XXXXXX", &filename, &error);
+  g_assert_no_error (error);
+  close (fd);
+  g_file_set_contents (filename, contents, -1, &error);
+  g_assert_no_error (error);
+
+  model = gd_text_file_model_new (filename, &error);
+  g_assert_no_error (error);
+
+  // Small enough to be indexed right away
+  g_assert_false (gd_text_file_model_is_loading (model));
+  g_assert_cmpuint (g_list_model_get_n_items (G_LIST_MODEL (model)), ==, 4);
+
+  text = gd_text_file_model_get_line (model, 1, &length);
+  g_assert_cmpuint (length, ==, 3);
+  g_assert_true (strncmp (text, "two", 3) == 0);
+
+  text = gd_text_file_model_get_line (model, 2, &length);
+  g_assert_cmpuint (length, ==, 0);
+
+  line = g_list_model_get_item (G_LIST_MODEL (model), 3);
+  g_assert_cmpuint (gd_text_line_get_number (line), ==, 3);
+  dup = gd_text_line_dup_text (line);
+  g_assert_cmpstr (dup, ==, "four");
+  g_free (dup);
+
+  // Lines keep the mapping alive
+  g_object_unref (model);
+  text = gd_text_line_get_text (line, &length);
+  g_assert_cmpuint (length, ==, 4);
+  g_assert_true (strncmp (text, "four", 4) == 0);
+  g_object_unref (line);
+
+  g_unlink (filename);
+  g_free (filename);
+}
+
+static void
+append_rows (GListStore *store,
+             int         n)
+{
+  int i;
+
+  for (i = 0; i < n; i ++)
+    {
+      GtkWidget *w = gtk_label_new ("FOO!");
+      g_object_set_data (G_OBJECT (w), "height", GINT_TO_POINTER (ROW_HEIGHT));
+      g_list_store_append (store, w);
+    }
+}
+
+static void
+follow_tail (void)
+{
+  GtkWidget *listbox = gd_model_list_box_new ();
+  GtkWidget *scroller = gtk_scrolled_window_new (NULL, NULL);
+  GListStore *store = g_list_store_new (GTK_TYPE_LABEL); // Shrug
+  GdModelListBox *box = GD_MODEL_LIST_BOX (listbox);
+  GdModelListBoxStats stats;
+  GtkAllocation fake_alloc;
+  GtkAdjustment *vadjustment;
+  guint64 fill_calls;
+  int min;
+
+  gtk_container_add (GTK_CONTAINER (scroller), listbox);
+  g_object_ref_sink (G_OBJECT (scroller));
+  vadjustment = gtk_scrolled_window_get_vadjustment (GTK_SCROLLED_WINDOW (scroller));
+
+  gd_model_list_box_set_model (box,
+                               G_LIST_MODEL (store),
+                               label_from_label, NULL, NULL,
+                               NULL, NULL, NULL);
+  gd_model_list_box_set_follow_tail (box, TRUE);
+  append_rows (store, 20);
+
+  gtk_widget_measure (scroller, GTK_ORIENTATION_HORIZONTAL, -1, &min, NULL, NULL, NULL);
+  fake_alloc.x = 0;
+  fake_alloc.y = 0;
+  fake_alloc.width = MAX (min, 300);
+  fake_alloc.height = 500;
+  gtk_widget_size_allocate (scroller, &fake_alloc, -1);
+
+  // Scroll to bottom
+  gtk_adjustment_set_value (vadjustment,
+                            gtk_adjustment_get_upper (vadjustment) - gtk_adjustment_get_page_size (vadjustment));
+  gtk_widget_size_allocate (scroller, &fake_alloc, -1);
+  g_assert_cmpint (box->model_to, ==, 20);
+
+  // Appending keeps us at the bottom and only binds the new rows
+  gd_model_list_box_get_stats (box, &stats);
+  fill_calls = stats.fill_calls;
+  append_rows (store, 3);
+  gtk_widget_size_allocate (scroller, &fake_alloc, -1);
+
+  g_assert_cmpint (box->model_to, ==, 23);
+  g_assert_cmpfloat (gtk_adjustment_get_value (vadjustment), ==,
+                     gtk_adjustment_get_upper (vadjustment) - gtk_adjustment_get_page_size (vadjustment));
+  gd_model_list_box_get_stats (box, &stats);
+  g_assert_cmpuint (stats.fill_calls - fill_calls, ==, 3);
+
+  // Scrolling up stops following
+  gtk_adjustment_set_value (vadjustment, 0);
+  gtk_widget_size_allocate (scroller, &fake_alloc, -1);
+  append_rows (store, 2);
+  gtk_widget_size_allocate (scroller, &fake_alloc, -1);
+  g_assert_cmpfloat (gtk_adjustment_get_value (vadjustment), ==, 0);
+  g_assert_cmpint (box->model_from, ==, 0);
+
+  g_object_unref (G_OBJECT (scroller));
+}
+
+static int
+measure_label (gpointer item,
+               guint    item_index,
+               int      width,
+               gpointer user_data)
+{
+  return ROW_HEIGHT;
+}
+
+static void
+snapshot_label (gpointer       item,
+                guint          item_index,
+                GtkSnapshot   *snapshot,
+                int            width,
+                int            height,
+                GtkStateFlags  state,
+                gpointer       user_data)
+{
+}
+
+static void
+widgetless (void)
+{
+  GtkWidget *listbox = gd_model_list_box_new ();
+  GtkWidget *scroller = gtk_scrolled_window_new (NULL, NULL);
+  GListStore *store = g_list_store_new (GTK_TYPE_LABEL); // Shrug
+  GdModelListBox *box = GD_MODEL_LIST_BOX (listbox);
+  GtkAllocation fake_alloc;
+  GtkAdjustment *vadjustment;
+
+  gtk_container_add (GTK_CONTAINER (scroller), listbox);
+  g_object_ref_sink (G_OBJECT (scroller));
+  vadjustment = gtk_scrolled_window_get_vadjustment (GTK_SCROLLED_WINDOW (scroller));
+
+  append_rows (store, 20);
+  gd_model_list_box_set_snapshot_model (box, G_LIST_MODEL (store),
+                                        measure_label, snapshot_label,
+                                        NULL, NULL);
+
+  fake_alloc.x = 0;
+  fake_alloc.y = 0;
+  fake_alloc.width = 300;
+  fake_alloc.height = 500;
+  gtk_widget_size_allocate (scroller, &fake_alloc, -1);
+
+  // Same layout as with widgets, but no children at all
+  g_assert_cmpint (box->widgets->len, ==, 5);
+  g_assert_null (gtk_widget_get_first_child (listbox));
+  g_assert_cmpfloat (gtk_adjustment_get_upper (vadjustment), ==, 20 * ROW_HEIGHT);
+
+  g_assert_cmpuint (gd_model_list_box_get_item_at_y (box, 0), ==, 0);
+  g_assert_cmpuint (gd_model_list_box_get_item_at_y (box, ROW_HEIGHT * 2 + 10), ==, 2);
+
+  gtk_adjustment_set_value (vadjustment, ROW_HEIGHT * 3 + 50);
+  gtk_widget_size_allocate (scroller, &fake_alloc, -1);
+  g_assert_cmpuint (gd_model_list_box_get_item_at_y (box, 0), ==, 3);
+  g_assert_cmpuint (gd_model_list_box_get_item_at_y (box, 60), ==, 4);
+
+  // Back to widgets
+  gd_model_list_box_set_model (box, G_LIST_MODEL (store),
+                               label_from_label, NULL, NULL,
+                               NULL, NULL, NULL);
+  gtk_widget_size_allocate (scroller, &fake_alloc, -1);
+  g_assert_nonnull (gtk_widget_get_first_child (listbox));
+  g_assert_cmpuint (gd_model_list_box_get_item_at_y (box, 0), ==, 0);
+
+  g_object_unref (G_OBJECT (scroller));
+}
+
+static GtkWidget *
+column_box_from_label (gpointer  item,
+                       GtkWidget *widget,
+                       guint      item_index,
+                       gpointer   user_data)
+{
+  GdColumnBox *row;
+  guint i;
+
+  if (widget == NULL)
+    {
+      row = GD_COLUMN_BOX (gd_column_box_new ());
+      for (i = 0; i < 3; i ++)
+        gd_column_box_append (row, gtk_label_new ("X"));
+    }
+  else
+    {
+      row = GD_COLUMN_BOX (widget);
+    }
+
+  // Cells in the first column get wider the further down they are
+  gtk_widget_set_size_request (gd_column_box_get_cell (row, 0), 30 + item_index * 10, ROW_HEIGHT);
+
+  return GTK_WIDGET (row);
+}
+
+static void
+columns (void)
+{
+  GtkWidget *listbox = gd_model_list_box_new ();
+  GtkWidget *scroller = gtk_scrolled_window_new (NULL, NULL);
+  GListStore *store = g_list_store_new (GTK_TYPE_LABEL); // Shrug
+  GdModelListBox *box = GD_MODEL_LIST_BOX (listbox);
+  GtkAllocation fake_alloc;
+  GtkAllocation cell_alloc;
+  GtkWidget *row;
+  int min, nat;
+
+  gtk_container_add (GTK_CONTAINER (scroller), listbox);
+  g_object_ref_sink (G_OBJECT (scroller));
+
+  g_assert_cmpuint (gd_model_list_box_append_column (box, -1, FALSE), ==, 0);
+  g_assert_cmpuint (gd_model_list_box_append_column (box, 50, FALSE), ==, 1);
+  g_assert_cmpuint (gd_model_list_box_append_column (box, -1, TRUE), ==, 2);
+
+  append_rows (store, 20);
+  gd_model_list_box_set_model (box, G_LIST_MODEL (store),
+                               column_box_from_label, NULL, NULL,
+                               NULL, NULL, NULL);
+
+  fake_alloc.x = 0;
+  fake_alloc.y = 0;
+  fake_alloc.width = 400;
+  fake_alloc.height = 500;
+  gtk_widget_size_allocate (scroller, &fake_alloc, -1);
+  g_assert_cmpint (box->widgets->len, ==, 5);
+
+  // Widest of the 5 bound rows, the fixed one, and the expanding one gets the rest
+  g_assert_cmpint (gd_model_list_box_get_column_width (box, 0), ==, 70);
+  g_assert_cmpint (gd_model_list_box_get_column_width (box, 1), ==, 50);
+  g_assert_cmpint (gd_model_list_box_get_column_width (box, 2), ==,
+                   gtk_widget_get_width (listbox) - 120);
+
+  // Every row uses the same widths
+  row = g_ptr_array_index (box->widgets, 0);
+  gtk_widget_get_allocation (gd_column_box_get_cell (GD_COLUMN_BOX (row), 2), &cell_alloc);
+  g_assert_cmpint (cell_alloc.x, ==, 120);
+  row = g_ptr_array_index (box->widgets, 4);
+  gtk_widget_get_allocation (gd_column_box_get_cell (GD_COLUMN_BOX (row), 1), &cell_alloc);
+  g_assert_cmpint (cell_alloc.x, ==, 70);
+  g_assert_cmpint (cell_alloc.width, ==, 50);
+
+  // The list asks for the unexpanded column widths
+  while (box->resize_id != 0)
+    g_main_context_iteration (NULL, TRUE);
+  gtk_widget_measure (listbox, GTK_ORIENTATION_HORIZONTAL, -1, &min, &nat, NULL, NULL);
+  g_assert_cmpint (min, >=, 120);
+  g_assert_cmpint (min, <, gtk_widget_get_width (listbox));
+  g_assert_cmpint (nat, ==, min);
+
+  g_object_unref (G_OBJECT (scroller));
+}
+
+static GtkWidget *
+column_box_with_wrapping (gpointer  item,
+                          GtkWidget *widget,
+                          guint      item_index,
+                          gpointer   user_data)
+{
+  GdColumnBox *row;
+  GtkWidget *label;
+
+  if (widget != NULL)
+    return widget;
+
+  row = GD_COLUMN_BOX (gd_column_box_new ());
+  label = gtk_label_new ("X");
+  gtk_widget_set_size_request (label, 50, -1);
+  gd_column_box_append (row, label);
+
+  label = gtk_label_new ("lorem ipsum dolor sit amet lorem ipsum dolor sit amet "
+                         "lorem ipsum dolor sit amet lorem ipsum dolor sit amet "
+                         "lorem ipsum dolor sit amet lorem ipsum dolor sit amet");
+  gtk_label_set_line_wrap (GTK_LABEL (label), TRUE);
+  gtk_label_set_max_width_chars (GTK_LABEL (label), 10);
+  gd_column_box_append (row, label);
+
+  return GTK_WIDGET (row);
+}
+
+static void
+column_resize (void)
+{
+  GtkWidget *listbox = gd_model_list_box_new ();
+  GtkWidget *scroller = gtk_scrolled_window_new (NULL, NULL);
+  GListStore *store = g_list_store_new (GTK_TYPE_LABEL); // Shrug
+  GdModelListBox *box = GD_MODEL_LIST_BOX (listbox);
+  GtkAllocation fake_alloc;
+  GtkWidget *row;
+  int label_height;
+
+  gtk_container_add (GTK_CONTAINER (scroller), listbox);
+  g_object_ref_sink (G_OBJECT (scroller));
+
+  gd_model_list_box_append_column (box, -1, FALSE);
+  gd_model_list_box_append_column (box, -1, TRUE);
+
+  append_rows (store, 20);
+  gd_model_list_box_set_model (box, G_LIST_MODEL (store),
+                               column_box_with_wrapping, NULL, NULL,
+                               NULL, NULL, NULL);
+
+  fake_alloc.x = 0;
+  fake_alloc.y = 0;
+  fake_alloc.width = 400;
+  fake_alloc.height = 500;
+  gtk_widget_size_allocate (scroller, &fake_alloc, -1);
+
+  // A new fixed column takes width away from the wrapping one, without the
+  // list changing its width. Rows still need to get taller.
+  gd_model_list_box_append_column (box, 150, FALSE);
+  gtk_widget_size_allocate (scroller, &fake_alloc, -1);
+
+  row = g_ptr_array_index (box->widgets, 0);
+  gtk_widget_measure (gd_column_box_get_cell (GD_COLUMN_BOX (row), 1),
+                      GTK_ORIENTATION_VERTICAL,
+                      gd_model_list_box_get_column_width (box, 1),
+                      &label_height, NULL, NULL, NULL);
+  g_assert_cmpint (gtk_widget_get_allocated_height (row), >=, label_height);
+
+  g_object_unref (G_OBJECT (scroller));
+}
+
+static GtkWidget *
+label_with_index_width (gpointer  item,
+                        GtkWidget *widget,
+                        guint      item_index,
+                        gpointer   user_data)
+{
+  widget = label_from_label (item, widget, item_index, user_data);
+  gtk_widget_set_size_request (widget, 100 + item_index * 10, ROW_HEIGHT);
+
+  return widget;
+}
+
+static void
+natural_width (void)
+{
+  GtkWidget *listbox = gd_model_list_box_new ();
+  GtkWidget *scroller = gtk_scrolled_window_new (NULL, NULL);
+  GListStore *store = g_list_store_new (GTK_TYPE_LABEL); // Shrug
+  GdModelListBox *box = GD_MODEL_LIST_BOX (listbox);
+  GdModelListBoxStats stats;
+  GtkAllocation fake_alloc;
+  GtkAdjustment *vadjustment;
+  int min, nat;
+
+  gtk_container_add (GTK_CONTAINER (scroller), listbox);
+  g_object_ref_sink (G_OBJECT (scroller));
+  vadjustment = gtk_scrolled_window_get_vadjustment (GTK_SCROLLED_WINDOW (scroller));
+
+  append_rows (store, 20);
+  gd_model_list_box_set_model (box, G_LIST_MODEL (store),
+                               label_with_index_width, NULL, NULL,
+                               NULL, NULL, NULL);
+
+  fake_alloc.x = 0;
+  fake_alloc.y = 0;
+  fake_alloc.width = 500;
+  fake_alloc.height = 500;
+  gtk_widget_size_allocate (scroller, &fake_alloc, -1);
+
+  // Rows 0 - 4 are bound. Measuring doesn't measure any rows.
+  while (box->resize_id != 0)
+    g_main_context_iteration (NULL, TRUE);
+  gd_model_list_box_get_stats (box, &stats);
+  gtk_widget_measure (listbox, GTK_ORIENTATION_HORIZONTAL, -1, &min, &nat, NULL, NULL);
+  g_assert_cmpint (min, ==, 140);
+  g_assert_cmpint (nat, ==, 140);
+  g_assert_cmpuint (stats.measure_calls, ==, box->stats.measure_calls);
+
+  gtk_adjustment_set_value (vadjustment, ROW_HEIGHT * 10);
+  gtk_widget_size_allocate (scroller, &fake_alloc, -1);
+
+  // The resize for the wider rows happens after size-allocate, not in it
+  g_assert_cmpuint (box->resize_id, !=, 0);
+  while (box->resize_id != 0)
+    g_main_context_iteration (NULL, TRUE);
+  gtk_widget_measure (listbox, GTK_ORIENTATION_HORIZONTAL, -1, &min, &nat, NULL, NULL);
+  g_assert_cmpint (min, ==, 240);
+
+  // Doesn't shrink again
+  gtk_adjustment_set_value (vadjustment, 0);
+  gtk_widget_size_allocate (scroller, &fake_alloc, -1);
+  gtk_widget_measure (listbox, GTK_ORIENTATION_HORIZONTAL, -1, &min, &nat, NULL, NULL);
+  g_assert_cmpint (min, ==, 240);
+
+  gd_model_list_box_set_declared_width (box, 50);
+  gtk_widget_measure (listbox, GTK_ORIENTATION_HORIZONTAL, -1, &min, &nat, NULL, NULL);
+  g_assert_cmpint (min, ==, 50);
+  g_assert_cmpint (nat, ==, 50);
+
+  g_object_unref (G_OBJECT (scroller));
+}
+
+static void
+scroll_state (void)
+{
+  GtkWidget *listbox = gd_model_list_box_new ();
+  GtkWidget *scroller = gtk_scrolled_window_new (NULL, NULL);
+  GListStore *store = g_list_store_new (GTK_TYPE_LABEL); // Shrug
+  GdModelListBox *box = GD_MODEL_LIST_BOX (listbox);
+  GdModelListBoxScrollState state = { 50, 30, ROW_HEIGHT };
+  GdModelListBoxScrollState saved;
+  GdModelListBoxStats stats;
+  GtkAllocation fake_alloc;
+  GtkAllocation row_alloc;
+  GtkAdjustment *vadjustment;
+
+  gtk_container_add (GTK_CONTAINER (scroller), listbox);
+  g_object_ref_sink (G_OBJECT (scroller));
+  vadjustment = gtk_scrolled_window_get_vadjustment (GTK_SCROLLED_WINDOW (scroller));
+
+  append_rows (store, 100);
+  gd_model_list_box_set_model (box, G_LIST_MODEL (store),
+                               label_from_label, NULL, NULL,
+                               NULL, NULL, NULL);
+  gd_model_list_box_set_scroll_state (box, &state);
+
+  fake_alloc.x = 0;
+  fake_alloc.y = 0;
+  fake_alloc.width = 300;
+  fake_alloc.height = 500;
+  gtk_widget_size_allocate (scroller, &fake_alloc, -1);
+
+  // Only the rows at the saved position got bound, without a jump
+  gd_model_list_box_get_stats (box, &stats);
+  g_assert_cmpuint (stats.fill_calls, ==, 6);
+  g_assert_cmpuint (stats.out_of_sight_resets, ==, 0);
+  g_assert_cmpuint (box->model_from, ==, 50);
+  gtk_widget_get_allocation (g_ptr_array_index (box->widgets, 0), &row_alloc);
+  g_assert_cmpint (row_alloc.y, ==, -30);
+  g_assert_cmpfloat (gtk_adjustment_get_value (vadjustment), ==, 50 * ROW_HEIGHT + 30);
+
+  gd_model_list_box_get_scroll_state (box, &saved);
+  g_assert_cmpuint (saved.anchor_index, ==, 50);
+  g_assert_cmpint (saved.anchor_offset, ==, 30);
+  g_assert_cmpint (saved.average_height, ==, ROW_HEIGHT);
+
+  // Close to the end, the rows above the anchor fill up the rest
+  state.anchor_index = 98;
+  state.anchor_offset = 0;
+  gd_model_list_box_set_scroll_state (box, &state);
+  gtk_widget_size_allocate (scroller, &fake_alloc, -1);
+  g_assert_cmpuint (box->model_to, ==, 100);
+  g_assert_cmpuint (box->model_from, ==, 95);
+
+  g_object_unref (G_OBJECT (scroller));
+}
+
+static GtkWidget *
+create_label (gpointer user_data)
+{
+  return gtk_label_new ("");
+}
+
+static void
+prewarm (void)
+{
+  GtkWidget *listbox = gd_model_list_box_new ();
+  GtkWidget *scroller = gtk_scrolled_window_new (NULL, NULL);
+  GListStore *store = g_list_store_new (GTK_TYPE_LABEL); // Shrug
+  GdModelListBox *box = GD_MODEL_LIST_BOX (listbox);
+  GdModelListBoxStats stats;
+  GtkAllocation fake_alloc;
+
+  gtk_container_add (GTK_CONTAINER (scroller), listbox);
+  g_object_ref_sink (G_OBJECT (scroller));
+
+  // No size yet, so this creates a screen full
+  gd_model_list_box_set_prewarm_func (box, create_label, ROW_HEIGHT, NULL, NULL);
+  while (box->prewarm_id != 0)
+    g_main_context_iteration (NULL, TRUE);
+
+  g_assert_cmpuint (box->pool->len, ==, 1080 / ROW_HEIGHT + 2);
+  g_assert_null (gtk_widget_get_parent (g_ptr_array_index (box->pool, 0)));
+
+  append_rows (store, 20);
+  gd_model_list_box_set_model (box, G_LIST_MODEL (store),
+                               label_from_label, NULL, NULL,
+                               NULL, NULL, NULL);
+
+  fake_alloc.x = 0;
+  fake_alloc.y = 0;
+  fake_alloc.width = 300;
+  fake_alloc.height = 500;
+  gtk_widget_size_allocate (scroller, &fake_alloc, -1);
+
+  // The first layout didn't create anything
+  gd_model_list_box_get_stats (box, &stats);
+  g_assert_cmpuint (stats.fill_calls, ==, 5);
+  g_assert_cmpuint (stats.pool_hits, ==, 5);
+  g_assert_cmpuint (stats.pool_misses, ==, 0);
+  g_assert_cmpuint (stats.widgets_created, ==, 1080 / ROW_HEIGHT + 2);
+  g_assert_true (gtk_widget_get_parent (g_ptr_array_index (box->widgets, 0)) == listbox);
+
+  g_object_unref (G_OBJECT (scroller));
+}
+
+static void
+invalidate_item (void)
+{
+  GtkWidget *listbox = gd_model_list_box_new ();
+  GtkWidget *scroller = gtk_scrolled_window_new (NULL, NULL);
+  GListStore *store = g_list_store_new (GTK_TYPE_LABEL); // Shrug
+  GdModelListBox *box = GD_MODEL_LIST_BOX (listbox);
+  GdModelListBoxStats stats;
+  GtkAllocation fake_alloc;
+  GtkWidget *item;
+  GtkWidget *row;
+
+  gtk_container_add (GTK_CONTAINER (scroller), listbox);
+  g_object_ref_sink (G_OBJECT (scroller));
+
+  append_rows (store, 20);
+  gd_model_list_box_set_model (box, G_LIST_MODEL (store),
+                               label_from_label, NULL, NULL,
+                               NULL, NULL, NULL);
+
+  fake_alloc.x = 0;
+  fake_alloc.y = 0;
+  fake_alloc.width = 300;
+  fake_alloc.height = 500;
+  gtk_widget_size_allocate (scroller, &fake_alloc, -1);
+
+  row = g_ptr_array_index (box->widgets, 2);
+  item = g_list_model_get_item (G_LIST_MODEL (store), 2);
+  gd_model_list_box_reset_stats (box);
+
+  // Same height, so only that one row gets filled again, on the same widget
+  gtk_label_set_label (GTK_LABEL (item), "Changed");
+  gd_model_list_box_invalidate_item (box, 2);
+  gtk_widget_size_allocate (scroller, &fake_alloc, -1);
+
+  gd_model_list_box_get_stats (box, &stats);
+  g_assert_cmpuint (stats.fill_calls, ==, 1);
+  g_assert_cmpuint (stats.widgets_created, ==, 0);
+  g_assert_true (g_ptr_array_index (box->widgets, 2) == row);
+  g_assert_cmpstr (gtk_label_get_label (GTK_LABEL (row)), ==, "Changed");
+
+  // Items outside of the visible range are ignored
+  gd_model_list_box_invalidate_item (box, 19);
+  gd_model_list_box_get_stats (box, &stats);
+  g_assert_cmpuint (stats.fill_calls, ==, 1);
+
+  // A taller row pushes the following ones down
+  g_object_set_data (G_OBJECT (item), "height", GINT_TO_POINTER (ROW_HEIGHT * 2));
+  gd_model_list_box_invalidate_item (box, 2);
+  gtk_widget_size_allocate (scroller, &fake_alloc, -1);
+  g_assert_cmpint (gtk_widget_get_allocated_height (row), ==, ROW_HEIGHT * 2);
+
+  // With auto-invalidation, notify does the same
+  gd_model_list_box_set_auto_invalidate (box, TRUE);
+  gd_model_list_box_reset_stats (box);
+  gtk_label_set_label (GTK_LABEL (item), "Changed again");
+  gtk_widget_size_allocate (scroller, &fake_alloc, -1);
+
+  gd_model_list_box_get_stats (box, &stats);
+  g_assert_cmpuint (stats.fill_calls, >, 0);
+  g_assert_cmpuint (stats.widgets_created, ==, 0);
+  g_assert_true (g_ptr_array_index (box->widgets, 2) == row);
+  g_assert_cmpstr (gtk_label_get_label (GTK_LABEL (row)), ==, "Changed again");
+
+  g_object_unref (item);
+  g_object_unref (G_OBJECT (scroller));
+}
+
+static GListModel *
+tree_children (gpointer item,
+               gpointer user_data)
+{
+  guint n_children = GPOINTER_TO_UINT (g_object_get_data (item, "children"));
+  GListStore *store;
+  guint i;
+
+  // Has children, but none right now
+  if (g_object_get_data (item, "empty") != NULL)
+    return G_LIST_MODEL (g_list_store_new (GTK_TYPE_LABEL));
+
+  if (n_children == 0)
+    return NULL;
+
+  store = g_list_store_new (GTK_TYPE_LABEL);
+  for (i = 0; i < n_children; i ++)
+    {
+      GtkWidget *label = gtk_label_new ("Child");
+
+      // Grandchildren, but only for the first child
+      if (i == 0)
+        g_object_set_data (G_OBJECT (label), "children", GUINT_TO_POINTER (2));
+
+      g_list_store_append (store, label);
+    }
+
+  // So the test can change the children later
+  g_object_set_data_full (item, "store", g_object_ref (store), g_object_unref);
+
+  return G_LIST_MODEL (store);
+}
+
+static void
+tree_list_model (void)
+{
+  GListStore *root = g_list_store_new (GTK_TYPE_LABEL); // Shrug
+  GdTreeListModel *model;
+  GListStore *children;
+  GtkWidget *item;
+  guint n_emissions = 0;
+  guint path[3];
+  guint *indices;
+  guint depth;
+  guint i;
+
+  for (i = 0; i < 3; i ++)
+    {
+      GtkWidget *label = gtk_label_new ("Top");
+      g_object_set_data (G_OBJECT (label), "children", GUINT_TO_POINTER (4));
+      g_list_store_append (root, label);
+    }
+
+  model = gd_tree_list_model_new (G_LIST_MODEL (root), tree_children, NULL, NULL);
+  g_signal_connect (model, "items-changed", G_CALLBACK (count_items_changed), &n_emissions);
+  g_assert_cmpuint (g_list_model_get_n_items (G_LIST_MODEL (model)), ==, 3);
+
+  // Expanding the second top level item inserts its 4 children after it
+  gd_tree_list_model_set_expanded (model, 1, TRUE);
+  g_assert_cmpuint (n_emissions, ==, 1);
+  g_assert_cmpuint (g_list_model_get_n_items (G_LIST_MODEL (model)), ==, 7);
+  g_assert_true (gd_tree_list_model_get_expanded (model, 1));
+  g_assert_cmpuint (gd_tree_list_model_get_depth (model, 2), ==, 1);
+  g_assert_cmpuint (gd_tree_list_model_get_depth (model, 6), ==, 0);
+
+  // And its first child has children of its own
+  gd_tree_list_model_set_expanded (model, 2, TRUE);
+  g_assert_cmpuint (g_list_model_get_n_items (G_LIST_MODEL (model)), ==, 9);
+  g_assert_cmpuint (gd_tree_list_model_get_depth (model, 4), ==, 2);
+
+  indices = gd_tree_list_model_get_path (model, 4, &depth);
+  g_assert_cmpuint (depth, ==, 3);
+  g_assert_cmpuint (indices[0], ==, 1);
+  g_assert_cmpuint (indices[1], ==, 0);
+  g_assert_cmpuint (indices[2], ==, 1);
+  g_assert_cmpuint (gd_tree_list_model_get_position_for_path (model, indices, depth), ==, 4);
+  g_free (indices);
+
+  path[0] = 2;
+  g_assert_cmpuint (gd_tree_list_model_get_position_for_path (model, path, 1), ==, 8);
+  path[0] = 0;
+  path[1] = 0;
+  g_assert_cmpuint (gd_tree_list_model_get_position_for_path (model, path, 2), ==, G_MAXUINT);
+
+  // Items added to an expanded node show up in place
+  item = g_list_model_get_item (G_LIST_MODEL (root), 1);
+  children = g_object_get_data (G_OBJECT (item), "store");
+  n_emissions = 0;
+  g_list_store_append (children, gtk_label_new ("Late child"));
+  g_assert_cmpuint (n_emissions, ==, 1);
+  g_assert_cmpuint (g_list_model_get_n_items (G_LIST_MODEL (model)), ==, 10);
+  g_object_unref (item);
+
+  item = g_list_model_get_item (G_LIST_MODEL (model), 8);
+  g_assert_cmpstr (gtk_label_get_label (GTK_LABEL (item)), ==, "Late child");
+  g_object_unref (item);
+
+  // ... and so do removals
+  n_emissions = 0;
+  g_list_store_remove (children, 4);
+  g_assert_cmpuint (n_emissions, ==, 1);
+  g_assert_cmpuint (g_list_model_get_n_items (G_LIST_MODEL (model)), ==, 9);
+  item = g_list_model_get_item (G_LIST_MODEL (model), 8);
+  g_assert_cmpstr (gtk_label_get_label (GTK_LABEL (item)), ==, "Top");
+  g_object_unref (item);
+  g_assert_cmpuint (gd_tree_list_model_get_depth (model, 7), ==, 1);
+
+  // Collapsing removes everything below, including the expanded grandchild
+  n_emissions = 0;
+  gd_tree_list_model_set_expanded (model, 1, FALSE);
+  g_assert_cmpuint (n_emissions, ==, 1);
+  g_assert_cmpuint (g_list_model_get_n_items (G_LIST_MODEL (model)), ==, 3);
+  g_assert_false (gd_tree_list_model_get_expanded (model, 1));
+
+  // Items without children right now don't get expanded at all
+  item = gtk_label_new ("Empty");
+  g_object_set_data (G_OBJECT (item), "empty", GUINT_TO_POINTER (TRUE));
+  g_list_store_append (root, item);
+  n_emissions = 0;
+  gd_tree_list_model_set_expanded (model, 3, TRUE);
+  g_assert_cmpuint (n_emissions, ==, 0);
+  g_assert_false (gd_tree_list_model_get_expanded (model, 3));
+
+  g_object_unref (model);
+  g_object_unref (root);
+}
+
+static void
+search_index (void)
+{
+  GtkWidget *listbox = gd_model_list_box_new ();
+  GtkWidget *scroller = gtk_scrolled_window_new (NULL, NULL);
+  GListStore *store = g_list_store_new (GTK_TYPE_LABEL); // Shrug
+  GdModelListBox *box = GD_MODEL_LIST_BOX (listbox);
+  GdSearchIndex *index;
+  GtkAllocation fake_alloc;
+  guint i;
+
+  gtk_container_add (GTK_CONTAINER (scroller), listbox);
+  g_object_ref_sink (G_OBJECT (scroller));
+
+  // Enough items to index them on a worker thread
+  for (i = 0; i < 5000; i ++)
+    {
+      char *text = g_strdup_printf ("Item %u", i);
+      GtkWidget *label = gtk_label_new (text);
+
+      g_object_set_data (G_OBJECT (label), "height", GINT_TO_POINTER (ROW_HEIGHT));
+      g_list_store_append (store, label);
+      g_free (text);
+    }
+
+  index = gd_search_index_new (G_LIST_MODEL (store), label_key, NULL, NULL);
+  g_assert_true (gd_search_index_is_building (index));
+
+  // Changes while building are applied to the batch afterwards
+  g_list_store_remove (G_LIST_STORE (store), 0);
+
+  while (gd_search_index_is_building (index))
+    g_main_context_iteration (NULL, TRUE);
+
+  // "Item 1", "Item 10" - "Item 19", ... "Item 1000" - "Item 1999"
+  g_assert_cmpuint (gd_search_index_count (index, "item 1"), ==, 1111);
+  g_assert_cmpuint (gd_search_index_lookup (index, "ITEM 1", 0), ==, 0);
+  g_assert_cmpuint (gd_search_index_lookup (index, "Item 1", 1), ==, 9);
+  g_assert_cmpuint (gd_search_index_lookup (index, "Item 1", 1111), ==, G_MAXUINT);
+  g_assert_cmpuint (gd_search_index_lookup (index, "Item 0", 0), ==, G_MAXUINT);
+  g_assert_cmpuint (gd_search_index_count (index, ""), ==, 4999);
+
+  // Small changes are indexed right away
+  g_list_store_insert (G_LIST_STORE (store), 0, gtk_label_new ("Aardvark"));
+  g_assert_cmpuint (gd_search_index_lookup (index, "aard", 0), ==, 0);
+  g_assert_cmpuint (gd_search_index_lookup (index, "Item 1", 1), ==, 10);
+
+  // Appends get collected into one batch, lookups index them first
+  g_list_store_append (G_LIST_STORE (store), gtk_label_new ("Zebra"));
+  g_list_store_append (G_LIST_STORE (store), gtk_label_new ("Aardwolf"));
+  g_assert_cmpuint (gd_search_index_count (index, "aard"), ==, 2);
+  g_assert_cmpuint (gd_search_index_lookup (index, "aardw", 0), ==, 5001);
+  g_assert_cmpuint (gd_search_index_lookup (index, "zebra", 0), ==, 5000);
+  g_list_store_remove (G_LIST_STORE (store), 5001);
+  g_list_store_remove (G_LIST_STORE (store), 5000);
+  g_assert_cmpuint (gd_search_index_count (index, ""), ==, 5000);
+
+  gd_model_list_box_set_model (box, G_LIST_MODEL (store),
+                               label_from_label, NULL, NULL,
+                               NULL, NULL, NULL);
+  fake_alloc.x = 0;
+  fake_alloc.y = 0;
+  fake_alloc.width = 300;
+  fake_alloc.height = 500;
+  gtk_widget_size_allocate (scroller, &fake_alloc, -1);
+
+  // Jumping to a match binds the rows there, not everything in between
+  gd_model_list_box_scroll_to_item (box, gd_search_index_lookup (index, "item 4321", 0));
+  gtk_widget_size_allocate (scroller, &fake_alloc, -1);
+  g_assert_cmpuint (box->model_from, ==, 4321);
+  g_assert_cmpuint (box->widgets->len, <=, 6);
+
+  // Visible rows don't scroll
+  gd_model_list_box_scroll_to_item (box, 4322);
+  gtk_widget_size_allocate (scroller, &fake_alloc, -1);
+  g_assert_cmpuint (box->model_from, ==, 4321);
+
+  g_object_unref (index);
+  g_object_unref (G_OBJECT (scroller));
+}
+
+static gpointer
+prepare_text (gpointer item,
+              guint    item_index,
+              gpointer user_data)
+{
+  return g_strdup_printf ("Prepared %u", item_index);
+}
+
+static GtkWidget *
+label_from_payload (gpointer   item,
+                    GtkWidget *widget,
+                    guint      item_index,
+                    gpointer   user_data)
+{
+  GtkWidget *label = label_from_label (item, widget, item_index, NULL);
+  const char *text = gd_model_list_box_get_payload (user_data, item_index);
+
+  g_assert_nonnull (text);
+  gtk_label_set_label (GTK_LABEL (label), text);
+
+  return label;
+}
+
+static void
+prepare (void)
+{
+  GtkWidget *listbox = gd_model_list_box_new ();
+  GtkWidget *scroller = gtk_scrolled_window_new (NULL, NULL);
+  GListStore *store = g_list_store_new (GTK_TYPE_LABEL); // Shrug
+  GdModelListBox *box = GD_MODEL_LIST_BOX (listbox);
+  GdModelListBoxStats stats;
+  GtkAllocation fake_alloc;
+  GtkAdjustment *vadjustment;
+
+  gtk_container_add (GTK_CONTAINER (scroller), listbox);
+  g_object_ref_sink (G_OBJECT (scroller));
+  vadjustment = gtk_scrolled_window_get_vadjustment (GTK_SCROLLED_WINDOW (scroller));
+
+  append_rows (store, 100);
+  gd_model_list_box_set_prepare_func (box, prepare_text, g_free, NULL, NULL);
+  gd_model_list_box_set_model (box, G_LIST_MODEL (store),
+                               label_from_payload, box, NULL,
+                               NULL, NULL, NULL);
+
+  fake_alloc.x = 0;
+  fake_alloc.y = 0;
+  fake_alloc.width = 300;
+  fake_alloc.height = 500;
+  gtk_widget_size_allocate (scroller, &fake_alloc, -1);
+
+  // Nothing could be prepared before the first layout
+  gd_model_list_box_get_stats (box, &stats);
+  g_assert_cmpuint (stats.prepare_misses, ==, 5);
+  g_assert_cmpuint (stats.prepare_hits, ==, 0);
+  g_assert_cmpstr (gtk_label_get_label (g_ptr_array_index (box->widgets, 0)), ==, "Prepared 0");
+
+  // The next screen full is being prepared now
+  g_assert_cmpuint (box->prepare_jobs, ==, 5);
+  while (box->prepare_jobs > 0)
+    g_main_context_iteration (NULL, TRUE);
+
+  gd_model_list_box_reset_stats (box);
+  gtk_adjustment_set_value (vadjustment, ROW_HEIGHT * 5);
+  gtk_widget_size_allocate (scroller, &fake_alloc, -1);
+
+  gd_model_list_box_get_stats (box, &stats);
+  g_assert_cmpuint (stats.prepare_hits, ==, 5);
+  g_assert_cmpuint (stats.prepare_misses, ==, 0);
+  g_assert_cmpstr (gtk_label_get_label (g_ptr_array_index (box->widgets, 0)), ==, "Prepared 5");
+
+  // Payloads move with their items
+  while (box->prepare_jobs > 0)
+    g_main_context_iteration (NULL, TRUE);
+  g_list_store_remove (store, 0);
+  g_assert_cmpstr (gd_model_list_box_get_payload (box, 4), ==, "Prepared 5");
+
+  g_object_unref (G_OBJECT (scroller));
+}
+
+static void
+count_removals (GtkWidget *widget,
+                gpointer   item,
+                gpointer   user_data)
+{
+  guint *n_removals = user_data;
+
+  (*n_removals) ++;
+}
+
+static void
+out_of_sight_teleport (void)
+{
+  GtkWidget *listbox = gd_model_list_box_new ();
+  GtkWidget *scroller = gtk_scrolled_window_new (NULL, NULL);
+  GListStore *store = g_list_store_new (GTK_TYPE_LABEL); // Shrug
+  GdModelListBox *box = GD_MODEL_LIST_BOX (listbox);
+  GdModelListBoxStats stats;
+  GtkAllocation fake_alloc;
+  GtkAdjustment *vadjustment;
+  GPtrArray *rows_before;
+  guint n_removals = 0;
+  guint i;
+
+  gtk_container_add (GTK_CONTAINER (scroller), listbox);
+  g_object_ref_sink (G_OBJECT (scroller));
+  vadjustment = gtk_scrolled_window_get_vadjustment (GTK_SCROLLED_WINDOW (scroller));
+
+  append_rows (store, 100);
+  gd_model_list_box_set_model (box, G_LIST_MODEL (store),
+                               label_from_label, NULL, NULL,
+                               count_removals, &n_removals, NULL);
+
+  fake_alloc.x = 0;
+  fake_alloc.y = 0;
+  fake_alloc.width = 300;
+  fake_alloc.height = 500;
+  gtk_widget_size_allocate (scroller, &fake_alloc, -1);
+
+  rows_before = g_ptr_array_new ();
+  for (i = 0; i < box->widgets->len; i ++)
+    g_ptr_array_add (rows_before, g_ptr_array_index (box->widgets, i));
+
+  gd_model_list_box_reset_stats (box);
+
+  // Way out of sight
+  gtk_adjustment_set_value (vadjustment, ROW_HEIGHT * 50);
+  gtk_widget_size_allocate (scroller, &fake_alloc, -1);
+
+  gd_model_list_box_get_stats (box, &stats);
+  g_assert_cmpuint (stats.out_of_sight_resets, ==, 1);
+  g_assert_cmpuint (stats.widgets_created, ==, 0);
+  g_assert_cmpuint (stats.rows_teleported, ==, rows_before->len);
+  g_assert_cmpuint (n_removals, ==, rows_before->len);
+  g_assert_cmpuint (box->model_from, >, 0);
+
+  // The same widgets show the new rows, they never left
+  g_assert_cmpuint (box->widgets->len, ==, rows_before->len);
+  g_assert_cmpuint (box->pool->len, ==, 0);
+  for (i = 0; i < box->widgets->len; i ++)
+    {
+      GtkWidget *row = g_ptr_array_index (box->widgets, i);
+
+      g_assert_true (g_ptr_array_find (rows_before, row, NULL));
+      g_assert_true (gtk_widget_get_child_visible (row));
+    }
+
+  g_ptr_array_unref (rows_before);
+  g_object_unref (G_OBJECT (scroller));
+}
+
+static void
+detach_pool (void)
+{
+  GtkWidget *listbox = gd_model_list_box_new ();
+  GtkWidget *scroller = gtk_scrolled_window_new (NULL, NULL);
+  GListStore *store = g_list_store_new (GTK_TYPE_LABEL); // Shrug
+  GdModelListBox *box = GD_MODEL_LIST_BOX (listbox);
+  GdModelListBoxStats stats;
+  GtkAllocation fake_alloc;
+  GtkAdjustment *vadjustment;
+  GtkWidget *first_row;
+
+  gtk_container_add (GTK_CONTAINER (scroller), listbox);
+  g_object_ref_sink (G_OBJECT (scroller));
+  vadjustment = gtk_scrolled_window_get_vadjustment (GTK_SCROLLED_WINDOW (scroller));
+
+  append_rows (store, 100);
+  gd_model_list_box_set_detach_pool (box, TRUE);
+  gd_model_list_box_set_model (box, G_LIST_MODEL (store),
+                               label_from_label, NULL, NULL,
+                               NULL, NULL, NULL);
+
+  fake_alloc.x = 0;
+  fake_alloc.y = 0;
+  fake_alloc.width = 300;
+  fake_alloc.height = 500;
+  gtk_widget_size_allocate (scroller, &fake_alloc, -1);
+  first_row = g_ptr_array_index (box->widgets, 0);
+
+  // The first row goes into the pool, but stays parented for this frame
+  gtk_adjustment_set_value (vadjustment, ROW_HEIGHT + 10);
+  gtk_widget_size_allocate (scroller, &fake_alloc, -1);
+  g_assert_cmpuint (box->pool->len, ==, 1);
+  g_assert_true (gtk_widget_get_parent (first_row) == listbox);
+
+  while (box->detach_id != 0)
+    g_main_context_iteration (NULL, TRUE);
+  g_assert_null (gtk_widget_get_parent (first_row));
+
+  // Coming back, it's parented again, still without binding it again
+  gd_model_list_box_reset_stats (box);
+  gtk_adjustment_set_value (vadjustment, 0);
+  gtk_widget_size_allocate (scroller, &fake_alloc, -1);
+
+  gd_model_list_box_get_stats (box, &stats);
+  g_assert_cmpuint (stats.affine_hits, ==, 1);
+  g_assert_true (g_ptr_array_index (box->widgets, 0) == first_row);
+  g_assert_true (gtk_widget_get_parent (first_row) == listbox);
+
+  g_object_unref (G_OBJECT (scroller));
+}
+
+static void
+count_upper_changes (GtkAdjustment *adjustment,
+                     GParamSpec    *pspec,
+                     gpointer       user_data)
+{
+  guint *n_changes = user_data;
+
+  (*n_changes) ++;
+}
+
+static void
+stable_upper (void)
+{
+  GtkWidget *listbox = gd_model_list_box_new ();
+  GtkWidget *scroller = gtk_scrolled_window_new (NULL, NULL);
+  GListStore *store = g_list_store_new (GTK_TYPE_LABEL); // Shrug
+  GdModelListBox *box = GD_MODEL_LIST_BOX (listbox);
+  GtkAllocation fake_alloc;
+  GtkAdjustment *vadjustment;
+  guint n_changes = 0;
+  guint i;
+
+  gtk_container_add (GTK_CONTAINER (scroller), listbox);
+  g_object_ref_sink (G_OBJECT (scroller));
+  vadjustment = gtk_scrolled_window_get_vadjustment (GTK_SCROLLED_WINDOW (scroller));
+
+  // Rows of 50, 100 and 150 pixels, so every set of visible rows
+  // has a slightly different average height
+  for (i = 0; i < 200; i ++)
+    {
+      GtkWidget *label = gtk_label_new ("Row");
+
+      g_object_set_data (G_OBJECT (label), "height", GINT_TO_POINTER (50 + (i % 3) * 50));
+      g_list_store_append (store, label);
+    }
+
+  gd_model_list_box_set_model (box, G_LIST_MODEL (store),
+                               label_from_label, NULL, NULL,
+                               NULL, NULL, NULL);
+  fake_alloc.x = 0;
+  fake_alloc.y = 0;
+  fake_alloc.width = 300;
+  fake_alloc.height = 500;
+  gtk_widget_size_allocate (scroller, &fake_alloc, -1);
+
+  g_signal_connect (vadjustment, "notify::upper", G_CALLBACK (count_upper_changes), &n_changes);
+
+  // Scroll through the first half in small steps
+  for (i = 0; i < 300; i ++)
+    {
+      gtk_adjustment_set_value (vadjustment, gtk_adjustment_get_value (vadjustment) + 30);
+      gtk_widget_size_allocate (scroller, &fake_alloc, -1);
+    }
+
+  // The estimate settles quickly, instead of changing with every row
+  g_assert_cmpuint (n_changes, <, 10);
+
+  // A new width starts the statistics over, with the rows in view
+  fake_alloc.width = 400;
+  gtk_widget_size_allocate (scroller, &fake_alloc, -1);
+  g_assert_cmpuint (box->height_count, ==, box->widgets->len);
+  g_assert_cmpuint (box->height_sum, >, 0);
+
+  // But at the end, the last row ends exactly at the bottom
+  gtk_adjustment_set_value (vadjustment,
+                            gtk_adjustment_get_upper (vadjustment) - gtk_adjustment_get_page_size (vadjustment));
+  gtk_widget_size_allocate (scroller, &fake_alloc, -1);
+  gtk_adjustment_set_value (vadjustment,
+                            gtk_adjustment_get_upper (vadjustment) - gtk_adjustment_get_page_size (vadjustment));
+  gtk_widget_size_allocate (scroller, &fake_alloc, -1);
+  g_assert_cmpuint (box->model_to, ==, 200);
+
+  g_object_unref (G_OBJECT (scroller));
+}
+
+static void
+huge_list (void)
+{
+  GtkWidget *listbox = gd_model_list_box_new ();
+  GtkWidget *scroller = gtk_scrolled_window_new (NULL, NULL);
+  GListStore *store = g_list_store_new (GTK_TYPE_LABEL); // Shrug
+  GdModelListBox *box = GD_MODEL_LIST_BOX (listbox);
+  GdModelListBoxScrollState state;
+  GtkAllocation fake_alloc;
+  GtkAdjustment *vadjustment;
+  GtkWidget *label;
+  GPtrArray *items;
+  const guint n_items = 300000;
+  const int row_height = 10000;
+  double page_size;
+  gboolean handled;
+  guint i;
+
+  gtk_container_add (GTK_CONTAINER (scroller), listbox);
+  g_object_ref_sink (G_OBJECT (scroller));
+  vadjustment = gtk_scrolled_window_get_vadjustment (GTK_SCROLLED_WINDOW (scroller));
+
+  // 3 billion pixels, more than an int can hold
+  label = gtk_label_new ("Tall");
+  g_object_ref_sink (label);
+  g_object_set_data (G_OBJECT (label), "height", GINT_TO_POINTER (row_height));
+  items = g_ptr_array_sized_new (n_items);
+  for (i = 0; i < n_items; i ++)
+    g_ptr_array_add (items, label);
+  g_list_store_splice (store, 0, 0, items->pdata, n_items);
+  g_ptr_array_free (items, TRUE);
+  g_object_unref (label);
+
+  gd_model_list_box_set_model (box, G_LIST_MODEL (store),
+                               label_from_label, NULL, NULL,
+                               NULL, NULL, NULL);
+  fake_alloc.x = 0;
+  fake_alloc.y = 0;
+  fake_alloc.width = 300;
+  fake_alloc.height = 500;
+  gtk_widget_size_allocate (scroller, &fake_alloc, -1);
+
+  g_assert_cmpint (box->list_upper, ==, (gint64)n_items * row_height);
+  g_assert_cmpfloat (gtk_adjustment_get_upper (vadjustment), <=, G_MAXINT);
+  page_size = gtk_adjustment_get_page_size (vadjustment);
+
+  // Keys still scroll the rows by a step, not by the scale times as much
+  g_signal_emit_by_name (box, "scroll-by", GTK_SCROLL_STEP_DOWN, &handled);
+  g_assert_true (handled);
+  gtk_widget_size_allocate (scroller, &fake_alloc, -1);
+  g_signal_emit_by_name (box, "scroll-by", GTK_SCROLL_STEP_DOWN, &handled);
+  gtk_widget_size_allocate (scroller, &fake_alloc, -1);
+  gd_model_list_box_get_scroll_state (box, &state);
+  g_assert_cmpuint (state.anchor_index, ==, 0);
+  g_assert_cmpint (state.anchor_offset, ==, 2 * ((int)page_size / 10));
+
+  // Dragging the scrollbar by less than a page still maps it onto the list,
+  // so the rows follow the slider instead of crawling by pixels
+  for (i = 1; i <= 60; i ++)
+    {
+      double value = i * 150.0;
+
+      gtk_adjustment_set_value (vadjustment, value);
+      gtk_widget_size_allocate (scroller, &fake_alloc, -1);
+      g_assert_cmpint (box->list_value, ==, (gint64) (value * box->adjustment_scale));
+    }
+  gd_model_list_box_get_scroll_state (box, &state);
+  g_assert_cmpuint (state.anchor_index, ==, (guint) (box->list_value / row_height));
+  g_assert_cmpuint (state.anchor_index, >, 0);
+
+  // Jumping to the middle of the scrollbar gets to the middle of the list
+  gtk_adjustment_set_value (vadjustment, (gtk_adjustment_get_upper (vadjustment) - page_size) / 2);
+  gtk_widget_size_allocate (scroller, &fake_alloc, -1);
+  gd_model_list_box_get_scroll_state (box, &state);
+  g_assert_cmpuint (state.anchor_index, >=, n_items / 2 - 1);
+  g_assert_cmpuint (state.anchor_index, <=, n_items / 2);
+
+  // Positioning by index is exact
+  gd_model_list_box_scroll_to_item (box, n_items - 10);
+  gtk_widget_size_allocate (scroller, &fake_alloc, -1);
+  gd_model_list_box_get_scroll_state (box, &state);
+  g_assert_cmpuint (state.anchor_index, ==, n_items - 10);
+  g_assert_cmpint (state.anchor_offset, ==, 0);
+
+  // And so is the end
+  gtk_adjustment_set_value (vadjustment, gtk_adjustment_get_upper (vadjustment) - page_size);
+  gtk_widget_size_allocate (scroller, &fake_alloc, -1);
+  g_assert_cmpuint (box->model_to, ==, n_items);
+  gd_model_list_box_get_scroll_state (box, &state);
+  g_assert_cmpuint (state.anchor_index, ==, n_items - 1);
+  g_assert_cmpint (state.anchor_offset, ==, row_height - 500);
+
+  g_object_unref (G_OBJECT (scroller));
+}
+
 int
 main (int argc, char **argv)
 {
+  const char *debug = g_getenv ("GD_LISTBOX_DEBUG");
+  char *flags;
+
+  /* Always enables the expensive layout consistency checks, on top of
+   * whatever other debug flags are set */
+  flags = g_strconcat (debug != NULL ? debug : "", ",validate", NULL);
+  g_setenv ("GD_LISTBOX_DEBUG", flags, TRUE);
+  g_free (flags);
+
   gtk_init ();
   g_test_init (&argc, &argv, NULL);
 
@@ -671,6 +2368,28 @@ main (int argc, char **argv)
   /*g_test_add_func ("/listbox/overscroll_top", overscroll_top);*/
   /*g_test_add_func ("/listbox/model-change", model_change);*/
   g_test_add_func ("/listbox/model-change-at-bottom", model_change_at_bottom);
+  g_test_add_func ("/listbox/model-change-batched", model_change_batched);
+  g_test_add_func ("/listbox/stats", stats);
+  g_test_add_func ("/listbox/selection", selection);
+  g_test_add_func ("/listbox/follow-tail", follow_tail);
+  g_test_add_func ("/listbox/widgetless", widgetless);
+  g_test_add_func ("/listbox/columns", columns);
+  g_test_add_func ("/listbox/column-resize", column_resize);
+  g_test_add_func ("/listbox/natural-width", natural_width);
+  g_test_add_func ("/listbox/scroll-state", scroll_state);
+  g_test_add_func ("/listbox/prewarm", prewarm);
+  g_test_add_func ("/listbox/invalidate-item", invalidate_item);
+  g_test_add_func ("/listbox/prepare", prepare);
+  g_test_add_func ("/listbox/out-of-sight-teleport", out_of_sight_teleport);
+  g_test_add_func ("/listbox/detach-pool", detach_pool);
+  g_test_add_func ("/listbox/stable-upper", stable_upper);
+  g_test_add_func ("/listbox/huge-list", huge_list);
+  g_test_add_func ("/sort-filter-model/sort-filter", sort_filter);
+  g_test_add_func ("/sort-filter-model/append", sort_filter_append);
+  g_test_add_func ("/array-model/records", array_model);
+  g_test_add_func ("/text-file-model/lines", text_file_model);
+  g_test_add_func ("/tree-list-model/expand", tree_list_model);
+  g_test_add_func ("/search-index/lookup", search_index);
 
   return g_test_run ();
 }